@@ -0,0 +1,748 @@
+#include "APU.h"
+#include <memory.h>
+#include "NES.h"
+#include "CPU.h"
+#include "CPUMem.h"
+#include "AudioRing.h"
+#include "Resampler.h"
+#include "State.h"
+
+// Linear mixing weights per output level, the non linear DAC of the
+// 2A03 is close to these for the levels games normally use
+#define PULSE_WEIGHT	0.00752f
+#define TRIANGLE_WEIGHT	0.00851f
+#define NOISE_WEIGHT	0.00494f
+#define DMC_WEIGHT		0.00335f
+
+// CPU cycles a DMC sample fetch halts the CPU for, it is 1 to 4
+// depending on what the CPU is doing and the common case is 4
+#define DMC_FETCH_CYCLES	4
+
+// Length counter values the upper five bits of the length registers select
+static const BYTE lengthTable[32] = {
+	10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+	12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+// 12.5%, 25%, 50% and negated 25% duty
+static const BYTE dutyTable[4][8] = {
+	{ 0, 1, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 1, 0, 0, 0, 0, 0 },
+	{ 0, 1, 1, 1, 1, 0, 0, 0 },
+	{ 1, 0, 0, 1, 1, 1, 1, 1 },
+};
+
+static const BYTE triangleTable[32] = {
+	15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+};
+
+// Timer periods in CPU cycles, NTSC
+static const WORD noisePeriodTable[16] = {
+	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const WORD dmcPeriodTable[16] = {
+	428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+// CPU cycles from the start of the frame counter sequence to each of its
+// steps, and the length of the whole sequence
+static const int frameStepCycles[2][5] = {
+	{ 7457, 14913, 22371, 29829, 0 },
+	{ 7457, 14913, 22371, 29829, 37281 },
+};
+static const int frameNumSteps[2]		= { 4, 5 };
+static const int frameSequenceCycles[2]	= { 29830, 37282 };
+
+APU::APU(CPU* pCpu, CPUMem* pMem) {
+	this->pCpu = pCpu;
+	pMemory = pMem;
+	pAudioRing = NULL;
+	pResampler = NULL;
+	pStats = NULL;
+	pResampled = NULL;
+	numFrameSamples = 0;
+	synthesize = false;
+	pBlip = NULL;
+	pSamples = NULL;
+	reset();
+	allocateSynthesis(true);
+}
+
+APU::~APU() {
+	allocateSynthesis(false);
+	delete pResampler;
+	delete[] pResampled;
+}
+
+// The band-limited buffer and the samples are only there while there is
+// synthesis, headless instances save the 35 KB
+void APU::allocateSynthesis(bool enabled) {
+	if (enabled && !synthesize) {
+		pBlip = new BlipBuffer();
+		pBlip->setRates(CPU_FREQUENCY, APU_SAMPLE_RATE);
+		pSamples = new short[BLIP_SIZE];
+	} else if (!enabled && synthesize) {
+		delete pBlip;
+		pBlip = NULL;
+		delete[] pSamples;
+		pSamples = NULL;
+		numFrameSamples = 0;
+	}
+	synthesize = enabled;
+}
+
+void APU::reset() {
+	memset(pulse, 0, sizeof(pulse));
+	memset(&triangle, 0, sizeof(triangle));
+	memset(&noise, 0, sizeof(noise));
+	memset(&dmc, 0, sizeof(dmc));
+
+	pulse[0].onesComplement = 1;
+	noise.shift = 1;
+	noise.period = noisePeriodTable[0];
+	dmc.period = dmcPeriodTable[0];
+	dmc.bitsRemaining = 8;
+	dmc.silence = 1;
+
+	fiveStep = 0;
+	irqInhibit = 0;
+	frameIrq = 0;
+	dmcIrq = 0;
+	stolenCycles = 0;
+	frameStep = 0;
+	frameDelay = frameStepCycles[0][0];
+
+	frameStart = pCpu->getTotalCycles();
+	time = 0;
+	if (pBlip) {
+		pBlip->clear();
+	}
+}
+
+//
+// Catching up with the CPU
+//
+
+// Runs the channels in stretches that end at the frame counter steps,
+// since those change the envelopes and length counters
+void APU::catchUp() {
+	unsigned long long now = pCpu->getTotalCycles();
+	if (now <= frameStart + time) {
+		return;
+	}
+
+	UINT target = (UINT)(now - frameStart);
+	while (time < target) {
+		UINT end = target - time < (UINT)frameDelay ? target : time + frameDelay;
+		runChannels(end);
+		frameDelay -= end - time;
+		time = end;
+		if (frameDelay == 0) {
+			clockFrameStep();
+		}
+	}
+}
+
+// Only the DMC matters to the CPU, the other channels are only run to
+// be heard
+void APU::runChannels(UINT end) {
+	if (synthesize) {
+		runPulse(pulse[0], end);
+		runPulse(pulse[1], end);
+		runTriangle(end);
+		runNoise(end);
+	}
+	runDMC(end);
+}
+
+void APU::setSynthesisEnabled(bool enabled) {
+	if (enabled && !synthesize) {
+		// Start the waveforms over from silence in a new audio frame
+		catchUp();
+		frameStart += time;
+		time = 0;
+		pulse[0].output = pulse[1].output = triangle.output = noise.output = dmc.output = 0;
+	}
+	allocateSynthesis(enabled);
+}
+
+// The pulse timer clocks every other CPU cycle. Each run starts by
+// bringing the output up to date, the registers may have changed since
+// the last one.
+void APU::runPulse(Pulse& p, UINT end) {
+	int period = (p.timer + 1) * 2;
+	int volume = pulseOutput(p);
+	int level = dutyTable[p.duty][p.step] ? volume : 0;
+	if (level != p.output) {
+		pBlip->addDelta(time, (level - p.output) * PULSE_WEIGHT);
+		p.output = level;
+	}
+
+	UINT t = time + p.delay;
+	if (volume == 0) {
+		// Silent, only keep the sequencer in step
+		if (t < end) {
+			UINT clocks = (end - t - 1) / period + 1;
+			p.step = (BYTE)((p.step + clocks) & 7);
+			t += clocks * period;
+		}
+	} else {
+		for (; t < end; t += period) {
+			p.step = (p.step + 1) & 7;
+			level = dutyTable[p.duty][p.step] ? volume : 0;
+			if (level != p.output) {
+				pBlip->addDelta(t, (level - p.output) * PULSE_WEIGHT);
+				p.output = level;
+			}
+		}
+	}
+	p.delay = t - end;
+}
+
+// The triangle timer clocks every CPU cycle. It holds its level when
+// either counter is zero, and periods below 2 are ultrasonic and would
+// only alias, so those hold too.
+void APU::runTriangle(UINT end) {
+	int period = triangle.timer + 1;
+	int level = triangleTable[triangle.step];
+	if (level != triangle.output) {
+		pBlip->addDelta(time, (level - triangle.output) * TRIANGLE_WEIGHT);
+		triangle.output = level;
+	}
+
+	UINT t = time + triangle.delay;
+	if (!triangle.length || !triangle.linear || triangle.timer < 2) {
+		if (t < end) {
+			t += ((end - t - 1) / period + 1) * period;
+		}
+	} else {
+		for (; t < end; t += period) {
+			triangle.step = (triangle.step + 1) & 31;
+			level = triangleTable[triangle.step];
+			pBlip->addDelta(t, (level - triangle.output) * TRIANGLE_WEIGHT);
+			triangle.output = level;
+		}
+	}
+	triangle.delay = t - end;
+}
+
+// The shift register keeps running while the channel is silent, what it
+// holds decides the output once it is heard again
+void APU::runNoise(UINT end) {
+	int volume = noise.length ? envelopeVolume(noise.envelope) : 0;
+	int level = noiseOutput();
+	if (level != noise.output) {
+		pBlip->addDelta(time, (level - noise.output) * NOISE_WEIGHT);
+		noise.output = level;
+	}
+
+	int tap = noise.mode ? 6 : 1;
+	UINT t = time + noise.delay;
+	if (volume == 0) {
+		// The feedback bits of the next 15 - tap clocks only depend on bits
+		// already in the register, so that many clocks can be done at once
+		if (t < end) {
+			UINT clocks = (end - t - 1) / noise.period + 1;
+			t += clocks * noise.period;
+
+			UINT shift = noise.shift;
+			UINT chunk = 15 - tap;
+			for (; clocks >= chunk; clocks -= chunk) {
+				shift = (shift >> chunk) | (((shift ^ (shift >> tap)) & ((1 << chunk) - 1)) << (15 - chunk));
+			}
+			for (; clocks; --clocks) {
+				shift = (shift >> 1) | (((shift ^ (shift >> tap)) & 1) << 14);
+			}
+			noise.shift = (WORD)shift;
+		}
+	} else {
+		for (; t < end; t += noise.period) {
+			WORD feedback = (noise.shift ^ (noise.shift >> tap)) & 1;
+			noise.shift = (noise.shift >> 1) | (feedback << 14);
+			level = (noise.shift & 1) ? 0 : volume;
+			if (level != noise.output) {
+				pBlip->addDelta(t, (level - noise.output) * NOISE_WEIGHT);
+				noise.output = level;
+			}
+		}
+	}
+	noise.delay = t - end;
+}
+
+// The output unit shifts one bit per timer clock and moves the level up
+// or down by 2. Every 8 bits it takes the next byte from the sample
+// buffer, which is refilled from memory right away. The cycles each
+// read steals from the CPU are charged through takeStolenCycles.
+void APU::runDMC(UINT end) {
+	if (synthesize && dmc.level != dmc.output) {
+		pBlip->addDelta(time, (dmc.level - dmc.output) * DMC_WEIGHT);
+		dmc.output = dmc.level;
+	}
+
+	UINT t = time + dmc.delay;
+	if (dmc.silence && !dmc.bufferFull) {
+		// Nothing to play until the channel is restarted, just count bits
+		if (t < end) {
+			UINT clocks = (end - t - 1) / dmc.period + 1;
+			dmc.bitsRemaining = (BYTE)((dmc.bitsRemaining - 1 + 8 - clocks % 8) % 8 + 1);
+			t += clocks * dmc.period;
+		}
+	} else {
+		for (; t < end; t += dmc.period) {
+			if (!dmc.silence) {
+				if (dmc.shift & 1) {
+					if (dmc.level <= 125) {
+						dmc.level += 2;
+					}
+				} else if (dmc.level >= 2) {
+					dmc.level -= 2;
+				}
+				dmc.shift >>= 1;
+				if (synthesize && dmc.level != dmc.output) {
+					pBlip->addDelta(t, (dmc.level - dmc.output) * DMC_WEIGHT);
+					dmc.output = dmc.level;
+				}
+			}
+
+			if (--dmc.bitsRemaining == 0) {
+				dmc.bitsRemaining = 8;
+				if (dmc.bufferFull) {
+					dmc.silence = 0;
+					dmc.shift = dmc.sampleBuffer;
+					dmc.bufferFull = 0;
+					fetchSample();
+				} else {
+					dmc.silence = 1;
+				}
+			}
+		}
+	}
+	dmc.delay = t - end;
+}
+
+void APU::fetchSample() {
+	if (dmc.bufferFull || !dmc.bytesRemaining) {
+		return;
+	}
+
+	dmc.sampleBuffer = pMemory->peek(dmc.address);
+	dmc.bufferFull = 1;
+	stolenCycles += DMC_FETCH_CYCLES;
+	dmc.address = dmc.address == 0xFFFF ? 0x8000 : dmc.address + 1;
+
+	if (--dmc.bytesRemaining == 0) {
+		if (dmc.loop) {
+			dmc.address = dmc.sampleAddress;
+			dmc.bytesRemaining = dmc.sampleLength;
+		} else if (dmc.irqEnabled) {
+			dmcIrq = 1;
+		}
+	}
+}
+
+int APU::pulseOutput(const Pulse& p) {
+	// Periods below 8 and sweeps past $7FF mute the channel
+	if (!p.length || p.timer < 8 || sweepTarget(p) > 0x7FF) {
+		return 0;
+	}
+	return envelopeVolume(p.envelope);
+}
+
+int APU::noiseOutput() {
+	if (!noise.length || (noise.shift & 1)) {
+		return 0;
+	}
+	return envelopeVolume(noise.envelope);
+}
+
+//
+// Frame counter
+//
+
+void APU::clockFrameStep() {
+	int mode = fiveStep ? 1 : 0;
+	switch (frameStep) {
+	case 0:
+	case 2:
+		quarterFrame();
+		break;
+	case 1:
+		quarterFrame();
+		halfFrame();
+		break;
+	case 3:
+		// The last step of the four step sequence, nothing in the five step one
+		if (!mode) {
+			quarterFrame();
+			halfFrame();
+			if (!irqInhibit) {
+				frameIrq = 1;
+			}
+		}
+		break;
+	case 4:
+		quarterFrame();
+		halfFrame();
+		break;
+	}
+
+	if (frameStep + 1 < frameNumSteps[mode]) {
+		frameDelay = frameStepCycles[mode][frameStep + 1] - frameStepCycles[mode][frameStep];
+		++frameStep;
+	} else {
+		frameDelay = frameSequenceCycles[mode] - frameStepCycles[mode][frameStep] + frameStepCycles[mode][0];
+		frameStep = 0;
+	}
+}
+
+// Envelopes and the triangle's linear counter
+void APU::quarterFrame() {
+	clockEnvelope(pulse[0].envelope);
+	clockEnvelope(pulse[1].envelope);
+	clockEnvelope(noise.envelope);
+
+	if (triangle.reloadFlag) {
+		triangle.linear = triangle.linearReload;
+	} else if (triangle.linear) {
+		--triangle.linear;
+	}
+	if (!triangle.control) {
+		triangle.reloadFlag = 0;
+	}
+}
+
+// Length counters and sweeps
+void APU::halfFrame() {
+	for (int i = 0; i != 2; ++i) {
+		if (pulse[i].length && !pulse[i].envelope.loop) {
+			--pulse[i].length;
+		}
+		clockSweep(pulse[i]);
+	}
+	if (triangle.length && !triangle.control) {
+		--triangle.length;
+	}
+	if (noise.length && !noise.envelope.loop) {
+		--noise.length;
+	}
+}
+
+void APU::clockEnvelope(Envelope& e) {
+	if (e.start) {
+		e.start = 0;
+		e.decay = 15;
+		e.divider = e.volume;
+	} else if (e.divider) {
+		--e.divider;
+	} else {
+		e.divider = e.volume;
+		if (e.decay) {
+			--e.decay;
+		} else if (e.loop) {
+			e.decay = 15;
+		}
+	}
+}
+
+WORD APU::sweepTarget(const Pulse& p) {
+	int change = p.timer >> p.sweepShift;
+	if (p.sweepNegate) {
+		int target = p.timer - change - (p.onesComplement ? 1 : 0);
+		return (WORD)(target < 0 ? 0 : target);
+	}
+	return (WORD)(p.timer + change);
+}
+
+void APU::clockSweep(Pulse& p) {
+	WORD target = sweepTarget(p);
+	if (!p.sweepDivider && p.sweepEnabled && p.sweepShift && p.timer >= 8 && target <= 0x7FF) {
+		p.timer = target;
+	}
+	if (!p.sweepDivider || p.sweepReload) {
+		p.sweepDivider = p.sweepPeriod;
+		p.sweepReload = 0;
+	} else {
+		--p.sweepDivider;
+	}
+}
+
+//
+// Registers
+//
+
+void APU::writePulse(Pulse& p, int reg, BYTE value) {
+	switch (reg) {
+	case 0:
+		p.duty = value >> 6;
+		p.envelope.loop = (value >> 5) & 1;
+		p.envelope.constant = (value >> 4) & 1;
+		p.envelope.volume = value & 0x0F;
+		break;
+	case 1:
+		p.sweepEnabled = value >> 7;
+		p.sweepPeriod = (value >> 4) & 7;
+		p.sweepNegate = (value >> 3) & 1;
+		p.sweepShift = value & 7;
+		p.sweepReload = 1;
+		break;
+	case 2:
+		p.timer = (p.timer & 0x0700) | value;
+		break;
+	case 3:
+		p.timer = (p.timer & 0x00FF) | ((WORD)(value & 7) << 8);
+		if (p.enabled) {
+			p.length = lengthTable[value >> 3];
+		}
+		p.step = 0;
+		p.envelope.start = 1;
+		break;
+	}
+}
+
+void APU::writeReg(WORD address, BYTE value) {
+	STATS_SCOPE(pStats->apuCycles);
+	catchUp();
+
+	if (address < APU_TRIANGLE) {
+		writePulse(pulse[(address >> 2) & 1], address & 3, value);
+		return;
+	}
+
+	switch (address) {
+	case APU_TRIANGLE:
+		triangle.control = value >> 7;
+		triangle.linearReload = value & 0x7F;
+		break;
+	case APU_TRIANGLE + 2:
+		triangle.timer = (triangle.timer & 0x0700) | value;
+		break;
+	case APU_TRIANGLE + 3:
+		triangle.timer = (triangle.timer & 0x00FF) | ((WORD)(value & 7) << 8);
+		if (triangle.enabled) {
+			triangle.length = lengthTable[value >> 3];
+		}
+		triangle.reloadFlag = 1;
+		break;
+
+	case APU_NOISE:
+		noise.envelope.loop = (value >> 5) & 1;
+		noise.envelope.constant = (value >> 4) & 1;
+		noise.envelope.volume = value & 0x0F;
+		break;
+	case APU_NOISE + 2:
+		noise.mode = value >> 7;
+		noise.period = noisePeriodTable[value & 0x0F];
+		break;
+	case APU_NOISE + 3:
+		if (noise.enabled) {
+			noise.length = lengthTable[value >> 3];
+		}
+		noise.envelope.start = 1;
+		break;
+
+	case APU_DMC:
+		dmc.irqEnabled = value >> 7;
+		dmc.loop = (value >> 6) & 1;
+		dmc.period = dmcPeriodTable[value & 0x0F];
+		if (!dmc.irqEnabled) {
+			dmcIrq = 0;
+		}
+		break;
+	case APU_DMC + 1:
+		dmc.level = value & 0x7F;
+		break;
+	case APU_DMC + 2:
+		dmc.sampleAddress = 0xC000 | ((WORD)value << 6);
+		break;
+	case APU_DMC + 3:
+		dmc.sampleLength = ((WORD)value << 4) | 1;
+		break;
+
+	case APU_STATUS:
+		pulse[0].enabled = value & 1;
+		pulse[1].enabled = (value >> 1) & 1;
+		triangle.enabled = (value >> 2) & 1;
+		noise.enabled = (value >> 3) & 1;
+		dmc.enabled = (value >> 4) & 1;
+		if (!pulse[0].enabled)	pulse[0].length = 0;
+		if (!pulse[1].enabled)	pulse[1].length = 0;
+		if (!triangle.enabled)	triangle.length = 0;
+		if (!noise.enabled)		noise.length = 0;
+
+		if (!dmc.enabled) {
+			dmc.bytesRemaining = 0;
+		} else if (!dmc.bytesRemaining) {
+			dmc.address = dmc.sampleAddress;
+			dmc.bytesRemaining = dmc.sampleLength;
+			fetchSample();
+		}
+		dmcIrq = 0;
+		break;
+
+	case APU_FRAME:
+		// The real frame counter restarts 3 or 4 cycles after the write
+		fiveStep = value >> 7;
+		irqInhibit = (value >> 6) & 1;
+		if (irqInhibit) {
+			frameIrq = 0;
+		}
+		frameStep = 0;
+		frameDelay = frameStepCycles[fiveStep][0];
+		if (fiveStep) {
+			quarterFrame();
+			halfFrame();
+		}
+		break;
+	}
+}
+
+BYTE APU::readStatus() {
+	STATS_SCOPE(pStats->apuCycles);
+	catchUp();
+
+	BYTE value = 0;
+	if (pulse[0].length)	value |= 0x01;
+	if (pulse[1].length)	value |= 0x02;
+	if (triangle.length)	value |= 0x04;
+	if (noise.length)		value |= 0x08;
+	if (dmc.bytesRemaining)	value |= 0x10;
+	if (frameIrq)			value |= 0x40;
+	if (dmcIrq)				value |= 0x80;
+
+	// Reading acknowledges the frame interrupt
+	frameIrq = 0;
+	return value;
+}
+
+// Polled every scanline, so it only catches up when an interrupt could
+// have been raised since the last time. When the frame interrupt
+// is the only possible one, the cycle of the last four step sequence
+// step says whether it has been.
+bool APU::isIrqPending() {
+	if (frameIrq || dmcIrq) {
+		return true;
+	}
+
+	bool dmcPossible = dmc.irqEnabled && dmc.bytesRemaining;
+	if (!dmcPossible) {
+		if (irqInhibit || fiveStep) {
+			return false;
+		}
+		unsigned long long irqCycle = frameStart + time + frameDelay + frameStepCycles[0][3] - frameStepCycles[0][frameStep];
+		if (pCpu->getTotalCycles() < irqCycle) {
+			return false;
+		}
+	}
+
+	STATS_SCOPE(pStats->apuCycles);
+	catchUp();
+	return frameIrq || dmcIrq;
+}
+
+// Only catches up while a sample is playing, nothing else steals cycles
+int APU::takeStolenCycles() {
+	if (dmc.bytesRemaining) {
+		STATS_SCOPE(pStats->apuCycles);
+		catchUp();
+	}
+
+	int cycles = stolenCycles;
+	stolenCycles = 0;
+	return cycles;
+}
+
+//
+// Output
+//
+
+void APU::setAudioRing(AudioRing* p, int sampleRate) {
+	delete pResampler;
+	delete[] pResampled;
+	pResampler = p ? new Resampler(APU_SAMPLE_RATE, sampleRate) : NULL;
+	pResampled = p ? new short[BLIP_SIZE] : NULL;
+	pAudioRing = p;
+}
+
+void APU::endFrame() {
+	int count;
+	{
+		STATS_SCOPE(pStats->apuCycles);
+		catchUp();
+		count = endAudioFrame();
+	}
+
+	if (count && pAudioRing) {
+		STATS_SCOPE(pStats->resampleCycles);
+
+		// Half full leaves as much room for the producer running ahead
+		// as for it falling behind
+		pResampler->adjustForFill(pAudioRing->getFill(), pAudioRing->getCapacity() / 2);
+		int numOut;
+		while ((numOut = pResampler->process(pSamples, count, pResampled, BLIP_SIZE)) != 0) {
+			pAudioRing->write(pResampled, numOut);
+			count = 0;
+		}
+	}
+}
+
+// Returns how many samples the frame made
+int APU::endAudioFrame() {
+	int count = 0;
+	if (synthesize) {
+		pBlip->endFrame(time);
+		count = pBlip->readSamples(pSamples, BLIP_SIZE);
+	}
+
+	frameStart += time;
+	time = 0;
+	numFrameSamples = count;
+	return count;
+}
+
+// The state is saved caught up with the CPU and with the outputs up to
+// date, so it does not depend on when the APU last happened to run or
+// where the audio frames started. After a load every channel starts
+// over from silence in a new audio frame.
+UINT APU::getStateSize() {
+	return sizeof(pulse) + sizeof(triangle) + sizeof(noise) + sizeof(dmc) + sizeof(fiveStep) + sizeof(irqInhibit) +
+		sizeof(frameIrq) + sizeof(dmcIrq) + sizeof(stolenCycles) + sizeof(frameStep) + sizeof(frameDelay);
+}
+
+void APU::saveState(BYTE*& p) {
+	catchUp();
+	runChannels(time);
+	STATE_WRITE(p, pulse);
+	STATE_WRITE(p, triangle);
+	STATE_WRITE(p, noise);
+	STATE_WRITE(p, dmc);
+	STATE_WRITE(p, fiveStep);
+	STATE_WRITE(p, irqInhibit);
+	STATE_WRITE(p, frameIrq);
+	STATE_WRITE(p, dmcIrq);
+	STATE_WRITE(p, stolenCycles);
+	STATE_WRITE(p, frameStep);
+	STATE_WRITE(p, frameDelay);
+}
+
+void APU::loadState(const BYTE*& p) {
+	STATE_READ(p, pulse);
+	STATE_READ(p, triangle);
+	STATE_READ(p, noise);
+	STATE_READ(p, dmc);
+	STATE_READ(p, fiveStep);
+	STATE_READ(p, irqInhibit);
+	STATE_READ(p, frameIrq);
+	STATE_READ(p, dmcIrq);
+	STATE_READ(p, stolenCycles);
+	STATE_READ(p, frameStep);
+	STATE_READ(p, frameDelay);
+
+	frameStart = pCpu->getTotalCycles();
+	time = 0;
+	pulse[0].output = pulse[1].output = triangle.output = noise.output = dmc.output = 0;
+	if (pBlip) {
+		pBlip->clear();
+	}
+}
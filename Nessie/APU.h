@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Types.h"
+#include "Stats.h"
+#include "BlipBuffer.h"
+
+class CPU;
+class CPUMem;
+class AudioRing;
+class Resampler;
+
+// Sample rate the channels are mixed at, mono 16-bit
+#define APU_SAMPLE_RATE		44100
+
+/*	APU registers. Each pulse channel has four: duty, length halt and
+	volume (DDLC VVVV), sweep (EPPP NSSS), timer low and length index
+	plus timer high (LLLL LTTT). Writing the last one restarts the
+	envelope and the duty sequence. */
+#define APU_PULSE1		(0x4000)
+#define APU_PULSE2		(0x4004)
+#define APU_TRIANGLE	(0x4008)	// CRRR RRRR linear counter, then timer low and high like the pulses
+#define APU_NOISE		(0x400C)	// --LC VVVV, then M--- PPPP mode and period, then length index
+#define APU_DMC			(0x4010)	// IL-- RRRR, direct load, sample address, sample length
+
+/*	Writing enables the channels (---D NT21), disabled ones have their
+	length counters cleared. Reading returns whether the length counters
+	are non zero and whether the frame and DMC interrupts are pending
+	(IF-D NT21), and acknowledges the frame interrupt. */
+#define APU_STATUS		(0x4015)
+
+/*	Frame counter (MI-- ----). M selects the five step sequence, which
+	has no interrupt, and I inhibits the interrupt of the four step one.
+	Shares its address with JOYPAD2, which is read only. */
+#define APU_FRAME		(0x4017)
+
+/*	The five channels of the 2A03. They are emulated lazily: nothing runs
+	while the CPU executes, instead every register access and the end of
+	every frame first catch the APU up to the CPU's cycle count. Catching
+	up steps each channel from one timer clock to the next and only
+	tells the BlipBuffer when its output actually changes, so a quiet
+	channel costs next to nothing.
+
+	The channels are mixed linearly, the approximation of the non linear
+	DAC that most emulators use. When the frame ends its samples are
+	resampled to the rate of the audio ring in one batch, with the ratio
+	nudged to keep the ring half full, and written to it in one piece. */
+class APU {
+public:
+			APU		( CPU* pCpu, CPUMem* pMem );
+			~APU	( void );
+
+	void	reset	( void );
+
+	void	writeReg		( WORD address, BYTE value );
+	BYTE	readStatus		( void );
+
+	// The frame counter and DMC interrupt line, polled by the CPU
+	bool	isIrqPending	( void );
+
+	// CPU cycles the DMC sample fetches took since the last call, the CPU
+	// takes them once a scanline
+	int		takeStolenCycles	( void );
+
+	// Finishes the samples of the frame and hands them to the audio ring
+	void	endFrame		( void );
+
+	// The samples of the last finished frame, at APU_SAMPLE_RATE
+	const short*	getFrameSamples		( void )	{ return pSamples; }
+	int				getNumFrameSamples	( void )	{ return numFrameSamples; }
+
+	// The frame samples go here at sampleRate, NULL drops them. Owned by
+	// the caller, whose reader should consume at sampleRate.
+	void	setAudioRing	( AudioRing* p, int sampleRate );
+	void	setStats		( EmulatorStats* p )	{ pStats = p; }
+
+	/*	Without synthesis only what the game can observe is emulated: the
+		length counters behind $4015, the frame interrupt
+		and the DMC, whose fetches steal CPU cycles and raise its
+		interrupt. The pulse, triangle and noise waveforms are not run
+		and no samples are made. What the CPU sees is the same either
+		way, but the waveform state in save states is not, so states are
+		only comparable between instances in the same mode. */
+	void	setSynthesisEnabled	( bool enabled );
+	bool	isSynthesisEnabled	( void )	{ return synthesize; }
+
+	// Save states, saveState writes getStateSize bytes
+	UINT	getStateSize	( void );
+	void	saveState	( BYTE*& p );
+	void	loadState	( const BYTE*& p );
+
+private:
+	struct Envelope {
+		BYTE	start;
+		BYTE	loop;		// Also halts the length counter
+		BYTE	constant;
+		BYTE	volume;		// Constant volume or divider period
+		BYTE	divider;
+		BYTE	decay;
+	};
+
+	struct Pulse {
+		Envelope	envelope;
+		BYTE	enabled;
+		BYTE	duty;
+		BYTE	step;
+		BYTE	length;
+		BYTE	sweepEnabled;
+		BYTE	sweepPeriod;
+		BYTE	sweepNegate;
+		BYTE	sweepShift;
+		BYTE	sweepDivider;
+		BYTE	sweepReload;
+		BYTE	onesComplement;		// Pulse 1 negates without the +1
+		WORD	timer;
+		int		delay;		// CPU cycles to the next timer clock
+		int		output;		// What the blip buffer was last told
+	};
+
+	struct Triangle {
+		BYTE	enabled;
+		BYTE	control;	// Also halts the length counter
+		BYTE	linearReload;
+		BYTE	linear;
+		BYTE	reloadFlag;
+		BYTE	step;
+		BYTE	length;
+		WORD	timer;
+		int		delay;
+		int		output;
+	};
+
+	struct Noise {
+		Envelope	envelope;
+		BYTE	enabled;
+		BYTE	mode;
+		BYTE	length;
+		WORD	period;
+		WORD	shift;
+		int		delay;
+		int		output;
+	};
+
+	struct DMC {
+		BYTE	enabled;
+		BYTE	irqEnabled;
+		BYTE	loop;
+		BYTE	level;
+		BYTE	sampleBuffer;
+		BYTE	bufferFull;
+		BYTE	shift;
+		BYTE	bitsRemaining;
+		BYTE	silence;
+		WORD	period;
+		WORD	sampleAddress;
+		WORD	sampleLength;
+		WORD	address;
+		WORD	bytesRemaining;
+		int		delay;
+		int		output;
+	};
+
+	void	catchUp			( void );
+	void	runChannels		( UINT end );
+	void	runPulse		( Pulse& p, UINT end );
+	void	runTriangle		( UINT end );
+	void	runNoise		( UINT end );
+	void	runDMC			( UINT end );
+	int		endAudioFrame	( void );
+	void	allocateSynthesis	( bool enabled );
+
+	void	clockFrameStep	( void );
+	void	quarterFrame	( void );
+	void	halfFrame		( void );
+	void	clockEnvelope	( Envelope& e );
+	void	clockSweep		( Pulse& p );
+	WORD	sweepTarget		( const Pulse& p );
+	void	fetchSample		( void );
+
+	void	writePulse		( Pulse& p, int reg, BYTE value );
+
+	// Output levels
+	int		pulseOutput		( const Pulse& p );
+	int		noiseOutput		( void );
+	int		envelopeVolume	( const Envelope& e )	{ return e.constant ? e.volume : e.decay; }
+
+	Pulse		pulse[2];
+	Triangle	triangle;
+	Noise		noise;
+	DMC			dmc;
+
+	// Frame counter
+	BYTE	fiveStep;
+	BYTE	irqInhibit;
+	BYTE	frameIrq;
+	BYTE	dmcIrq;
+	int		frameStep;
+	int		frameDelay;		// CPU cycles to the next step
+
+	// DMC fetches the CPU has not been charged for yet
+	int		stolenCycles;
+
+	// Time, in CPU cycles. The APU has run up to frameStart + time.
+	unsigned long long	frameStart;
+	UINT				time;
+
+	CPU*		pCpu;
+	CPUMem*		pMemory;
+	AudioRing*	pAudioRing;
+	Resampler*	pResampler;		// Only while there is a ring
+	short*		pResampled;		// BLIP_SIZE samples, with the resampler
+	bool		synthesize;
+
+	// Frame statistics, only touched when built with NESSIE_INSTRUMENT
+	EmulatorStats*	pStats;
+
+	// Only while synthesizing
+	BlipBuffer*	pBlip;
+	short*		pSamples;	// BLIP_SIZE samples
+	int			numFrameSamples;
+};
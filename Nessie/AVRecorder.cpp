@@ -0,0 +1,242 @@
+#include "AVRecorder.h"
+#include <memory.h>
+#include "NES.h"
+#include "Palette.h"
+#include "Timer.h"
+
+static const char rawMagic[4] = { 'N', 'A', 'V', 0x1A };
+
+// Studio range BT.601 Y, U and V of each palette entry
+static BYTE yuvTable[64][3];
+
+static void buildYuvTable() {
+	for (int i = 0; i != 64; ++i) {
+		double r = (NESPalette[i] >> 16) & 0xFF;
+		double g = (NESPalette[i] >> 8) & 0xFF;
+		double b = NESPalette[i] & 0xFF;
+		yuvTable[i][0] = (BYTE)(16.5 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0);
+		yuvTable[i][1] = (BYTE)(128.5 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0);
+		yuvTable[i][2] = (BYTE)(128.5 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0);
+	}
+}
+
+static void writeWavHeader(FILE* pFile, int sampleRate, UINT dataBytes) {
+	BYTE header[44];
+	memcpy(header, "RIFF", 4);
+	*(UINT*)(header + 4) = 36 + dataBytes;
+	memcpy(header + 8, "WAVEfmt ", 8);
+	*(UINT*)(header + 16) = 16;
+	*(WORD*)(header + 20) = 1;					// PCM
+	*(WORD*)(header + 22) = 1;					// Mono
+	*(UINT*)(header + 24) = sampleRate;
+	*(UINT*)(header + 28) = sampleRate * 2;		// Bytes per second
+	*(WORD*)(header + 32) = 2;					// Bytes per sample
+	*(WORD*)(header + 34) = 16;
+	memcpy(header + 36, "data", 4);
+	*(UINT*)(header + 40) = dataBytes;
+	fwrite(header, sizeof(header), 1, pFile);
+}
+
+AVRecorder::AVRecorder() {
+	pSlots = NULL;
+	numSlots = 0;
+	writeIndex = readIndex = 0;
+	quit = 0;
+	thread = NULL;
+	dataEvent = spaceEvent = NULL;
+	pVideoFile = pAudioFile = NULL;
+	audioBytes = 0;
+	framesWritten = 0;
+	failed = 0;
+	pPlanes = NULL;
+	framesDropped = 0;
+	blockedTicks = 0;
+}
+
+AVRecorder::~AVRecorder() {
+	close();
+}
+
+bool AVRecorder::open(const char* pBaseName, AVFormat outputFormat, AVBackpressure mode, UINT queueFrames, int sampleRate) {
+	close();
+	format = outputFormat;
+	backpressure = mode;
+	rate = sampleRate;
+
+	char name[MAX_PATH];
+	if (format == AV_FORMAT_Y4M_WAV) {
+		sprintf_s(name, MAX_PATH, "%s.y4m", pBaseName);
+		if (fopen_s(&pVideoFile, name, "wb") != 0 || !pVideoFile) {
+			pVideoFile = NULL;
+			return false;
+		}
+		sprintf_s(name, MAX_PATH, "%s.wav", pBaseName);
+		if (fopen_s(&pAudioFile, name, "wb") != 0 || !pAudioFile) {
+			pAudioFile = NULL;
+			close();
+			return false;
+		}
+
+		// The frame rate is exact, one frame is 262 scanlines of CPU cycles.
+		// NTSC pixels are 8:7.
+		fprintf(pVideoFile, "YUV4MPEG2 W%d H%d F%d:%d Ip A8:7 C444\n", SCREEN_WIDTH, SCREEN_HEIGHT,
+			CPU_FREQUENCY, NUM_CYCLES_PER_SCANLINE * (NUM_SCANLINES_SCREEN + NUM_SCANLINES_VBLANK));
+		writeWavHeader(pAudioFile, rate, 0);
+		buildYuvTable();
+		pPlanes = new BYTE[SCREEN_WIDTH * SCREEN_HEIGHT * 3];
+	} else {
+		sprintf_s(name, MAX_PATH, "%s.nav", pBaseName);
+		if (fopen_s(&pVideoFile, name, "wb") != 0 || !pVideoFile) {
+			pVideoFile = NULL;
+			return false;
+		}
+		UINT header = (UINT)rate;
+		fwrite(rawMagic, 4, 1, pVideoFile);
+		fwrite(&header, sizeof(header), 1, pVideoFile);
+	}
+
+	numSlots = 2;
+	while (numSlots < queueFrames) {
+		numSlots <<= 1;
+	}
+	pSlots = new Slot[numSlots];
+	writeIndex = readIndex = 0;
+	quit = 0;
+	audioBytes = 0;
+	framesWritten = 0;
+	failed = 0;
+	framesDropped = 0;
+	blockedTicks = 0;
+
+	dataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	spaceEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+	return true;
+}
+
+void AVRecorder::close() {
+	if (thread) {
+		InterlockedExchange(&quit, 1);
+		SetEvent(dataEvent);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+		CloseHandle(dataEvent);
+		CloseHandle(spaceEvent);
+		thread = dataEvent = spaceEvent = NULL;
+	}
+
+	if (pAudioFile) {
+		finishWav();
+		fclose(pAudioFile);
+		pAudioFile = NULL;
+	}
+	if (pVideoFile) {
+		fclose(pVideoFile);
+		pVideoFile = NULL;
+	}
+
+	delete[] pSlots;
+	pSlots = NULL;
+	delete[] pPlanes;
+	pPlanes = NULL;
+}
+
+LONGLONG AVRecorder::getBlockedNs() {
+	return timerToNs(blockedTicks);
+}
+
+void AVRecorder::addFrame(UINT frame, const BYTE* pFrameBuffer, const short* pSamples, UINT numSamples) {
+	if (!thread) {
+		return;
+	}
+
+	LONG w = writeIndex;
+	while ((UINT)(w - readIndex) == numSlots) {
+		if (backpressure == AV_DROP) {
+			++framesDropped;
+			return;
+		}
+		LONGLONG start = readTimer();
+		WaitForSingleObject(spaceEvent, INFINITE);
+		blockedTicks += readTimer() - start;
+	}
+
+	// The reader is done with the slot once readIndex has passed it
+	MemoryBarrier();
+	Slot& slot = pSlots[w & (numSlots - 1)];
+	slot.frame = frame;
+	slot.numSamples = numSamples < AV_MAX_SAMPLES ? numSamples : AV_MAX_SAMPLES;
+	memcpy(slot.video, pFrameBuffer, sizeof(slot.video));
+	memcpy(slot.audio, pSamples, slot.numSamples * sizeof(short));
+
+	// The slot contents must be visible before the index that publishes it
+	MemoryBarrier();
+	writeIndex = w + 1;
+	SetEvent(dataEvent);
+}
+
+DWORD WINAPI AVRecorder::threadProc(LPVOID pParam) {
+	((AVRecorder*)pParam)->writerLoop();
+	return 0;
+}
+
+// Drains the queue until close asks it to stop and it is empty
+void AVRecorder::writerLoop() {
+	for (;;) {
+		LONG r = readIndex;
+		if (r == writeIndex) {
+			if (quit) {
+				break;
+			}
+			WaitForSingleObject(dataEvent, INFINITE);
+			continue;
+		}
+
+		MemoryBarrier();
+		writeSlot(pSlots[r & (numSlots - 1)]);
+		MemoryBarrier();
+		readIndex = r + 1;
+		SetEvent(spaceEvent);
+	}
+}
+
+void AVRecorder::writeSlot(const Slot& slot) {
+	bool ok;
+	if (format == AV_FORMAT_Y4M_WAV) {
+		BYTE* pY = pPlanes;
+		BYTE* pU = pY + SCREEN_WIDTH * SCREEN_HEIGHT;
+		BYTE* pV = pU + SCREEN_WIDTH * SCREEN_HEIGHT;
+		for (int i = 0; i != SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+			const BYTE* pYuv = yuvTable[slot.video[i] & 0x3F];
+			pY[i] = pYuv[0];
+			pU[i] = pYuv[1];
+			pV[i] = pYuv[2];
+		}
+		ok = fwrite("FRAME\n", 6, 1, pVideoFile) == 1;
+		ok = fwrite(pPlanes, SCREEN_WIDTH * SCREEN_HEIGHT * 3, 1, pVideoFile) == 1 && ok;
+		if (slot.numSamples) {
+			ok = fwrite(slot.audio, slot.numSamples * sizeof(short), 1, pAudioFile) == 1 && ok;
+			audioBytes += slot.numSamples * sizeof(short);
+		}
+	} else {
+		AVRawRecord record;
+		record.frame = slot.frame;
+		record.numSamples = slot.numSamples;
+		ok = fwrite(&record, sizeof(record), 1, pVideoFile) == 1;
+		ok = fwrite(slot.video, sizeof(slot.video), 1, pVideoFile) == 1 && ok;
+		if (slot.numSamples) {
+			ok = fwrite(slot.audio, slot.numSamples * sizeof(short), 1, pVideoFile) == 1 && ok;
+		}
+	}
+
+	if (!ok) {
+		InterlockedExchange(&failed, 1);
+	}
+	InterlockedIncrement(&framesWritten);
+}
+
+// The sizes in the header are only known once the last frame is written
+void AVRecorder::finishWav() {
+	fseek(pAudioFile, 0, SEEK_SET);
+	writeWavHeader(pAudioFile, rate, audioBytes);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdio.h>
+#include "Types.h"
+#include "Emulator.h"
+
+// Audio samples a queued frame can carry, a frame at 44.1 kHz is ~730
+#define AV_MAX_SAMPLES	2048
+
+enum AVFormat {
+	AV_FORMAT_Y4M_WAV,		// <base>.y4m, 4:4:4 video, and <base>.wav, 16-bit mono
+	AV_FORMAT_RAW			// <base>.nav, see AVRawRecord
+};
+
+// What addFrame does when the writer has fallen behind
+enum AVBackpressure {
+	AV_BLOCK,				// Wait for a free slot, nothing is lost
+	AV_DROP					// Drop the frame and count it
+};
+
+/*	Record of the raw format, after the "NAV\x1A" magic and a UINT
+	sample rate: the header, then the palette index frame buffer exactly
+	as the emulator made it, then numSamples 16-bit samples. */
+struct AVRawRecord {
+	UINT	frame;
+	UINT	numSamples;
+};
+
+/*	Dumps the frames and audio of a run to disk on a thread of its own.
+	addFrame copies the frame buffer and the frame's samples into a slot
+	of a bounded queue and returns, converting to YUV and writing to the
+	files happen on the writer thread. So the emulation thread pays for
+	a copy and an event, unless the queue is full and the backpressure
+	mode is AV_BLOCK.
+
+	Dropped frames are missing from the output altogether, video and
+	audio both, so the streams stay in step with each other but not
+	with the run. */
+class AVRecorder {
+public:
+			AVRecorder	( void );
+			~AVRecorder	( void );
+
+	// Creates the output files and starts the writer
+	bool	open		( const char* pBaseName, AVFormat format, AVBackpressure mode, UINT queueFrames, int sampleRate );
+
+	// Waits for the queued frames to be written and closes the files
+	void	close		( void );
+
+	// Called by the emulator at the end of every frame
+	void	addFrame	( UINT frame, const BYTE* pFrameBuffer, const short* pSamples, UINT numSamples );
+
+	UINT		getFramesWritten	( void )	{ return (UINT)framesWritten; }
+	UINT		getFramesDropped	( void )	{ return framesDropped; }
+	LONGLONG	getBlockedNs		( void );	// Time addFrame spent waiting
+	bool		hasFailed			( void )	{ return failed != 0; }
+
+private:
+	struct Slot {
+		UINT	frame;
+		UINT	numSamples;
+		BYTE	video	[ SCREEN_WIDTH * SCREEN_HEIGHT ];
+		short	audio	[ AV_MAX_SAMPLES ];
+	};
+
+	static DWORD WINAPI	threadProc	( LPVOID pParam );
+
+	void	writerLoop		( void );
+	void	writeSlot		( const Slot& slot );
+	void	finishWav		( void );
+
+	AVFormat		format;
+	AVBackpressure	backpressure;
+	int				rate;
+
+	// Single producer, single consumer, indices only ever grow
+	Slot*			pSlots;
+	UINT			numSlots;		// A power of two
+	volatile LONG	writeIndex;
+	volatile LONG	readIndex;
+	volatile LONG	quit;
+
+	HANDLE			thread;
+	HANDLE			dataEvent;		// Something was queued
+	HANDLE			spaceEvent;		// A slot was freed
+
+	FILE*			pVideoFile;
+	FILE*			pAudioFile;
+	UINT			audioBytes;
+
+	// Written by the writer thread
+	volatile LONG	framesWritten;
+	volatile LONG	failed;
+	BYTE*			pPlanes;		// Y, U and V planes of one frame
+
+	// Written by the emulation thread
+	UINT			framesDropped;
+	LONGLONG		blockedTicks;
+};
@@ -0,0 +1,64 @@
+#include "AudioRing.h"
+#include <memory.h>
+
+AudioRing::AudioRing(UINT capacity) {
+	UINT size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	pSamples = new short[size];
+	memset(pSamples, 0, size * sizeof(short));
+	mask = size - 1;
+	writeIndex = 0;
+	readIndex = 0;
+	dropped = 0;
+	underruns = 0;
+}
+
+AudioRing::~AudioRing() {
+	delete[] pSamples;
+}
+
+UINT AudioRing::getFill() {
+	return (UINT)writeIndex - (UINT)readIndex;
+}
+
+// Copies in one or two pieces depending on where the ring wraps
+UINT AudioRing::write(const short* p, UINT count) {
+	UINT w = (UINT)writeIndex;
+	UINT space = getCapacity() - (w - (UINT)readIndex);
+	if (count > space) {
+		dropped += count - space;
+		count = space;
+	}
+
+	UINT start = w & mask;
+	UINT first = count < getCapacity() - start ? count : getCapacity() - start;
+	memcpy(pSamples + start, p, first * sizeof(short));
+	memcpy(pSamples, p + first, (count - first) * sizeof(short));
+
+	// The samples have to be visible before the index that publishes them
+	MemoryBarrier();
+	writeIndex = (LONG)(w + count);
+	return count;
+}
+
+UINT AudioRing::read(short* p, UINT count) {
+	UINT r = (UINT)readIndex;
+	UINT fill = (UINT)writeIndex - r;
+	MemoryBarrier();
+	if (count > fill) {
+		++underruns;
+		count = fill;
+	}
+
+	UINT start = r & mask;
+	UINT first = count < getCapacity() - start ? count : getCapacity() - start;
+	memcpy(p, pSamples + start, first * sizeof(short));
+	memcpy(p + first, pSamples, (count - first) * sizeof(short));
+
+	// Done with the samples before the writer may reuse their space
+	MemoryBarrier();
+	readIndex = (LONG)(r + count);
+	return count;
+}
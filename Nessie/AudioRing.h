@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+#include "Types.h"
+
+/*	Hands audio samples from the emulation thread to the audio callback.
+	There is exactly one writer and one reader, and each of the two
+	indices is only ever stored by its own side, so neither side takes a
+	lock or waits for the other. A full ring drops what the writer could
+	not fit and an empty one gives the reader fewer samples than it
+	asked for, the counts say how often either happened.
+
+	The indices count samples since the start and wrap around 2^32, the
+	capacity is a power of two so the distance between them is still
+	right after they wrap. */
+class AudioRing {
+public:
+			AudioRing	( UINT capacity );	// Rounded up to a power of two
+			~AudioRing	( void );
+
+	// Writer side
+	UINT	write		( const short* p, UINT count );
+	UINT	getDropped	( void )	{ return dropped; }
+
+	// Reader side
+	UINT	read		( short* p, UINT count );
+	UINT	getUnderruns	( void )	{ return underruns; }
+
+	// Samples waiting to be read, safe to call from either side
+	UINT	getFill		( void );
+	UINT	getCapacity	( void )	{ return mask + 1; }
+
+private:
+	short*	pSamples;
+	UINT	mask;
+
+	volatile LONG	writeIndex;		// Stored by the writer only
+	volatile LONG	readIndex;		// Stored by the reader only
+
+	UINT	dropped;
+	UINT	underruns;
+};
@@ -0,0 +1,123 @@
+#include "BatchRunner.h"
+#include <memory.h>
+#include "ThreadPool.h"
+#include "CPU.h"
+
+BatchRunner::BatchRunner(UINT num, int numThreads) {
+	numInstances = num;
+	ppInstances = new Emulator*[numInstances];
+	for (UINT i = 0; i != numInstances; ++i) {
+		ppInstances[i] = new Emulator();
+		ppInstances[i]->setTraceTrack(i);
+
+		// Nobody listens to a batch, getInstance(i)->setAudioEnabled
+		// turns the sound back on for an instance that needs it
+		ppInstances[i]->setAudioEnabled(false);
+	}
+	pPool = new ThreadPool(numThreads);
+
+	memset(&stepConfig, 0, sizeof(stepConfig));
+	stepConfig.numPorts = 1;
+	observationSize = 0;
+	pRamScratch = NULL;
+}
+
+BatchRunner::~BatchRunner() {
+	delete pPool;
+	for (UINT i = 0; i != numInstances; ++i) {
+		delete ppInstances[i];
+	}
+	delete[] ppInstances;
+	delete[] pRamScratch;
+}
+
+int BatchRunner::getNumThreads() {
+	return pPool->getNumThreads();
+}
+
+bool BatchRunner::getOpcodeStats(OpcodeStats& total) {
+	clearOpcodeStats(total);
+	for (UINT i = 0; i != numInstances; ++i) {
+		const OpcodeStats* pStats = ppInstances[i]->getCPU()->getOpcodeStats();
+		if (!pStats) {
+			return false;
+		}
+		addOpcodeStats(total, *pStats);
+	}
+	return true;
+}
+
+// The instances share one image, only what the cartridge can write is
+// kept per instance
+bool BatchRunner::loadFromFile(const char* pFileName) {
+	const char* pError;
+	CartridgeImage* pImage = CartridgeImage::load(pFileName, pError);
+	if (!pImage) {
+		return false;
+	}
+
+	bool loaded = true;
+	for (UINT i = 0; i != numInstances && loaded; ++i) {
+		loaded = ppInstances[i]->loadCartridge(pImage);
+	}
+	pImage->release();
+	return loaded;
+}
+
+void BatchRunner::configureStep(const StepConfig& config) {
+	for (UINT i = 0; i != numInstances; ++i) {
+		ppInstances[i]->configureStep(config);
+	}
+	stepConfig = config;
+	stepConfig.pRamAddresses = NULL;	// The instances keep their own copy
+	observationSize = ppInstances[0]->getObservationSize(config.format);
+
+	delete[] pRamScratch;
+	pRamScratch = NULL;
+	if (config.numRamAddresses) {
+		pRamScratch = new BYTE[numInstances * config.numRamAddresses];
+	}
+}
+
+void BatchRunner::step(const BYTE* pActions, int frameskip, void* pObservations, BYTE* pRam, LONGLONG* pEmulationNs) {
+	pStepActions = pActions;
+	stepFrameskip = frameskip;
+	pStepObservations = (BYTE*)pObservations;
+	pStepRam = pRam;
+	pStepEmulationNs = pEmulationNs;
+
+	// One task per instance so an instance stuck in a long frame
+	// only ever holds up itself.
+	pPool->parallelFor(numInstances, stepInstance, this);
+}
+
+void BatchRunner::stepInstance(void* pContext, UINT i) {
+	BatchRunner* pRunner = (BatchRunner*)pContext;
+	UINT n = pRunner->numInstances;
+
+	// Gather this instance's column of the action rows
+	BYTE actions[2];
+	actions[0] = pRunner->pStepActions[i];
+	actions[1] = pRunner->stepConfig.numPorts > 1 ? pRunner->pStepActions[n + i] : 0;
+
+	void* pObservation = NULL;
+	if (pRunner->pStepObservations) {
+		pObservation = pRunner->pStepObservations + (size_t)i * pRunner->observationSize;
+	}
+
+	UINT numRam = pRunner->stepConfig.numRamAddresses;
+	BYTE* pRam = (pRunner->pStepRam && numRam) ? pRunner->pRamScratch + i * numRam : NULL;
+
+	StepTiming timing;
+	pRunner->ppInstances[i]->step(actions, pRunner->stepFrameskip, pObservation, pRam, &timing);
+
+	// Scatter the RAM bytes into this instance's column
+	if (pRam) {
+		for (UINT a = 0; a != numRam; ++a) {
+			pRunner->pStepRam[a * n + i] = pRam[a];
+		}
+	}
+	if (pRunner->pStepEmulationNs) {
+		pRunner->pStepEmulationNs[i] = timing.emulationNs;
+	}
+}
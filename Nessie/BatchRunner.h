@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Types.h"
+#include "Emulator.h"
+
+class ThreadPool;
+struct OpcodeStats;
+
+/*	Owns a batch of emulator instances and steps all of them in parallel.
+	Everything going in and out is laid out structure of arrays so a
+	caller can hand over the whole batch in contiguous buffers:
+
+	actions			numPorts rows of numInstances bytes, port major
+	observations	numInstances observations back to back
+	ram				numRamAddresses rows of numInstances bytes
+	emulationNs		numInstances host times for the step */
+class BatchRunner {
+public:
+			BatchRunner		( UINT numInstances, int numThreads = 0 );
+			~BatchRunner	( void );
+
+	bool	loadFromFile	( const char* pFileName );
+	void	configureStep	( const StepConfig& config );
+
+	void	step			( const BYTE* pActions, int frameskip, void* pObservations, BYTE* pRam, LONGLONG* pEmulationNs );
+
+	Emulator*	getInstance			( UINT i )	{ return ppInstances[i]; }
+	UINT		getNumInstances		( void )	{ return numInstances; }
+	int			getNumThreads		( void );
+	UINT		getObservationSize	( void )	{ return observationSize; }
+
+	// Sum of the per-opcode counters of all instances, false when the
+	// build does not count them
+	bool		getOpcodeStats		( OpcodeStats& total );
+
+private:
+	static void	stepInstance	( void* pContext, UINT index );
+
+	Emulator**	ppInstances;
+	UINT		numInstances;
+	ThreadPool*	pPool;
+
+	StepConfig	stepConfig;
+	UINT		observationSize;
+
+	// Per instance RAM before it is transposed into the batch buffer
+	BYTE*		pRamScratch;
+
+	// Arguments of the step in flight
+	const BYTE*	pStepActions;
+	int			stepFrameskip;
+	BYTE*		pStepObservations;
+	BYTE*		pStepRam;
+	LONGLONG*	pStepEmulationNs;
+};
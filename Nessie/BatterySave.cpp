@@ -0,0 +1,120 @@
+#include "BatterySave.h"
+#include "Timer.h"
+
+BatterySave::BatterySave() {
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	pData = NULL;
+	size = 0;
+	thread = NULL;
+	flushEvent = NULL;
+	quit = 0;
+	numFlushes = 0;
+	flushTicks = 0;
+}
+
+BatterySave::~BatterySave() {
+	close();
+}
+
+bool BatterySave::open(const char* pFileName, UINT ramSize) {
+	close();
+	file = CreateFile(pFileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	// Mapping more than the file holds grows it, the new bytes are zero
+	mapping = CreateFileMapping(file, NULL, PAGE_READWRITE, 0, ramSize, NULL);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	pData = (BYTE*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, ramSize);
+	if (!pData) {
+		close();
+		return false;
+	}
+	size = ramSize;
+
+	quit = 0;
+	numFlushes = 0;
+	flushTicks = 0;
+	flushEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!flushEvent) {
+		close();
+		return false;
+	}
+	thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+	if (!thread) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void BatterySave::close() {
+	stopWriter();
+	if (flushEvent) {
+		CloseHandle(flushEvent);
+		flushEvent = NULL;
+	}
+
+	if (pData) {
+		flush();
+		UnmapViewOfFile(pData);
+		pData = NULL;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+}
+
+void BatterySave::stopWriter() {
+	if (thread) {
+		InterlockedExchange(&quit, 1);
+		SetEvent(flushEvent);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+		thread = NULL;
+	}
+}
+
+void BatterySave::requestFlush() {
+	SetEvent(flushEvent);
+}
+
+LONGLONG BatterySave::getFlushNs() {
+	return timerToNs(flushTicks);
+}
+
+DWORD WINAPI BatterySave::threadProc(LPVOID pParam) {
+	((BatterySave*)pParam)->flushLoop();
+	return 0;
+}
+
+void BatterySave::flushLoop() {
+	for (;;) {
+		WaitForSingleObject(flushEvent, INFINITE);
+		if (quit) {
+			break;
+		}
+		flush();
+	}
+}
+
+// Starts writing the dirty pages, then waits for them and the file's
+// metadata to reach the disk
+void BatterySave::flush() {
+	LONGLONG start = readTimer();
+	FlushViewOfFile(pData, size);
+	FlushFileBuffers(file);
+	flushTicks += readTimer() - start;
+	++numFlushes;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <windows.h>
+#include "Types.h"
+
+/*	Battery backed cartridge RAM kept in a .sav file mapped read/write.
+	The CPU writes straight into the mapping, so the written pages
+	belong to the OS right away and the emulator crashing loses none of
+	them. Flushing is for the OS going down: the emulator asks for a
+	flush at the end of every frame that wrote to the RAM, and a thread
+	of the save's own writes the view and the file to disk. Asking
+	costs an event and never waits on the disk. A request made while a
+	flush is running gets one more flush after it, which covers every
+	write up to the request. */
+class BatterySave {
+public:
+			BatterySave		( void );
+			~BatterySave	( void );
+
+	// Maps the first ramSize bytes of the file, creating it or growing it
+	// with zeros if it is shorter
+	bool	open			( const char* pFileName, UINT ramSize );
+
+	// Flushes whatever is left and waits for it
+	void	close			( void );
+
+	// Waits for the flush the writer is on and ends its thread. Later
+	// requests do nothing, close still does the last flush.
+	void	stopWriter		( void );
+
+	BYTE*	getData			( void )	{ return pData; }
+	UINT	getSize			( void )	{ return size; }
+
+	// Called by the emulator at the end of a frame that wrote to the RAM
+	void	requestFlush	( void );
+
+	// What the writer has done, for nessie-bench battery. The writer
+	// updates them without locking, read them after stopWriter.
+	UINT		getNumFlushes	( void )	{ return numFlushes; }
+	LONGLONG	getFlushNs		( void );	// Time the writer spent flushing
+
+private:
+	static DWORD WINAPI	threadProc	( LPVOID pParam );
+
+	void	flushLoop		( void );
+	void	flush			( void );
+
+	HANDLE			file;
+	HANDLE			mapping;
+	BYTE*			pData;
+	UINT			size;
+
+	HANDLE			thread;
+	HANDLE			flushEvent;		// Auto reset, a flush was asked for
+	volatile LONG	quit;
+	UINT			numFlushes;
+	LONGLONG		flushTicks;
+};
@@ -0,0 +1,94 @@
+#include "BlipBuffer.h"
+#include <math.h>
+#include <memory.h>
+
+#define PI	3.14159265358979323846
+
+// Where the impulse starts to roll off, as a fraction of the sample rate
+#define BLIP_CUTOFF	0.45
+
+BlipBuffer::BlipBuffer() {
+	factor = 0;
+	setRates(1789772.0, 44100);
+}
+
+BlipBuffer::~BlipBuffer() {
+}
+
+// Every phase holds a Blackman windowed sinc centered BLIP_TAPS / 2 plus
+// the phase fraction samples in, so reading is delayed by BLIP_TAPS / 2
+// samples. Each phase is normalized to sum to 1, that way a step
+// integrates to exactly its delta.
+void BlipBuffer::setRates(double clockRate, int sampleRate) {
+	factor = (unsigned long long)(sampleRate / clockRate * 4294967296.0 + 0.5);
+
+	for (int phase = 0; phase != BLIP_PHASES; ++phase) {
+		double sum = 0.0;
+		double taps[BLIP_TAPS];
+		for (int i = 0; i != BLIP_TAPS; ++i) {
+			double x = i - BLIP_TAPS / 2 - (double)phase / BLIP_PHASES;
+			double sinc = x == 0.0 ? 1.0 : sin(2.0 * PI * BLIP_CUTOFF * x) / (2.0 * PI * BLIP_CUTOFF * x);
+			double w = 2.0 * PI * (x + BLIP_TAPS / 2) / BLIP_TAPS;
+			double window = 0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+			taps[i] = sinc * window;
+			sum += taps[i];
+		}
+		for (int i = 0; i != BLIP_TAPS; ++i) {
+			kernel[phase][i] = (float)(taps[i] / sum);
+		}
+	}
+
+	clear();
+}
+
+void BlipBuffer::clear() {
+	offset = 0;
+	integrator = 0.0f;
+	dcLevel = 0.0f;
+	memset(buffer, 0, sizeof(buffer));
+}
+
+void BlipBuffer::endFrame(UINT clocks) {
+	offset += clocks * factor;
+
+	// Keep the oldest samples rather than writing past the end, a
+	// reader this far behind has lost the audio anyway
+	unsigned long long limit = ((unsigned long long)BLIP_SIZE) << 32;
+	if (offset > limit) {
+		offset = limit;
+	}
+}
+
+int BlipBuffer::readSamples(short* pOut, int count) {
+	int available = getSamplesAvailable();
+	if (count > available) {
+		count = available;
+	}
+
+	// The high pass takes out the DC offset of the channels, about 7 Hz
+	// at 44.1 kHz
+	float sum = integrator;
+	float dc = dcLevel;
+	for (int i = 0; i != count; ++i) {
+		sum += buffer[i];
+		float s = sum - dc;
+		dc += s * (1.0f / 1024.0f);
+
+		int sample = (int)(s * 32767.0f);
+		if (sample > 32767) {
+			sample = 32767;
+		} else if (sample < -32768) {
+			sample = -32768;
+		}
+		pOut[i] = (short)sample;
+	}
+	integrator = sum;
+	dcLevel = dc;
+
+	// Move the impulses of the following samples to the front
+	int remaining = available - count + BLIP_TAPS;
+	memmove(buffer, buffer + count, remaining * sizeof(float));
+	memset(buffer + remaining, 0, count * sizeof(float));
+	offset -= ((unsigned long long)count) << 32;
+	return count;
+}
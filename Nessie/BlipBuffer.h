@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Types.h"
+
+// Sub-sample positions a step is rounded to
+#define BLIP_PHASE_BITS	5
+#define BLIP_PHASES		(1 << BLIP_PHASE_BITS)
+
+// Output samples the impulse of one step is spread over
+#define BLIP_TAPS		16
+
+// Output samples a frame can hold, over four frames at 48 kHz
+#define BLIP_SIZE		4096
+
+/*	Band-limited synthesis of a signal that only ever changes in steps,
+	like the APU channels. Instead of being sampled every clock, the
+	buffer is told at which clock the signal changed and by how much.
+	Each change adds a windowed sinc impulse to the output samples
+	around it, and reading integrates the impulses back into the signal.
+	The steps come out without aliasing and the cost is per change, not
+	per clock.
+
+	Clocks are counted from the start of the current frame. endFrame
+	makes the samples up to its clock readable and starts the next
+	frame, the fraction of a sample left over carries into it. */
+class BlipBuffer {
+public:
+			BlipBuffer	( void );
+			~BlipBuffer	( void );
+
+	// Clock rate of the steps and sample rate of the output
+	void	setRates	( double clockRate, int sampleRate );
+	void	clear		( void );
+
+	// Adds a step of delta to the signal at a clock in the frame
+	inline void	addDelta	( UINT clock, float delta ) {
+		unsigned long long position = offset + clock * factor;
+		UINT index = (UINT)(position >> 32);
+		const float* pKernel = kernel[ (position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1) ];
+		float* pOut = buffer + index;
+		for (int i = 0; i != BLIP_TAPS; ++i) {
+			pOut[i] += pKernel[i] * delta;
+		}
+	}
+
+	void	endFrame			( UINT clocks );
+	int		getSamplesAvailable	( void )	{ return (int)(offset >> 32); }
+
+	// Reads up to count samples as 16-bit PCM and returns how many
+	int		readSamples	( short* pOut, int count );
+
+	// Output samples a frame of this many clocks produces, at most
+	int		getMaxSamples	( UINT clocks )	{ return (int)((clocks * factor + offset) >> 32) + 1; }
+
+private:
+	// Clocks to output samples, 32.32 fixed point
+	unsigned long long	factor;
+	unsigned long long	offset;
+
+	// Running sum of the impulses, and the DC level the high pass removes
+	float	integrator;
+	float	dcLevel;
+
+	float	kernel	[ BLIP_PHASES ][ BLIP_TAPS ];
+	float	buffer	[ BLIP_SIZE + BLIP_TAPS ];
+};
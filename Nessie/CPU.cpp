@@ -5,40 +5,10 @@
 #include "NES.h"
 #include "Emulator.h"
 #include "PPU.h"
-
-/* Bit0 - C - Carry flag: this holds the carry out of the most significant
-   bit in any arithmetic operation. In subtraction operations however, this
-   flag is cleared - set to 0 - if a borrow is required, set to 1 - if no
-   borrow is required. The carry flag is also used in shift and rotate
-   logical operations. */
-#define FLAG_C (0x1)
-
-   /* Bit1 - Z - Zero flag: this is set to 1 when any arithmetic or logical
-   operation produces a zero result, and is set to 0 if the result is
-   non-zero. */
-#define FLAG_Z (0x2)
-
-   /*	Bit 2 - I: this is an interrupt enable/disable flag. If it is set,
-		interrupts are disabled. If it is cleared, interrupts are enabled. */
-#define FLAG_I (0x4)
-
-   /*  Bit 3 - D: this is the decimal mode status flag. When set, and an Add with 
-	   Carry or Subtract with Carry instruction is executed, the source values are
-	   treated as valid BCD (Binary Coded Decimal, eg. 0x00-0x99 = 0-99) numbers.
-	   The result generated is also a BCD number. */
-#define FLAG_D (0x8)
-
-   /*	Bit 4 - B: this is set when a software interrupt (BRK instruction) is
-		executed. */
-#define FLAG_B (0x10)
-
-   /*   Bit 6 - V - Overflow flag: when an arithmetic operation produces a result
-		too large to be represented in a byte, V is set */
-#define FLAG_V (0x40)
-
-   /*   Bit 7 - S - Sign flag: this is set if the result of an operation is
-		negative, cleared if positive. */
-#define FLAG_N (0x80)
+#include "APU.h"
+#include "State.h"
+#include "Profiler.h"
+#include "Tracer.h"
 
 #define SETFLAG(A, B) A |= B
 #define CLEARFLAG(A, B) A &= ~B
@@ -48,7 +18,6 @@
 #define SETFLAGIFTRUE(A, B, C) if (C) { SETFLAG(A, B); } else { CLEARFLAG(A, B); }
 
 #define SET_N_Z(A, B) SETFLAGIFTRUE(A, FLAG_Z, B == 0); SETFLAGIFTRUE(A, FLAG_N, B & 0x80);
-#define SET_N_Z_C(A, B) SETFLAGIFTRUE(A, FLAG_Z, B == 0); SETFLAGIFTRUE(A, FLAG_N, B & 0x80); SETFLAGIFTRUE(A, FLAG_C, B >= 0x100);
 
 //						 0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F		
 const BYTE instrCycleCount[] = { 
@@ -56,7 +25,7 @@ const BYTE instrCycleCount[] = {
                 /* 1 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
                 /* 2 */  6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
                 /* 3 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                /* 4 */ 13, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+                /* 4 */  6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
                 /* 5 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
                 /* 6 */  6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
                 /* 7 */  2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
@@ -70,12 +39,52 @@ const BYTE instrCycleCount[] = {
                 /* F */  2, 5, 2, 2, 2, 4, 6, 2, 2, 4, 2, 2, 2, 4, 7, 2
 };
 
+// The official opcodes run has a case for, the unofficial ones trap
+const BYTE instrImplemented[] = {
+	/* 0 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 0,
+	/* 1 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	/* 2 */ 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* 3 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	/* 4 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* 5 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	/* 6 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* 7 */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	/* 8 */ 0, 1, 0, 0, 1, 1, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0,
+	/* 9 */ 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 1, 0, 0, 1, 0, 0,
+	/* A */ 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* B */ 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* C */ 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* D */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+	/* E */ 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0,
+	/* F */ 1, 1, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0, 0, 1, 1, 0
+};
+
+bool CPU::isImplemented(BYTE opCode) {
+	return instrImplemented[opCode] != 0;
+}
+
 CPU::CPU(CPUMem* p, Emulator* pEmu) {
 	pMemory = p;
+	pRam = p->getRam();
 	pEmulator = pEmu;
+	pProfiler = NULL;
+	nmiTraceStart = 0;
+	instructionCount = 0;
+	totalCycles = 0;
+
+	pOpcodeStats = NULL;
+	lastOpcode = 0;
+	pageCrossed = false;
+	branchTaken = false;
+	pageCrossCycles = 0;
+#ifdef NESSIE_OPCODE_STATS
+	pOpcodeStats = new OpcodeStats;
+	clearOpcodeStats(*pOpcodeStats);
+#endif
 }
 
 CPU::~CPU() {
+	delete pOpcodeStats;
 }
 
 void CPU::reset() {
@@ -87,12 +96,69 @@ void CPU::reset() {
 
 	cyclesLeftOnScanline = NUM_CYCLES_PER_SCANLINE;
 	scanline = 0;
+
+	// The counters measure from power on, a reset starts them over
+	instructionCount = 0;
+	totalCycles = 0;
+}
+
+void CPU::getRegisters(CPURegisters& r) {
+	r.P = P;
+	r.A = A;
+	r.X = X;
+	r.Y = Y;
+	r.F = F;
+	r.S = S;
+}
+
+void CPU::setRegisters(const CPURegisters& r) {
+	P = r.P;
+	A = r.A;
+	X = r.X;
+	Y = r.Y;
+	F = r.F;
+	S = r.S;
+}
+
+UINT CPU::getStateSize() {
+	return sizeof(P) + sizeof(A) + sizeof(X) + sizeof(Y) + sizeof(F) + sizeof(S) +
+		sizeof(cyclesLeftOnScanline) + sizeof(scanline) + sizeof(totalCycles);
+}
+
+void CPU::saveState(BYTE*& p) {
+	STATE_WRITE(p, P);
+	STATE_WRITE(p, A);
+	STATE_WRITE(p, X);
+	STATE_WRITE(p, Y);
+	STATE_WRITE(p, F);
+	STATE_WRITE(p, S);
+	STATE_WRITE(p, cyclesLeftOnScanline);
+	STATE_WRITE(p, scanline);
+	STATE_WRITE(p, totalCycles);
+}
+
+void CPU::loadState(const BYTE*& p) {
+	STATE_READ(p, P);
+	STATE_READ(p, A);
+	STATE_READ(p, X);
+	STATE_READ(p, Y);
+	STATE_READ(p, F);
+	STATE_READ(p, S);
+	STATE_READ(p, cyclesLeftOnScanline);
+	STATE_READ(p, scanline);
+	STATE_READ(p, totalCycles);
 }
 
 void CPU::run() {
 	// Load instruction
 	BYTE opCode = readMem(P++);
 	int extraCycles = 0;
+	pageCrossCycles = 0;
+	++instructionCount;
+#ifdef NESSIE_OPCODE_STATS
+	pageCrossed = false;
+	branchTaken = false;
+#endif
 
 	// Execute instrution
 	switch (opCode) {
@@ -144,10 +210,33 @@ void CPU::run() {
 		SET_N_Z(F, A);
 		break;
 
+		//
+		// ASL
+		//
+	case 0x0A:
+		SETFLAGIFTRUE(F, FLAG_C, A & 0x80);
+		A <<= 1;
+		SET_N_Z(F, A);
+		break;
+	case 0x06:
+		leftShift(getAddressZeroPage());
+		break;
+	case 0x16:
+		leftShift(getAddressZeroPageOffset(X));
+		break;
+	case 0x0E:
+		leftShift(getAddressAbsolute());
+		break;
+	case 0x1E:
+		leftShift(getAddressAbsoluteOffset(X));
+		break;
+
 		//
 		// BCC
 		//
-	case 0x90: branchIfNotFlag(FLAG_C); break;
+	case 0x90:
+		extraCycles = branchIfNotFlag(FLAG_C);
+		break;
 
 		//
 		// BCS
@@ -163,6 +252,23 @@ void CPU::run() {
 		extraCycles = branchIfFlag(FLAG_Z);
 		break;
 
+		//
+		// BIT
+		//
+	case 0x24:
+		bitTest(readMemZeroPage());
+		break;
+	case 0x2C:
+		bitTest(readMemAbsolute());
+		break;
+
+		//
+		// BMI
+		//
+	case 0x30:
+		extraCycles = branchIfFlag(FLAG_N);
+		break;
+
 		//
 		// BNE
 		//
@@ -177,6 +283,37 @@ void CPU::run() {
 		extraCycles = branchIfNotFlag(FLAG_N);
 		break;
 
+		//
+		// BRK
+		//
+	case 0x00:
+		// Pushes the address past the padding byte that follows it, and
+		// the flags with B set
+		++P;
+		push((BYTE)(P >> 8));
+		push((BYTE)(P & 0xFF));
+		push(F | FLAG_B | 0x20);
+		SETFLAG(F, FLAG_I);
+		P = (WORD)readMem(0xFFFE) | ((WORD)readMem(0xFFFF)) << 8;
+		if (pProfiler) {
+			pProfiler->call(P, S);
+		}
+		break;
+
+		//
+		// BVC
+		//
+	case 0x50:
+		extraCycles = branchIfNotFlag(FLAG_V);
+		break;
+
+		//
+		// BVS
+		//
+	case 0x70:
+		extraCycles = branchIfFlag(FLAG_V);
+		break;
+
 		//
 		// CLC
 		//
@@ -209,74 +346,70 @@ void CPU::run() {
 		// CPX
 		//
 	case 0xE0: // Immediate
-		{
-			WORD src = (WORD)X - (WORD)readMemImmediate();
-			SET_N_Z_C(F, src);
-		}
+		compare(X, readMemImmediate());
 		break;
 	case 0xE4: // Zero page
-		{
-			WORD src = (WORD)X - (WORD)readMemZeroPage();
-			SET_N_Z_C(F, src);
-		}
+		compare(X, readMemZeroPage());
 		break;
 	case 0xEC: // Absolute
-		{
-			WORD src = (WORD)X - (WORD)readMemAbsolute();
-			SET_N_Z_C(F, src);
-		}
+		compare(X, readMemAbsolute());
 		break;
 
 		//
 		// CMP
 		//	
 	case 0xC9:
-		{
-			WORD src = (WORD)A - (WORD)readMemImmediate();
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemImmediate());
 		break;
 	case 0xC5:
-		{
-			WORD src = (WORD)A - (WORD)readMemZeroPage();
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemZeroPage());
 		break;
 	case 0xD5:
-		{
-			WORD src = (WORD)A - (WORD)readMemZeroPageOffset(X);
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemZeroPageOffset(X));
 		break;
 	case 0xCD:
-		{
-			WORD src = (WORD)A - (WORD)readMemAbsolute();
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemAbsolute());
 		break;
 	case 0xDD:
-		{
-			WORD src = (WORD)A - (WORD)readMemAbsoluteOffset(X);
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemAbsoluteOffset(X));
 		break;
 	case 0xD9:
-		{
-			WORD src = (WORD)A - (WORD)readMemAbsoluteOffset(Y);
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemAbsoluteOffset(Y));
 		break;
 	case 0xC1:
-		{
-			WORD src = (WORD)A - (WORD)readMemPreIndexedIndirect();
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemPreIndexedIndirect());
 		break;
 	case 0xD1:
-		{
-			WORD src = (WORD)A - (WORD)readMemPostIndexedIndirect();
-			SET_N_Z_C(F, src);
-		}
+		compare(A, readMemPostIndexedIndirect());
+		break;
+
+		//
+		// CPY
+		//
+	case 0xC0: // Immediate
+		compare(Y, readMemImmediate());
+		break;
+	case 0xC4: // Zero page
+		compare(Y, readMemZeroPage());
+		break;
+	case 0xCC: // Absolute
+		compare(Y, readMemAbsolute());
+		break;
+
+		//
+		// DEC
+		//
+	case 0xC6:
+		decMem(getAddressZeroPage());
+		break;
+	case 0xD6:
+		decMem(getAddressZeroPageOffset(X));
+		break;
+	case 0xCE:
+		decMem(getAddressAbsolute());
+		break;
+	case 0xDE:
+		decMem(getAddressAbsoluteOffset(X));
 		break;
 
 		//
@@ -373,7 +506,9 @@ void CPU::run() {
 		{
 			WORD address = getAddressAbsolute();
 			BYTE low = readMem(address);
-			BYTE high = readMem(address + 1);
+			// The high byte comes from the same page, the 6502 does not
+			// carry into the pointer's high byte
+			BYTE high = readMem((address & 0xFF00) | (BYTE)(address + 1));
 			P = low;
 			P |= ((WORD)high) << 8;
 		}
@@ -389,6 +524,9 @@ void CPU::run() {
 			push((P >> 8) & 0xFF);
 			push(P & 0xFF);
 			P = destination;
+			if (pProfiler) {
+				pProfiler->call(destination, S);
+			}
 		}			
 		break;
 
@@ -498,6 +636,48 @@ void CPU::run() {
 		rightShift(getAddressAbsoluteOffset(X));
 		break;
 
+		//
+		// NOP
+		//
+	case 0xEA:
+		break;
+
+		//
+		// ORA
+		//
+	case 0x09:
+		A |= readMemImmediate();
+		SET_N_Z(F, A);
+		break;
+	case 0x05:
+		A |= readMemZeroPage();
+		SET_N_Z(F, A);
+		break;
+	case 0x15:
+		A |= readMemZeroPageOffset(X);
+		SET_N_Z(F, A);
+		break;
+	case 0x0D:
+		A |= readMemAbsolute();
+		SET_N_Z(F, A);
+		break;
+	case 0x1D:
+		A |= readMemAbsoluteOffset(X);
+		SET_N_Z(F, A);
+		break;
+	case 0x19:
+		A |= readMemAbsoluteOffset(Y);
+		SET_N_Z(F, A);
+		break;
+	case 0x01:
+		A |= readMemPreIndexedIndirect();
+		SET_N_Z(F, A);
+		break;
+	case 0x11:
+		A |= readMemPostIndexedIndirect();
+		SET_N_Z(F, A);
+		break;
+
 		//
 		// PHA
 		//
@@ -505,6 +685,14 @@ void CPU::run() {
 		push(A);
 		break;
 
+		//
+		// PHP
+		//
+	case 0x08:
+		// B and bit 5 only exist on the stack copy
+		push(F | FLAG_B | 0x20);
+		break;
+
 		//
 		// PLA
 		//
@@ -513,6 +701,13 @@ void CPU::run() {
 		SET_N_Z(F, A);
 		break;
 
+		//
+		// PLP
+		//
+	case 0x28:
+		F = (BYTE)((pop() & ~FLAG_B) | 0x20);
+		break;
+
 		//
 		// ROL
 		//
@@ -532,12 +727,38 @@ void CPU::run() {
 		rolMem(getAddressAbsoluteOffset(X));
 		break;
 
+		//
+		// ROR
+		//
+	case 0x6A:
+		ror(A);
+		break;
+	case 0x66:
+		rorMem(getAddressZeroPage());
+		break;
+	case 0x76:
+		rorMem(getAddressZeroPageOffset(X));
+		break;
+	case 0x6E:
+		rorMem(getAddressAbsolute());
+		break;
+	case 0x7E:
+		rorMem(getAddressAbsoluteOffset(X));
+		break;
+
 		//
 		// RTI
 		//
 	case 0x40:
 		{
-			F = pop();
+			if (pProfiler) {
+				pProfiler->ret(S);
+			}
+			if (nmiTraceStart) {
+				traceEvent("NMI", pEmulator->getTraceTrack(), nmiTraceStart, readTimer());
+				nmiTraceStart = 0;
+			}
+			F = (BYTE)((pop() & ~FLAG_B) | 0x20);
 			WORD newP = pop();
 			newP |= ((WORD)pop()) << 8;
 			P = newP;
@@ -549,6 +770,9 @@ void CPU::run() {
 		//
 	case 0x60:
 		{
+			if (pProfiler) {
+				pProfiler->ret(S);
+			}
 			WORD retAddr = pop();
 			retAddr |= ((WORD)pop()) << 8;
 			retAddr++;
@@ -556,6 +780,32 @@ void CPU::run() {
 		}
 		break;
 
+		//
+		// SBC
+		//
+	case 0xE9: A = addWithCarry(A, (BYTE)~readMemImmediate()); break;
+	case 0xE5: A = addWithCarry(A, (BYTE)~readMemZeroPage()); break;
+	case 0xF5: A = addWithCarry(A, (BYTE)~readMemZeroPageOffset(X)); break;
+	case 0xED: A = addWithCarry(A, (BYTE)~readMemAbsolute()); break;
+	case 0xFD: A = addWithCarry(A, (BYTE)~readMemAbsoluteOffset(X)); break;
+	case 0xF9: A = addWithCarry(A, (BYTE)~readMemAbsoluteOffset(Y)); break;
+	case 0xE1: A = addWithCarry(A, (BYTE)~readMemPreIndexedIndirect()); break;
+	case 0xF1: A = addWithCarry(A, (BYTE)~readMemPostIndexedIndirect()); break;
+
+		//
+		// SEC
+		//
+	case 0x38:
+		SETFLAG(F, FLAG_C);
+		break;
+
+		//
+		// SED
+		//
+	case 0xF8:
+		SETFLAG(F, FLAG_D);
+		break;
+
 		//
 		// SEI
 		//
@@ -567,10 +817,10 @@ void CPU::run() {
 		// STA
 		//
 	case 0x85: // Zero Page
-		store(getAddressZeroPage(), A);
+		storeZeroPage(getAddressZeroPage(), A);
 		break;
 	case 0x95: // Zero Page, X
-		store(getAddressZeroPageOffset(X), A);
+		storeZeroPage(getAddressZeroPageOffset(X), A);
 		break;
 	case 0x8D: // Absolute
 		store(getAddressAbsolute(), A);
@@ -592,23 +842,23 @@ void CPU::run() {
 		// STX
 		//
 	case 0x86: // Zero page
-		store(getAddressZeroPage(), X);
+		storeZeroPage(getAddressZeroPage(), X);
 		break;
 	case 0x96: // Zero page Y offset
-		store(getAddressZeroPageOffset(Y), X);
+		storeZeroPage(getAddressZeroPageOffset(Y), X);
 		break;
 	case 0x8E: // Absolute
 		store(getAddressAbsolute(), X);
 		break;
 
 		//
-		// STX
+		// STY
 		//
 	case 0x84: // Zero page
-		store(getAddressZeroPage(), Y);
+		storeZeroPage(getAddressZeroPage(), Y);
 		break;
 	case 0x94: // Zero page Y offset
-		store(getAddressZeroPageOffset(X), Y);
+		storeZeroPage(getAddressZeroPageOffset(X), Y);
 		break;
 	case 0x8C: // Absolute
 		store(getAddressAbsolute(), Y);
@@ -630,6 +880,14 @@ void CPU::run() {
 		SET_N_Z(F, Y);
 		break;
 
+		//
+		// TSX
+		//
+	case 0xBA:
+		X = S;
+		SET_N_Z(F, X);
+		break;
+
 		//
 		// TXA
 		//
@@ -645,6 +903,14 @@ void CPU::run() {
 		S = X;
 		break;
 
+		//
+		// TYA
+		//
+	case 0x98:
+		A = Y;
+		SET_N_Z(F, A);
+		break;
+
 	default:
 		char message[512];
 		sprintf_s(message, 512, "Unregnized instruction 0x%x : $%x", opCode, P-1);
@@ -653,31 +919,210 @@ void CPU::run() {
 		break;
 	}
 	
-	int cycles = instrCycleCount[opCode] + extraCycles;
+	int cycles = instrCycleCount[opCode] + extraCycles + pageCrossCycles;
 	if (cycles == 0) {
 		// fuck off
 		NOT_IMPLEMENTED;
 	}
 
-	cyclesLeftOnScanline -= cycles;
-	if (cyclesLeftOnScanline < 0) {
-		cyclesLeftOnScanline += NUM_CYCLES_PER_SCANLINE;
-		++scanline;
-		if (scanline < NUM_SCANLINES_SCREEN) {
-			pEmulator->getPPU()->renderScanline(scanline - 1, pEmulator->getScreenPixelBuffer() + ((scanline-1) * 256));
-		} else if (scanline == NUM_SCANLINES_SCREEN) {
-			// Need to cause VBLANK
-			doVblankInterrupt();
-			pEmulator->flipScreen();
-			pEmulator->getPPU()->setVblankFlag();
-		} else if (scanline == NUM_SCANLINES_SCREEN + NUM_SCANLINES_VBLANK ) {
-			scanline = 0;
-			pEmulator->getPPU()->clearVblankFlag();
+	if (pProfiler) {
+		pProfiler->advance(cycles, P);
+	}
+
+#ifdef NESSIE_OPCODE_STATS
+	OpcodeStats& stats = *pOpcodeStats;
+	++stats.executions[opCode];
+	stats.cycles[opCode] += cycles;
+	++stats.pairs[lastOpcode * 256 + opCode];
+	lastOpcode = opCode;
+
+	if (branchTaken) {
+		++stats.takenBranches[opCode];
+	}
+	if (pageCrossed) {
+		++stats.pageCrosses[opCode];
+	}
+#endif
+
+	tick(cycles);
+	if (pMemory->isDmaPending()) {
+		tickDma();
+	}
+}
+
+// Instruction pairs runFused executes in one dispatch. They were picked
+// from the pair counts of nessie-bench opcodes and common NES idioms.
+#define FUSED(first, second)	(((first) << 8) | (second))
+
+// Length of the first instruction of a fused pair, 0 for opcodes that
+// never start one
+static inline int fusedFirstLength(BYTE opCode) {
+	switch (opCode) {
+	case 0xCA: return 1;	// DEX
+	case 0x88: return 1;	// DEY
+	case 0x18: return 1;	// CLC
+	case 0xA9: return 2;	// LDA #
+	case 0xA5: return 2;	// LDA zp
+	case 0xC9: return 2;	// CMP #
+	case 0xC5: return 2;	// CMP zp
+	case 0xE6: return 2;	// INC zp
+	case 0xAD: return 3;	// LDA abs
+	}
+	return 0;
+}
+
+/*	Each fused handler does exactly what run would do for the two
+	instructions, using the same helpers, and charges the sum of their
+	cycles in one tick. That is only the same as ticking twice if the
+	first instruction does not end the scanline, since the scanline end
+	renders and may take the NMI, so pairs are only fused when the first
+	instruction fits in what is left of the scanline. That also lets a
+	handler charge the first instruction early when the second one
+	needs the cycle count to be right. */
+void CPU::runFused() {
+#ifdef NESSIE_OPCODE_STATS
+	// The counters need to see every instruction
+	run();
+#else
+	BYTE first = pMemory->peek(P);
+	int length = fusedFirstLength(first);
+	if (!length || pProfiler || cyclesLeftOnScanline < instrCycleCount[first]) {
+		run();
+		return;
+	}
+
+	BYTE second = pMemory->peek(P + length);
+	int extraCycles = 0;
+	int charged = 0;
+
+	switch (FUSED(first, second)) {
+	case FUSED(0xCA, 0xD0):		// DEX, BNE
+		P += 2;
+		--X;
+		SET_N_Z(F, X);
+		extraCycles = branchIfNotFlag(FLAG_Z);
+		break;
+
+	case FUSED(0x88, 0xD0):		// DEY, BNE
+		P += 2;
+		--Y;
+		SET_N_Z(F, Y);
+		extraCycles = branchIfNotFlag(FLAG_Z);
+		break;
+
+	case FUSED(0xA9, 0x85):		// LDA, STA
+	case FUSED(0xA9, 0x8D):
+	case FUSED(0xA5, 0x85):
+	case FUSED(0xA5, 0x8D):
+	case FUSED(0xAD, 0x85):
+	case FUSED(0xAD, 0x8D):
+		++P;
+		if (first == 0xA9) {
+			A = readMemImmediate();
+		} else if (first == 0xA5) {
+			A = readMemZeroPage();
+		} else {
+			A = readMemAbsolute();
+		}
+		SET_N_Z(F, A);
+		++P;
+		if (second == 0x85) {
+			storeZeroPage(getAddressZeroPage(), A);
+		} else {
+			// The store can reach the APU, which times register writes
+			// by the cycle count, so the LDA is charged before it
+			charged = instrCycleCount[first];
+			totalCycles += charged;
+			cyclesLeftOnScanline -= charged;
+			store(getAddressAbsolute(), A);
 		}
+		break;
+
+	case FUSED(0xC9, 0xF0):		// CMP, BEQ
+	case FUSED(0xC5, 0xF0):
+		++P;
+		compare(A, first == 0xC9 ? readMemImmediate() : readMemZeroPage());
+		++P;
+		extraCycles = branchIfFlag(FLAG_Z);
+		break;
+
+	case FUSED(0xE6, 0xD0):		// INC zp, BNE
+		++P;
+		incMem(getAddressZeroPage());
+		++P;
+		extraCycles = branchIfNotFlag(FLAG_Z);
+		break;
+
+	case FUSED(0x18, 0x69):		// CLC, ADC
+	case FUSED(0x18, 0x65):
+		P += 2;
+		CLEARFLAG(F, FLAG_C);
+		A = addWithCarry(A, second == 0x69 ? readMemImmediate() : readMemZeroPage());
+		break;
+
+	case FUSED(0xAD, 0x10):		// LDA abs, BPL, the $2002 vblank poll
+		++P;
+		A = readMemAbsolute();
+		SET_N_Z(F, A);
+		++P;
+		extraCycles = branchIfNotFlag(FLAG_N);
+		break;
+
+	default:
+		run();
+		return;
+	}
+
+	instructionCount += 2;
+	tick(instrCycleCount[first] + instrCycleCount[second] + extraCycles - charged);
+	if (pMemory->isDmaPending()) {
+		tickDma();
+	}
+#endif
+}
+
+// OAM DMA halts the CPU for 513 cycles, plus one more to line up with
+// an even cycle when the DMA starts on an odd one. The stall spans
+// several scanlines, tick renders all of them.
+void CPU::tickDma() {
+	pMemory->clearDmaPending();
+	tick(513 + (int)(totalCycles & 1));
+}
+
+void CPU::endScanline() {
+	// The APU interrupt line and the DMC's stolen cycles are only looked
+	// at between scanlines
+	APU* pApu = pEmulator->getAPU();
+	int stolenCycles = pApu->takeStolenCycles();
+	cyclesLeftOnScanline -= stolenCycles;
+	totalCycles += stolenCycles;
+	if (!(F & FLAG_I) && pApu->isIrqPending()) {
+		doIrq();
+	}
+
+	cyclesLeftOnScanline += NUM_CYCLES_PER_SCANLINE;
+	++scanline;
+	if (scanline < NUM_SCANLINES_SCREEN) {
+		if (pEmulator->isRenderEnabled()) {
+			STATS_SCOPE(pEmulator->getCurrentStats().renderCycles);
+			TRACE_SCOPE("scanline", pEmulator->getTraceTrack());
+			pEmulator->getPPU()->renderScanline(scanline - 1, pEmulator->getFrameBuffer() + ((scanline-1) * 256));
+		}
+	} else if (scanline == NUM_SCANLINES_SCREEN) {
+		// Need to cause VBLANK
+		doVblankInterrupt();
+		pEmulator->endFrame();
+		pEmulator->getPPU()->setVblankFlag();
+	} else if (scanline == NUM_SCANLINES_SCREEN + NUM_SCANLINES_VBLANK ) {
+		scanline = 0;
+		pEmulator->getPPU()->clearVblankFlag();
 	}
 }
 
 void CPU::doVblankInterrupt() {
+	STATS_COUNT(pEmulator->getCurrentStats().nmis);
+	nmiTraceStart = traceEnabled ? readTimer() : 0;
+
 	// Push the PC onto the stack
 	push((BYTE)(P >> 8));
 	push((BYTE)(P & 0xFF));
@@ -691,8 +1136,28 @@ void CPU::doVblankInterrupt() {
 	// Set the PC equal to the address specified in the 
 	// vector table for the NMI interrupt.
 	P = (WORD)readMem(0xFFFA) | ((WORD)readMem(0xFFFB)) << 8;
+	if (pProfiler) {
+		pProfiler->call(P, S);
+	}
 
 	cyclesLeftOnScanline -= 7;
+	totalCycles += 7;
+}
+
+// Same as the NMI but through the IRQ/BRK vector
+void CPU::doIrq() {
+	push((BYTE)(P >> 8));
+	push((BYTE)(P & 0xFF));
+	push(F & ~FLAG_B);
+	F |= FLAG_I;
+
+	P = (WORD)readMem(0xFFFE) | ((WORD)readMem(0xFFFF)) << 8;
+	if (pProfiler) {
+		pProfiler->call(P, S);
+	}
+
+	cyclesLeftOnScanline -= 7;
+	totalCycles += 7;
 }
 
 void CPU::incMem(WORD m) {
@@ -702,6 +1167,26 @@ void CPU::incMem(WORD m) {
 	SET_N_Z(F, b);
 }
 
+void CPU::decMem(WORD m) {
+	BYTE b = readMem(m);
+	--b;
+	store(m, b);
+	SET_N_Z(F, b);
+}
+
+// CMP, CPX and CPY. C is set when there is no borrow, reg >= m
+void CPU::compare(BYTE reg, BYTE m) {
+	BYTE result = (BYTE)(reg - m);
+	SETFLAGIFTRUE(F, FLAG_C, reg >= m);
+	SET_N_Z(F, result);
+}
+
+// BIT copies bits 7 and 6 of the operand to N and V
+void CPU::bitTest(BYTE m) {
+	SETFLAGIFTRUE(F, FLAG_Z, (A & m) == 0);
+	F = (BYTE)((F & ~(FLAG_N | FLAG_V)) | (m & (FLAG_N | FLAG_V)));
+}
+
 void CPU::rol(BYTE& b) {
 	BYTE carry = b & 0x80;
 	b <<= 1;
@@ -716,6 +1201,28 @@ void CPU::rolMem(WORD m) {
 	store(m, b);
 }
 
+void CPU::ror(BYTE& b) {
+	BYTE carry = b & 1;
+	b >>= 1;
+	b |= (F & FLAG_C) << 7;
+	SETFLAGIFTRUE(F, FLAG_C, carry);
+	SET_N_Z(F, b);
+}
+
+void CPU::rorMem(WORD m) {
+	BYTE b = readMem(m);
+	ror(b);
+	store(m, b);
+}
+
+void CPU::leftShift(WORD m) {
+	BYTE b = readMem(m);
+	SETFLAGIFTRUE(F, FLAG_C, b & 0x80);
+	b <<= 1;
+	SET_N_Z(F, b);
+	store(m, b);
+}
+
 void CPU::rightShift(WORD m) {
 	BYTE b = readMem(m);
 	SETFLAGIFTRUE(F, FLAG_C, b & 1);
@@ -725,18 +1232,21 @@ void CPU::rightShift(WORD m) {
 	store(m, b);
 }
 
+// The stack is always plain RAM at $0100-$01FF
 void CPU::push(BYTE b) {
-	store(0x100 | S, b);
+	pRam[0x100 | S] = b;
 	--S;	
 }
 
 BYTE CPU::pop(void) {
 	++S;	
-	return  readMem(0x100 | (WORD)S);	
+	return pRam[0x100 | (WORD)S];
 }
 
+// The branches return the cycles a taken branch adds to the two in
+// the table, one more when it lands on another page
 int CPU::branchIfNotFlag(BYTE flag) {
-	int cycles = 2;			
+	int cycles = 0;
 	if (!TESTFLAG(F, flag)) {
 		BYTE displacement = readMemImmediate();
 		WORD newP;							
@@ -745,7 +1255,13 @@ int CPU::branchIfNotFlag(BYTE flag) {
 		} else {								
 			newP = P + displacement;			
 		}										
-		cycles += ((P & 0xFF00) != ((newP) & 0xFF00)) ? 2 : 1;
+		cycles = ((P & 0xFF00) != ((newP) & 0xFF00)) ? 2 : 1;
+#ifdef NESSIE_OPCODE_STATS
+		// Taken by the condition, an offset of 0 lands where not taking
+		// it would
+		branchTaken = true;
+		pageCrossed = (P & 0xFF00) != (newP & 0xFF00);
+#endif
 		P = newP;
 	} else {	
 		++P;	
@@ -755,7 +1271,7 @@ int CPU::branchIfNotFlag(BYTE flag) {
 }
 
 int CPU::branchIfFlag(BYTE flag) {
-	int cycles = 2;			
+	int cycles = 0;
 	if (TESTFLAG(F, flag)) {
 		BYTE displacement = readMemImmediate();
 		WORD newP;							
@@ -764,7 +1280,11 @@ int CPU::branchIfFlag(BYTE flag) {
 		} else {								
 			newP = P + displacement;			
 		}										
-		cycles += ((P & 0xFF00) != ((newP) & 0xFF00)) ? 2 : 1;
+		cycles = ((P & 0xFF00) != ((newP) & 0xFF00)) ? 2 : 1;
+#ifdef NESSIE_OPCODE_STATS
+		branchTaken = true;
+		pageCrossed = (P & 0xFF00) != (newP & 0xFF00);
+#endif
 		P = newP;
 	} else {	
 		++P;	
@@ -777,12 +1297,13 @@ BYTE CPU::readMemImmediate() {
 	return readMem(P++);
 }
 
+// Indexing wraps around inside the zero page
 WORD CPU::getAddressZeroPageOffset(BYTE offset) {
-	return (WORD)readMem(P++)+(WORD)offset;
+	return (WORD)(BYTE)(readMem(P++) + offset);
 }
 
 BYTE CPU::readMemZeroPageOffset(BYTE offset) {
-	return readMem(getAddressZeroPageOffset(offset));
+	return pRam[getAddressZeroPageOffset(offset)];
 }
 
 WORD CPU::getAddressZeroPage() {
@@ -790,7 +1311,7 @@ WORD CPU::getAddressZeroPage() {
 }
 
 BYTE CPU::readMemZeroPage() {
-	return readMem(getAddressZeroPage());
+	return pRam[getAddressZeroPage()];
 }
 
 WORD CPU::getAddressAbsolute() {
@@ -810,16 +1331,25 @@ WORD CPU::getAddressAbsoluteOffset(BYTE offset) {
 	BYTE high = readMem(P++);
 	WORD w = (((WORD)high) << 8) | ((WORD)low);
 	w += offset;
+#ifdef NESSIE_OPCODE_STATS
+	pageCrossed = (w >> 8) != high;
+#endif
 	return w;
 }
 
+// Reads take a cycle more when the index carries into the high byte.
+// Stores and read-modify-writes always take it, the table has it.
 BYTE CPU::readMemAbsoluteOffset(BYTE offset) {
 	WORD w = getAddressAbsoluteOffset(offset);
+	pageCrossCycles = (BYTE)w < offset ? 1 : 0;
 	return readMem(w);
 }
 
+// ($nn,X): the pointer is at $nn+X, both of its bytes wrap around
+// inside the zero page
 WORD CPU::getAddressPreIndexedIndirect() {
-	WORD w = readMem(0xFF & readMem(P++)+X);
+	BYTE pointer = readMem(P++) + X;
+	WORD w = (((WORD)pRam[(BYTE)(pointer + 1)]) << 8) | ((WORD)pRam[pointer]);
 	return w;
 }
 
@@ -828,16 +1358,23 @@ BYTE CPU::readMemPreIndexedIndirect() {
 	return readMem(w);
 }
 
+// ($nn),Y: the pointer is at $nn, its high byte wraps around inside
+// the zero page, and Y is added to the address it points to
 WORD CPU::getAddressPostIndexedIndirect() {
-	BYTE low = readMem(P++);
-	BYTE high = readMem(P);
+	BYTE pointer = readMem(P++);
+	BYTE low = pRam[pointer];
+	BYTE high = pRam[(BYTE)(pointer + 1)];
 	WORD w = (((WORD)high) << 8) | ((WORD)low);
 	w += Y;
+#ifdef NESSIE_OPCODE_STATS
+	pageCrossed = (w >> 8) != high;
+#endif
 	return w;
 }
 
 BYTE CPU::readMemPostIndexedIndirect() {
 	WORD w = getAddressPostIndexedIndirect();
+	pageCrossCycles = (BYTE)w < Y ? 1 : 0;
 	return readMem(w);
 }
 
@@ -846,13 +1383,16 @@ BYTE CPU::addWithCarry(BYTE a, BYTE b) {
 	WORD wb = (WORD)b;
 	wa += wb;
 	wa += (WORD)F & 1;
-	
-	SET_N_Z_C(F, wa);
+	BYTE result = (BYTE)(wa & 0xFF);
+
+	SETFLAGIFTRUE(F, FLAG_C, wa >= 0x100);
+	SET_N_Z(F, result);
 
-	// I find this suspicious
+	// Overflow when both operands have the same sign and the result
+	// does not
 	SETFLAGIFTRUE(F, FLAG_V, 
-		!((a ^ b) & 0x80) && ((a ^ wa) & 0x80));
+		!((a ^ b) & 0x80) && ((a ^ result) & 0x80));
 
-	return (BYTE)(wa & 0xFF);
+	return result;
 }
 
@@ -2,8 +2,54 @@
 
 #include "Types.h"
 #include "CPUMem.h"
+#include "OpcodeStats.h"
+
+/* Bit0 - C - Carry flag: this holds the carry out of the most significant
+   bit in any arithmetic operation. In subtraction operations however, this
+   flag is cleared - set to 0 - if a borrow is required, set to 1 - if no
+   borrow is required. The carry flag is also used in shift and rotate
+   logical operations. */
+#define FLAG_C (0x1)
+
+   /* Bit1 - Z - Zero flag: this is set to 1 when any arithmetic or logical
+   operation produces a zero result, and is set to 0 if the result is
+   non-zero. */
+#define FLAG_Z (0x2)
+
+   /*	Bit 2 - I: this is an interrupt enable/disable flag. If it is set,
+		interrupts are disabled. If it is cleared, interrupts are enabled. */
+#define FLAG_I (0x4)
+
+   /*  Bit 3 - D: this is the decimal mode status flag. When set, and an Add with 
+	   Carry or Subtract with Carry instruction is executed, the source values are
+	   treated as valid BCD (Binary Coded Decimal, eg. 0x00-0x99 = 0-99) numbers.
+	   The result generated is also a BCD number. */
+#define FLAG_D (0x8)
+
+   /*	Bit 4 - B: this is set when a software interrupt (BRK instruction) is
+		executed. */
+#define FLAG_B (0x10)
+
+   /*   Bit 6 - V - Overflow flag: when an arithmetic operation produces a result
+		too large to be represented in a byte, V is set */
+#define FLAG_V (0x40)
+
+   /*   Bit 7 - S - Sign flag: this is set if the result of an operation is
+		negative, cleared if positive. */
+#define FLAG_N (0x80)
 
 class Emulator;
+class Profiler;
+
+// The programmer visible registers, for tools that inspect or set up the CPU
+struct CPURegisters {
+	WORD	P;
+	BYTE	A;
+	BYTE	X;
+	BYTE	Y;
+	BYTE	F;
+	BYTE	S;
+};
 
 class CPU {
 public:
@@ -13,11 +59,44 @@ public:
 	void	reset	( void );
 	void	run		( void );	
 
+	// Same as run but executes common instruction pairs as one, see CPU.cpp
+	void	runFused	( void );
+
 	void	nmi		( void );
+
+	// Save states, saveState writes getStateSize bytes
+	UINT	getStateSize	( void );
+	void	saveState	( BYTE*& p );
+	void	loadState	( const BYTE*& p );
+
+	// Register access, used to start nestest in automation mode and to trace
+	void	getRegisters	( CPURegisters& r );
+	void	setRegisters	( const CPURegisters& r );
+
+	// Whether run knows the opcode, the others stop the process
+	static bool	isImplemented	( BYTE opCode );
+
+	// Guest profiler fed from run(), NULL turns it off
+	void	setProfiler		( Profiler* p )	{ pProfiler = p; }
+
+	// Per-opcode counters, NULL unless built with NESSIE_OPCODE_STATS
+	OpcodeStats*	getOpcodeStats	( void )	{ return pOpcodeStats; }
 	
 
+	// Advances the scanline timing by the cycles an instruction took
+	inline void	tick	( int cycles )	{ totalCycles += cycles; cyclesLeftOnScanline -= cycles; while (cyclesLeftOnScanline < 0) { endScanline(); } }
+
+	// Counters since the last reset, for benchmarking
+	unsigned long long	getInstructionCount	( void )	{ return instructionCount; }
+	unsigned long long	getTotalCycles		( void )	{ return totalCycles; }
+
 private:	
+	friend class WideCPU;
+
 	void	doVblankInterrupt	();
+	void	doIrq				();
+	void	endScanline			();
+	void	tickDma				();
 
 	WORD	getAddressZeroPage();
 	WORD	getAddressZeroPageOffset(BYTE offset);
@@ -37,9 +116,15 @@ private:
 	int		branchIfNotFlag				(BYTE flag);
 	int		branchIfFlag				(BYTE flag);
 	void	incMem						(WORD m);
+	void	decMem						(WORD m);
+	void	compare						(BYTE reg, BYTE m);
+	void	bitTest						(BYTE m);
+	void	leftShift					(WORD m);
 	void	rightShift					(WORD m);
 	void	rol							(BYTE& b);
 	void	rolMem						(WORD m);
+	void	ror							(BYTE& b);
+	void	rorMem						(WORD m);
 	BYTE	addWithCarry				(BYTE a, BYTE b);
 
 	void	push						(BYTE b);
@@ -47,12 +132,28 @@ private:
 
 	// Pointer to the memory class which also handles the system bus
 	CPUMem*		pMemory;
+	BYTE*		pRam;
 	Emulator*	pEmulator;
+	Profiler*	pProfiler;
+
+	OpcodeStats*	pOpcodeStats;
+	BYTE			lastOpcode;
+	bool			pageCrossed;	// Set by the indexed addressing modes when counting
+	bool			branchTaken;	// Set by the branches when counting
+
+	// The cycle an indexed read pays for crossing a page, run resets it
+	int			pageCrossCycles;
+
+	// Host time the NMI handler was entered, for the trace, 0 when not tracing
+	LONGLONG	nmiTraceStart;
 
 	// Convencience
 	inline void	store		(WORD address, BYTE value)	{ return pMemory->write(address, value); }
 	inline BYTE	readMem		(WORD address)				{ return pMemory->read(address); }
 
+	// Zero page and stack are always internal RAM, so they skip the bus
+	inline void	storeZeroPage	(WORD address, BYTE value)	{ pRam[address] = value; }
+
 	// Registers!
 	WORD	P;	// Program counter
 	BYTE	A;	// Accumulator
@@ -63,4 +164,7 @@ private:
 
 	int cyclesLeftOnScanline;
 	int scanline;
+
+	unsigned long long	instructionCount;
+	unsigned long long	totalCycles;
 };
\ No newline at end of file
@@ -2,9 +2,20 @@
 #include "NES.h"
 #include <memory.h>
 #include "PPU.h"
+#include "APU.h"
+#include "Controller.h"
+#include "State.h"
+#include "Tracer.h"
 
 CPUMem::CPUMem() {
-	
+	pStats = NULL;
+	traceTrack = 0;
+	prgBankNumber[0] = prgBankNumber[1] = 0;
+	dmaPending = false;
+	pApu = NULL;
+	pPrgRam = NULL;
+	prgRamMask = 0;
+	prgRamWritten = false;
 }
 
 CPUMem::~CPUMem() {
@@ -51,21 +62,29 @@ BYTE CPUMem::read(WORD wAddress)
 		return pPrgRomBank1[wAddress-0x8000];
 	} else if (wAddress >= 0xC000 && wAddress <= 0xFFFF) {
 		return pPrgRomBank2[wAddress-0xC000];
+	} else if (wAddress >= 0x6000 && pPrgRam) {
+		return pPrgRam[wAddress & prgRamMask];
+	} else if (wAddress == APU_STATUS) {
+		// Timed by the APU itself
+		STATS_COUNT(pStats->ioReads[STATS_IO_INDEX(wAddress)]);
+		return pApu->readStatus();
 	} else {
+		STATS_SCOPE(pStats->ioCycles);
+		STATS_COUNT(pStats->ioReads[STATS_IO_INDEX(wAddress)]);
+
 		if (wAddress >= 0x2000 && wAddress <= 0x3FFF) {
 			// Remove the mirroring and use the base addresses
 			return ppuRegRead(0x2000 | (wAddress&7));
 		} else if (wAddress == SPRDMA) {
 			// TODO: Unknown results reading from SPRDMA..
 			return openBus();
-		} else if (wAddress == 0x4015)
+		} else if (wAddress == JOYPAD1)
 		{
-			NOT_IMPLEMENTED;
-			return 0;
+			return pController1->read();
 		}
-		else if (wAddress == 0x4016)
+		else if (wAddress == JOYPAD2)
 		{
-			return 0;
+			return pController2->read();
 		}
 	}
 
@@ -74,6 +93,21 @@ BYTE CPUMem::read(WORD wAddress)
 	return 0;
 } 
 
+BYTE CPUMem::peek(WORD wAddress) {
+	if (wAddress < 0x2000) {
+		return memory[wAddress];
+	} else if (wAddress >= 0xC000) {
+		return pPrgRomBank2[wAddress-0xC000];
+	} else if (wAddress >= 0x8000) {
+		return pPrgRomBank1[wAddress-0x8000];
+	} else if (wAddress >= 0x6000 && pPrgRam) {
+		return pPrgRam[wAddress & prgRamMask];
+	}
+
+	// Registers are not touched
+	return 0;
+}
+
 void CPUMem::ppuRegWrite(WORD address, BYTE value) {
 	switch (address) {
 	case PPUCTRL:
@@ -107,47 +141,115 @@ void CPUMem::write(WORD address, BYTE value) {
 	if (address < 0x2000) {
 		// Normal RAM write
 		memory[address] = value;
+	} else if (address >= 0x6000) {
+		// Writes to ROM do nothing without a mapper
+		if (address < 0x8000 && pPrgRam) {
+			pPrgRam[address & prgRamMask] = value;
+			prgRamWritten = true;
+		}
 	} else if (address >= 0x2000 && address <= 0x3FFF) {
+		STATS_SCOPE(pStats->ioCycles);
+		STATS_COUNT(pStats->ioWrites[STATS_IO_INDEX(address)]);
+
 		// Remove the mirroring and use the base addresses
 		ppuRegWrite(0x2000 | (address&7), value);
 	}
-	// All the APU registers.
-	else if (address == 0x4003 || address == 0x4015)
+	// All the APU registers, $4014 and $4016 in between belong to DMA
+	// and the controllers
+	else if (address <= APU_DMC + 3 || address == APU_STATUS || address == APU_FRAME)
 	{
-		// Do nothing
-		//NOT_IMPLEMENTED;
-		//memory[address] = value;
-//			APU_Write(wAddress, byData);
+		STATS_COUNT(pStats->ioWrites[STATS_IO_INDEX(address)]);
+		pApu->writeReg(address, value);
 	}
 	else if (address == 0x4014)
 	{
-		WORD dmaStart = value;
-		dmaStart <<= 8;
+		STATS_SCOPE(pStats->dmaCycles);
+		TRACE_SCOPE("OAM DMA", traceTrack);
+		STATS_COUNT(pStats->dmas);
+		STATS_COUNT(pStats->ioWrites[STATS_IO_INDEX(address)]);
+
+		oamDma(value);
+	}
+	else if (address == JOYPAD1)
+	{
+		STATS_SCOPE(pStats->ioCycles);
+		STATS_COUNT(pStats->ioWrites[STATS_IO_INDEX(address)]);
 
-		WORD oamAddr = pPpu->readOAMAddr();
+		// The strobe goes to both controllers
+		pController1->write(value);
+		pController2->write(value);
+	}	
+}
+
+// Copies page $XX00-$XXFF into OAM. RAM and ROM pages are copied in
+// one go, anything else goes through read() a byte at a time since
+// the reads can have side effects.
+void CPUMem::oamDma(BYTE page) {
+	WORD dmaStart = ((WORD)page) << 8;
+
+	const BYTE* pSource = NULL;
+	if (dmaStart < 0x2000) {
+		pSource = memory + dmaStart;
+	} else if (dmaStart >= 0xC000) {
+		pSource = pPrgRomBank2 + (dmaStart - 0xC000);
+	} else if (dmaStart >= 0x8000) {
+		pSource = pPrgRomBank1 + (dmaStart - 0x8000);
+	} else if (dmaStart >= 0x6000 && pPrgRam && prgRamMask >= 0xFF) {
+		pSource = pPrgRam + (dmaStart & prgRamMask);
+	}
+
+	if (pSource) {
+		pPpu->writeOAMBlock(pSource);
+	} else {
+		BYTE buffer[256];
 		for (WORD i = 0; i != 256; ++i) {
-			BYTE data = read(dmaStart | i);	
-			pPpu->writeOAMMem((BYTE)(oamAddr + i & 0xFF), data);	// This takes a cycle
+			buffer[i] = read(dmaStart | i);
 		}
-	
-		// Here something takes an extra cycle
-		read(0);
+		pPpu->writeOAMBlock(buffer);
 	}
-	else if (address == 0x4016)
-	{			
-		//write to joystick here
-	//	memory[0x4016] = value;
-	}	
+
+	// The 513 or 514 cycles the CPU is halted for are charged by the CPU
+	dmaPending = true;
 }
 
-void CPUMem::setPrgRomBank1(BYTE* p) {
+void CPUMem::setPrgRomBank1(const BYTE* p, BYTE bankNumber) {
 	pPrgRomBank1 = p;
+	prgBankNumber[0] = bankNumber;
 }
 
-void CPUMem::setPrgRomBank2(BYTE* p) {
+void CPUMem::setPrgRomBank2(const BYTE* p, BYTE bankNumber) {
 	pPrgRomBank2 = p;
+	prgBankNumber[1] = bankNumber;
+}
+
+void CPUMem::setPrgRam(BYTE* p, UINT size) {
+	pPrgRam = p;
+	prgRamMask = p ? size - 1 : 0;
+	prgRamWritten = false;
+}
+
+UINT CPUMem::getStateSize() {
+	return sizeof(memory) + (pPrgRam ? prgRamMask + 1 : 0);
+}
+
+void CPUMem::saveState(BYTE*& p) {
+	STATE_WRITE(p, memory);
+	if (pPrgRam) {
+		memcpy(p, pPrgRam, prgRamMask + 1);
+		p += prgRamMask + 1;
+	}
 }
 
+void CPUMem::loadState(const BYTE*& p) {
+	STATE_READ(p, memory);
+	// With a battery save open this writes the .sav, see
+	// Emulator::openBatterySave
+	if (pPrgRam) {
+		memcpy(pPrgRam, p, prgRamMask + 1);
+		p += prgRamMask + 1;
+		prgRamWritten = true;
+	}
+}
 
 WORD CPUMem::getInitialProgramCounter( void ) {
 	// This wont work in the long run with mappers and shit
@@ -1,7 +1,19 @@
 #pragma once
 #include "Types.h"
+#include "Stats.h"
+
+// $0000-$1FFF, the mirrors of the 2 KB of RAM are stored separately
+#define CPU_RAM_SIZE	0x2000
+
+// $0000-$07FF, the RAM the console has
+#define CPU_RAM_BASE_SIZE	0x800
+
+// $6000-$7FFF, cartridge RAM smaller than this is mirrored across it
+#define PRG_RAM_SIZE	0x2000
 
 class PPU;
+class APU;
+class Controller;
 
 class CPUMem {
 public:
@@ -11,27 +23,72 @@ public:
 	void	reset	( void );
 
 	BYTE	read	( WORD wAddress );
+	BYTE	peek	( WORD wAddress );	// Read RAM or ROM without any side effects
 	void	write	( WORD wAddress, BYTE value );
 
-	void	setPrgRomBank1	( BYTE* p );
-	void	setPrgRomBank2	( BYTE* p );
+	void	setPrgRomBank1	( const BYTE* p, BYTE bankNumber = 0 );
+	void	setPrgRomBank2	( const BYTE* p, BYTE bankNumber = 0 );
+
+	// Cartridge RAM, a power of two up to PRG_RAM_SIZE bytes owned by the
+	// caller, or NULL for a cartridge without any
+	void	setPrgRam		( BYTE* p, UINT size );
+
+	// Whether the PRG RAM was written since the last call, for battery
+	// saves to flush only after frames that changed them
+	bool	takePrgRamWritten	( void )	{ bool written = prgRamWritten; prgRamWritten = false; return written; }
 	void	setPPU			( PPU* p )	{ pPpu = p; }
+	void	setAPU			( APU* p )	{ pApu = p; }
+	void	setControllers	( Controller* p1, Controller* p2 )	{ pController1 = p1; pController2 = p2; }
+	void	setStats		( EmulatorStats* p )	{ pStats = p; }
+	void	setTraceTrack	( UINT track )			{ traceTrack = track; }
 
 	WORD	getInitialProgramCounter	( void );
 
+	// Which 16 KB PRG ROM bank is mapped at an address, for symbolizing
+	BYTE	getPrgBank	( WORD wAddress )	{ return wAddress >= 0xC000 ? prgBankNumber[1] : prgBankNumber[0]; }
+
+	// The whole RAM area, CPU_RAM_SIZE bytes. The CPU accesses the zero
+	// page and the stack straight through this.
+	BYTE*	getRam	( void )	{ return memory; }
+
+	// Set by an OAM DMA write, the CPU charges the stall once the
+	// instruction that started the DMA has finished
+	bool	isDmaPending	( void )	{ return dmaPending; }
+	void	clearDmaPending	( void )	{ dmaPending = false; }
+
+	// Save states, saveState writes getStateSize bytes
+	UINT	getStateSize	( void );
+	void	saveState	( BYTE*& p );
+	void	loadState	( const BYTE*& p );
+
 private:
 	BYTE	ppuRegRead	( WORD wAddress );
 	void	ppuRegWrite	( WORD address, BYTE value );
 	BYTE	openBus		( void );
+	void	oamDma		( BYTE page );
 
 	
 	
 	// Main RAM of the NES
-	BYTE	memory			[ 0x2000 ];	
+	BYTE	memory			[ CPU_RAM_SIZE ];	
 	
 	// Two ROM banks for program memory.
-	BYTE*	pPrgRomBank1;	
-	BYTE*	pPrgRomBank2;	
+	const BYTE*	pPrgRomBank1;
+	const BYTE*	pPrgRomBank2;
+	BYTE	prgBankNumber	[ 2 ];
+
+	BYTE*	pPrgRam;
+	UINT	prgRamMask;
+	bool	prgRamWritten;
 
 	PPU*	pPpu;
+	APU*	pApu;
+	bool	dmaPending;
+
+	Controller*	pController1;
+	Controller*	pController2;
+
+	// Frame statistics, only touched when built with NESSIE_INSTRUMENT
+	EmulatorStats*	pStats;
+	UINT			traceTrack;
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "CartridgeImage.h"
+#include "Hash.h"
+#include "ZipArchive.h"
+#include <string.h>
+#include <memory.h>
+
+// Anything bigger in an archive is no ROM, and its size is not worth
+// trying to allocate
+#define MAX_ZIPPED_ROM_SIZE	(64 << 20)
+
+const RomIndex* CartridgeImage::pRomIndex = NULL;
+
+CartridgeImage::CartridgeImage() {
+	refCount = 1;
+	pInflated = NULL;
+	pData = NULL;
+	size = 0;
+	crc = 0;
+	indexed = false;
+	badSizes = false;
+}
+
+CartridgeImage::~CartridgeImage() {
+	delete[] pInflated;
+}
+
+// Where the archive part of a path through a zip file ends, just past
+// its ".zip", or NULL for any other path
+static const char* findZipEnd(const char* pFileName) {
+	for (const char* p = pFileName; *p; ++p) {
+		if (_strnicmp(p, ".zip", 4) == 0 && (p[4] == 0 || p[4] == '\\' || p[4] == '/')) {
+			return p + 4;
+		}
+	}
+	return NULL;
+}
+
+CartridgeImage* CartridgeImage::load(const char* pFileName, const char*& pError, bool allowBadSizes) {
+	CartridgeImage* pImage = new CartridgeImage();
+
+	const char* pZipEnd = findZipEnd(pFileName);
+	if (pZipEnd) {
+		char archive[MAX_PATH];
+		size_t length = pZipEnd - pFileName;
+		if (length >= sizeof(archive)) {
+			pError = "the path is too long";
+			delete pImage;
+			return NULL;
+		}
+		memcpy(archive, pFileName, length);
+		archive[length] = 0;
+		pError = pImage->openZip(archive, *pZipEnd ? pZipEnd + 1 : NULL);
+	} else {
+		pError = pImage->openFile(pFileName);
+	}
+	if (pError) {
+		delete pImage;
+		return NULL;
+	}
+
+	// The index is looked up before a header with the wrong ROM sizes is
+	// turned down, fixing those is part of what it is for. apply checks
+	// the sizes from the entry against the file instead.
+	RomInfo& info = pImage->info;
+	bool parsed = parseRomHeader(pImage->pData, pImage->size, info);
+	if (pRomIndex && info.prgRomOffset) {
+		const RomIndexEntry* pEntry = pRomIndex->find(pImage->crc);
+		if (pEntry) {
+			pImage->indexed = RomIndex::apply(*pEntry, pImage->size, info);
+		}
+	}
+
+	if (!parsed && !pImage->indexed) {
+		if (!allowBadSizes || !info.prgRomOffset || info.prgRomOffset >= pImage->size) {
+			pError = info.pError;
+			delete pImage;
+			return NULL;
+		}
+		info.prgRomSize = pImage->size - info.prgRomOffset;
+		info.chrRomSize = 0;
+		info.chrRomOffset = pImage->size;
+		pImage->badSizes = true;
+	}
+
+	pError = NULL;
+	return pImage;
+}
+
+const char* CartridgeImage::openFile(const char* pFileName) {
+	if (!file.open(pFileName)) {
+		return "could not open the file";
+	}
+	pData = file.getData();
+	size = file.getSize();
+
+	// Movies use this to make sure they are played back on the same ROM
+	crc = crc32(pData, size);
+	return NULL;
+}
+
+const char* CartridgeImage::openZip(const char* pArchive, const char* pEntry) {
+	ZipArchive zip;
+	if (!zip.open(pArchive)) {
+		return "could not open the zip archive";
+	}
+	ZipEntry entry;
+	if (pEntry ? !zip.findEntry(pEntry, entry) : !zip.findFirst(".nes", entry)) {
+		return pEntry ? "the zip archive has no such file" : "the zip archive has no .nes file";
+	}
+	if (entry.size > MAX_ZIPPED_ROM_SIZE) {
+		return "the file in the zip archive is too big";
+	}
+
+	pInflated = new BYTE[entry.size ? entry.size : 1];
+	if (!zip.extract(entry, pInflated)) {
+		return "could not unzip the file";
+	}
+	pData = pInflated;
+	size = entry.size;
+
+	// extract checked the unzipped file against it, the same CRC as the
+	// file on its own has
+	crc = entry.crc;
+	return NULL;
+}
+
+void CartridgeImage::addRef() {
+	InterlockedIncrement(&refCount);
+}
+
+void CartridgeImage::release() {
+	if (InterlockedDecrement(&refCount) == 0) {
+		delete this;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Types.h"
+#include "MappedFile.h"
+#include "RomInfo.h"
+#include "RomIndex.h"
+
+/*	A ROM file as loaded, shared by every emulator that runs it. The
+	image never changes after the load: PRG and CHR ROM are read
+	straight out of the read only file mapping, and whatever a
+	cartridge can write (CHR RAM, PRG RAM, mapper registers) lives in
+	each emulator. Emulators running the same image fetch from the same
+	cache lines.
+
+	A path through a zip archive, "games.zip\Game.nes", loads that
+	entry, and a path ending in the archive loads its first .nes file.
+	The entry is inflated straight into memory the image owns, and its
+	CRC is taken from the archive's directory instead of hashing it.
+
+	Every user holds a reference and the last release deletes the
+	image, from whichever thread that happens on. */
+class CartridgeImage {
+public:
+	// Returns the image holding one reference, or NULL and why not.
+	// allowBadSizes keeps an iNES file whose header says more ROM than
+	// it has and that is not in the index, with everything after the
+	// header as PRG ROM. That is for the indexer to hash, not to run.
+	static CartridgeImage*	load	( const char* pFileName, const char*& pError, bool allowBadSizes = false );
+
+	// Files in the index get what the index says instead of what their
+	// header says. Set once before loading anything, the index has to
+	// stay open for as long as it is set.
+	static void		setIndex	( const RomIndex* pIndex )	{ pRomIndex = pIndex; }
+
+	void	addRef		( void );
+	void	release		( void );
+
+	const RomInfo&	getInfo		( void )	{ return info; }
+	const BYTE*		getPrgRom	( void )	{ return pData + info.prgRomOffset; }
+	const BYTE*		getChrRom	( void )	{ return info.chrRomSize ? pData + info.chrRomOffset : NULL; }
+
+	// CRC32 and size of the whole file, after unzipping
+	UINT			getCrc		( void )	{ return crc; }
+	UINT			getSize		( void )	{ return size; }
+
+	// Whether the info came from the index rather than the header
+	bool			isIndexed	( void )	{ return indexed; }
+
+	// Whether allowBadSizes kept it
+	bool			hasBadSizes	( void )	{ return badSizes; }
+
+private:
+			CartridgeImage	( void );
+			~CartridgeImage	( void );
+
+	// Both return why the file could not be read, NULL if it was
+	const char*	openFile	( const char* pFileName );
+	const char*	openZip		( const char* pArchive, const char* pEntry );
+
+	volatile LONG	refCount;
+	MappedFile		file;		// Plain ROM files
+	BYTE*			pInflated;	// ROMs from zip archives
+	const BYTE*		pData;
+	UINT			size;
+	RomInfo			info;
+	UINT			crc;
+	bool			indexed;
+	bool			badSizes;
+
+	static const RomIndex*	pRomIndex;
+};
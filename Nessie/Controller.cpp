@@ -0,0 +1,55 @@
+#include "Controller.h"
+#include "State.h"
+
+Controller::Controller() {
+	pState = NULL;
+	reset();
+}
+
+Controller::~Controller() {
+}
+
+void Controller::reset() {
+	strobe = 0;
+	shiftReg = 0;
+}
+
+BYTE Controller::read() {
+	// While strobe is high the shift register is reloaded constantly,
+	// so every read returns the A button.
+	if (strobe) {
+		shiftReg = pState ? *pState : 0;
+	}
+
+	BYTE bit = shiftReg & 1;
+
+	// Ones are shifted in so reads past the eighth button return 1
+	shiftReg = (shiftReg >> 1) | 0x80;
+
+	// The upper bits are open bus, which is the high byte of the
+	// address on most games since they read with LDA $4016.
+	return 0x40 | bit;
+}
+
+void Controller::write(BYTE value) {
+	BYTE newStrobe = value & 1;
+	if (strobe || newStrobe) {
+		// Latch the buttons just in time
+		shiftReg = pState ? *pState : 0;
+	}
+	strobe = newStrobe;
+}
+
+UINT Controller::getStateSize() {
+	return sizeof(strobe) + sizeof(shiftReg);
+}
+
+void Controller::saveState(BYTE*& p) {
+	STATE_WRITE(p, strobe);
+	STATE_WRITE(p, shiftReg);
+}
+
+void Controller::loadState(const BYTE*& p) {
+	STATE_READ(p, strobe);
+	STATE_READ(p, shiftReg);
+}
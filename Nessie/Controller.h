@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Types.h"
+
+/*	A standard NES controller. The button state is not copied into the
+	controller by the host, instead the controller keeps a pointer to
+	the host state and reads it the moment the game strobes. That way
+	the game always latches the most recent input. */
+class Controller {
+public:
+			Controller	( void );
+			~Controller	( void );
+
+	void	reset		( void );
+
+	BYTE	read		( void );
+	void	write		( BYTE value );
+
+	void	setState	( const BYTE* p )	{ pState = p; }
+
+	// Save states, saveState writes getStateSize bytes
+	UINT	getStateSize	( void );
+	void	saveState	( BYTE*& p );
+	void	loadState	( const BYTE*& p );
+
+private:
+	const BYTE*	pState;
+
+	BYTE	strobe;
+	BYTE	shiftReg;
+};
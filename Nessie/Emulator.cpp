@@ -4,20 +4,69 @@
 #include <windows.h>
 #include "CPU.h"
 #include "PPU.h"
-#include "SDL.h"
-#include "Emulator.h"
-
-#define PRGROM_BANKSIZE = (1024 * 16)
+#include "APU.h"
+#include "Controller.h"
+#include "Movie.h"
+#include "FrameHashLog.h"
+#include "AVRecorder.h"
+#include "BatterySave.h"
+#include "Hash.h"
+#include "State.h"
+#include "Palette.h"
+#include "Timer.h"
+#include "Tracer.h"
 
 Emulator::Emulator( void ) {
 	pCpuMem = new CPUMem();
 	pCartridge = NULL;
+	pLoadError = NULL;
+	pPrgRam = NULL;
+	prgRamSize = 0;
+	pBatterySave = NULL;
+	controllerState[0] = controllerState[1] = 0;
+	pRecording = NULL;
+	pPlayback = NULL;
+	pFrameHashLog = NULL;
+	pAVRecorder = NULL;
+	frameCount = 0;
+	traceTrack = 0;
+	frameComplete = false;
+	renderEnabled = true;
+	fusionEnabled = true;
+	memset(frameBuffer, 0, sizeof(frameBuffer));
+	memset(&stepConfig, 0, sizeof(stepConfig));
+	stepConfig.numPorts = 1;
+	pRamAddresses = NULL;
+	clearStats(currentStats);
+	clearStats(lastStats);
+	clearStats(averageStats);
+	clearStats(statsSum);
+	pStatsHistory = NULL;
+	numStatsFrames = 0;
+	statsFrameStarted = false;
+#ifdef NESSIE_INSTRUMENT
+	pStatsHistory = new EmulatorStats[STATS_WINDOW];
+#endif
 	pCpu = new CPU(pCpuMem, this);
 	pPpu = new PPU(pCpu, this);
+	pApu = new APU(pCpu, pCpuMem);
+	pApu->setStats(&currentStats);
 	pCpuMem->setPPU(pPpu);
+	pCpuMem->setAPU(pApu);
+	pCpuMem->setStats(&currentStats);
+
+	// The controllers read the host state straight out of controllerState
+	apController[0] = new Controller();
+	apController[1] = new Controller();
+	apController[0]->setState(&controllerState[0]);
+	apController[1]->setState(&controllerState[1]);
+	pCpuMem->setControllers(apController[0], apController[1]);
 }
 
 Emulator::~Emulator( void ) {
+	// Flushes the save while the CPU memory still points at it
+	closeBatterySave();
+
 	if (pCpu) {
 		delete pCpu;
 		pCpu = NULL;
@@ -25,82 +74,418 @@ Emulator::~Emulator( void ) {
 
 	delete pCpuMem;
 	delete pPpu;	
+	delete pApu;
+	delete apController[0];
+	delete apController[1];
+	delete[] pRamAddresses;
+	delete[] pStatsHistory;
+	delete[] pPrgRam;
+	if (pCartridge) {
+		pCartridge->release();
+	}
 }
 
 void Emulator::run(void) {
 	pCpu->run();	
 }
 
-// Fix later
-extern SDL_Surface* screen;
+void Emulator::runFrame(void) {
+	beginFrame();
+	STATS_SCOPE(currentStats.frameCycles);
+	TRACE_SCOPE("frame", traceTrack);
+
+	// The CPU ends the frame when it reaches vblank
+	if (fusionEnabled) {
+		while (!frameComplete) {
+			pCpu->runFused();
+		}
+	} else {
+		while (!frameComplete) {
+			pCpu->run();
+		}
+	}
+}
+
+void Emulator::beginFrame(void) {
+#ifdef NESSIE_INSTRUMENT
+	if (statsFrameStarted) {
+		commitStats();
+	}
+	statsFrameStarted = true;
+#endif
+
+	// Playback stops with the input of the last frame, so the frame
+	// after it never runs on stale input
+	if (pPlayback) {
+		pPlayback->nextFrame(controllerState[0], controllerState[1]);
+		if (pPlayback->isFinished()) {
+			stopPlayback();
+		}
+	}
+	if (pRecording) {
+		pRecording->addFrame(controllerState[0], controllerState[1]);
+	}
+
+	frameComplete = false;
+}
+
+void Emulator::commitStats(void) {
+	// The CPU gets what the other parts did not use
+	EmulatorStats& s = currentStats;
+	unsigned long long others = s.ioCycles + s.renderCycles + s.dmaCycles + s.apuCycles + s.resampleCycles + s.mapperCycles;
+	s.cpuCycles = s.frameCycles > others ? s.frameCycles - others : 0;
+	lastStats = s;
+
+	EmulatorStats& oldest = pStatsHistory[numStatsFrames % STATS_WINDOW];
+	if (numStatsFrames >= STATS_WINDOW) {
+		subtractStats(statsSum, oldest);
+	}
+	oldest = s;
+	addStats(statsSum, s);
+	++numStatsFrames;
+	divideStats(averageStats, statsSum, numStatsFrames < STATS_WINDOW ? numStatsFrames : STATS_WINDOW);
+
+	clearStats(currentStats);
+}
+
+void Emulator::setTraceTrack(UINT track) {
+	traceTrack = track;
+	pCpuMem->setTraceTrack(track);
+}
+
+void Emulator::setAudioRing(AudioRing* pRing, int sampleRate) {
+	pApu->setAudioRing(pRing, sampleRate);
+}
+
+void Emulator::setAudioEnabled(bool enabled) {
+	pApu->setSynthesisEnabled(enabled);
+}
 
-unsigned int* Emulator::getScreenPixelBuffer() {
-	return (unsigned int*)screen->pixels;
+bool Emulator::isAudioEnabled(void) {
+	return pApu->isSynthesisEnabled();
 }
 
-void Emulator::flipScreen() {
-	SDL_Flip(screen);
+void Emulator::setControllerState(int port, BYTE buttons) {
+	controllerState[port & 1] = buttons;
 }
 
+void Emulator::endFrame(void) {
+	pApu->endFrame();
+	frameComplete = true;
+	if (pBatterySave && pCpuMem->takePrgRamWritten()) {
+		pBatterySave->requestFlush();
+	}
+	if (pFrameHashLog) {
+		pFrameHashLog->addFrame(frameCount, frameBuffer, pCpuMem->getRam());
+	}
+	if (pAVRecorder) {
+		pAVRecorder->addFrame(frameCount, frameBuffer, pApu->getFrameSamples(), pApu->getNumFrameSamples());
+	}
+	++frameCount;
+}
 
-void Emulator::loadFromFile(const char* pFileName) {
-	// Screw the filename
-	FILE* pFile;
-	fopen_s(&pFile, "nestest.nes", "r");
-	if (pFile) {
-		fseek(pFile, 0, SEEK_END);
-		long lFileSize = ftell(pFile);
-		fseek(pFile, 0, SEEK_SET);
-		pCartridge = new unsigned char[lFileSize];
-		fread(pCartridge, 1, lFileSize, pFile);
-		fclose(pFile);
+void Emulator::runFrames(const BYTE* pInput, UINT numFrames, int numPorts) {
+	for (UINT i = 0; i != numFrames; ++i) {
+		controllerState[0] = pInput[0];
+		if (numPorts > 1) {
+			controllerState[1] = pInput[1];
+		}
+		pInput += numPorts;
 
-		// File should be loaded. See what the fuck it contains;
-		struct NESHEADER {
-			char magic[4];
-			unsigned char num16kbROMbanks;
-			unsigned char num8kbVROMbanks;
-			
-			unsigned char mirroring : 1;
-			unsigned char batteryBacked : 1;
-			unsigned char trainer : 1;
-			unsigned char fourScreenVRAMlayout : 1;
-			unsigned char ROMMapperTypeLower : 4;
-			
-			unsigned char VS_system : 1;
-			unsigned char reserved_1 : 3;
-			unsigned char ROMMapperTypeHigher : 4;
+		runFrame();
+	}
+}
 
-			unsigned char num8kRAMbanks;
+bool Emulator::startRecording(Movie* pMovie, bool fromSaveState) {
+	if (!pCartridge || pBatterySave) {
+		return false;
+	}
+
+	if (fromSaveState) {
+		BYTE* pState = new BYTE[getStateSize()];
+		saveState(pState);
+		pMovie->begin(getRomCrc(), pState, getStateSize());
+		delete[] pState;
+	} else {
+		powerOn();
+		pMovie->begin(getRomCrc(), NULL, 0);
+	}
 
-			unsigned char PAL : 1;
-			unsigned char reserved_2 : 7;
-			
-			unsigned char reserved_3[6];
-		};
+	pRecording = pMovie;
+	return true;
+}
 
-		NESHEADER* pHeader = (NESHEADER*)pCartridge;
-		
-		// No mapper right now, I'll just put the program rom pointer to the first
-		// program bank
-		pCpuMem->setPrgRomBank1(pCartridge + sizeof(NESHEADER));
-		pCpuMem->setPrgRomBank2(pCartridge + sizeof(NESHEADER));
-		
-		// Initialize the pattern tables to point to the first and
-		// second banks of CHR-ROM.
-		pPpu->setPatternTable1(pCartridge + sizeof(NESHEADER) + 0x4000 * pHeader->num16kbROMbanks);
-		pPpu->setPatternTable2(pCartridge + sizeof(NESHEADER) + 0x4000 * pHeader->num16kbROMbanks + 0x1000);
+void Emulator::stopRecording(void) {
+	pRecording = NULL;
+}
 
-		pPpu->setupNameTables(pHeader->mirroring);
+bool Emulator::startPlayback(Movie* pMovie) {
+	if (!pCartridge || pBatterySave || pMovie->getRomCrc() != getRomCrc()) {
+		return false;
+	}
 
-		// Reset the NES
-		reset();
+	if (pMovie->hasSaveState()) {
+		if (pMovie->getSaveStateSize() != getStateSize()) {
+			return false;
+		}
+		loadState(pMovie->getSaveState());
+	} else {
+		powerOn();
 	}
+
+	pMovie->rewind();
+	pPlayback = pMovie->isFinished() ? NULL : pMovie;
+	return true;
+}
+
+void Emulator::stopPlayback(void) {
+	pPlayback = NULL;
+}
+
+// The state holds the CHR and PRG RAM only when the cartridge has some
+UINT Emulator::getStateSize(void) {
+	return pCpu->getStateSize() + pCpuMem->getStateSize() + pPpu->getStateSize() + pApu->getStateSize() +
+		apController[0]->getStateSize() + apController[1]->getStateSize() + sizeof(controllerState) + sizeof(frameCount);
+}
+
+void Emulator::saveState(BYTE* pState) {
+	BYTE* p = pState;
+	pCpu->saveState(p);
+	pCpuMem->saveState(p);
+	pPpu->saveState(p);
+	pApu->saveState(p);
+	apController[0]->saveState(p);
+	apController[1]->saveState(p);
+	STATE_WRITE(p, controllerState);
+	STATE_WRITE(p, frameCount);
+}
+
+void Emulator::loadState(const BYTE* pState) {
+	const BYTE* p = pState;
+	pCpu->loadState(p);
+	pCpuMem->loadState(p);
+	pPpu->loadState(p);
+	pApu->loadState(p);
+	apController[0]->loadState(p);
+	apController[1]->loadState(p);
+	STATE_READ(p, controllerState);
+	STATE_READ(p, frameCount);
+}
+
+void Emulator::configureStep(const StepConfig& config) {
+	stepConfig = config;
+
+	// Keep our own copy of the addresses
+	delete[] pRamAddresses;
+	pRamAddresses = NULL;
+	if (config.numRamAddresses) {
+		pRamAddresses = new WORD[config.numRamAddresses];
+		memcpy(pRamAddresses, config.pRamAddresses, config.numRamAddresses * sizeof(WORD));
+	}
+	stepConfig.pRamAddresses = pRamAddresses;
+}
+
+UINT Emulator::getObservationSize(ObservationFormat format) {
+	switch (format) {
+	case OBS_PALETTE_INDEX:
+	case OBS_GRAYSCALE:
+		return SCREEN_WIDTH * SCREEN_HEIGHT;
+	case OBS_GRAYSCALE_HALF:
+		return (SCREEN_WIDTH / 2) * (SCREEN_HEIGHT / 2);
+	case OBS_RGB32:
+		return SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(unsigned int);
+	default:
+		return 0;
+	}
+}
+
+void Emulator::step(const BYTE* pActions, int frameskip, void* pObservation, BYTE* pRam, StepTiming* pTiming) {
+	LONGLONG start = readTimer();
+
+	controllerState[0] = pActions[0];
+	if (stepConfig.numPorts > 1) {
+		controllerState[1] = pActions[1];
+	}
+
+	// Only the last frame is ever looked at
+	if (frameskip < 1) {
+		frameskip = 1;
+	}
+	bool wasRenderEnabled = renderEnabled;
+	for (int i = 0; i != frameskip; ++i) {
+		renderEnabled = wasRenderEnabled && (i == frameskip - 1) && stepConfig.format != OBS_NONE;
+		runFrame();
+	}
+	renderEnabled = wasRenderEnabled;
+
+	LONGLONG emulated = readTimer();
+
+	if (pObservation) {
+		writeObservation(stepConfig.format, pObservation);
+	}
+	if (pRam) {
+		for (UINT i = 0; i != stepConfig.numRamAddresses; ++i) {
+			pRam[i] = pCpuMem->peek(stepConfig.pRamAddresses[i]);
+		}
+	}
+
+	if (pTiming) {
+		LONGLONG end = readTimer();
+		pTiming->frames = frameskip;
+		pTiming->emulationNs = timerToNs(emulated - start);
+		pTiming->observationNs = timerToNs(end - emulated);
+	}
+}
+
+void Emulator::writeObservation(ObservationFormat format, void* pObservation) {
+	const BYTE* pIn = frameBuffer;
+
+	switch (format) {
+	case OBS_PALETTE_INDEX:
+		memcpy(pObservation, frameBuffer, sizeof(frameBuffer));
+		break;
+	case OBS_GRAYSCALE:
+		{
+			BYTE* pOut = (BYTE*)pObservation;
+			for (int i = 0; i != SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+				pOut[i] = NESPaletteLuma[pIn[i] & 0x3F];
+			}
+		}
+		break;
+	case OBS_GRAYSCALE_HALF:
+		{
+			BYTE* pOut = (BYTE*)pObservation;
+			for (int y = 0; y != SCREEN_HEIGHT; y += 2) {
+				const BYTE* pRow = pIn + y * SCREEN_WIDTH;
+				for (int x = 0; x != SCREEN_WIDTH; x += 2) {
+					*pOut++ = NESPaletteLuma[pRow[x] & 0x3F];
+				}
+			}
+		}
+		break;
+	case OBS_RGB32:
+		{
+			unsigned int* pOut = (unsigned int*)pObservation;
+			for (int i = 0; i != SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+				pOut[i] = NESPalette[pIn[i] & 0x3F];
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+
+bool Emulator::loadFromFile(const char* pFileName) {
+	CartridgeImage* pImage = CartridgeImage::load(pFileName, pLoadError);
+	if (!pImage) {
+		return false;
+	}
+	bool loaded = loadCartridge(pImage);
+	pImage->release();
+	return loaded;
+}
+
+// Only NROM for now: 16 or 32 KB of PRG ROM and 8 KB of CHR ROM or RAM.
+// The banks point straight into the shared image.
+bool Emulator::loadCartridge(CartridgeImage* pImage) {
+	const RomInfo& info = pImage->getInfo();
+	if (info.mapper != 0) {
+		pLoadError = "only mapper 0 (NROM) is supported";
+		return false;
+	}
+	if ((info.prgRomSize != 0x4000 && info.prgRomSize != 0x8000) ||
+		(info.chrRomSize != 0 && info.chrRomSize != 0x2000)) {
+		pLoadError = "PRG or CHR ROM size does not fit NROM";
+		return false;
+	}
+	pLoadError = NULL;
+
+	pImage->addRef();
+	if (pCartridge) {
+		pCartridge->release();
+	}
+	pCartridge = pImage;
+
+	// NROM-128 has one 16 KB bank, mirrored at $C000. NROM-256 has two.
+	const BYTE* pPrg = pImage->getPrgRom();
+	BYTE lastBank = (BYTE)(info.prgRomSize / 0x4000 - 1);
+	pCpuMem->setPrgRomBank1(pPrg, 0);
+	pCpuMem->setPrgRomBank2(pPrg + lastBank * 0x4000, lastBank);
+
+	if (info.chrRomSize) {
+		pPpu->setChrRom(pImage->getChrRom());
+	} else {
+		pPpu->setChrRam();
+	}
+	pPpu->setupNameTables(info.verticalMirroring);
+
+	// NROM boards can only decode 8 KB at $6000, anything smaller is
+	// mirrored. A new cartridge starts with cleared RAM, or with its
+	// battery save once that is opened.
+	closeBatterySave();
+	UINT ramSize = info.prgRamSize + info.prgNvramSize;
+	prgRamSize = ramSize ? 0x40 : 0;
+	while (prgRamSize && prgRamSize < ramSize && prgRamSize < PRG_RAM_SIZE) {
+		prgRamSize <<= 1;
+	}
+	delete[] pPrgRam;
+	pPrgRam = NULL;
+	if (prgRamSize) {
+		pPrgRam = new BYTE[prgRamSize];
+		memset(pPrgRam, 0, prgRamSize);
+	}
+	pCpuMem->setPrgRam(pPrgRam, prgRamSize);
+
+	// Reset the NES
+	reset();
+	return true;
+}
+
+bool Emulator::openBatterySave(const char* pFileName) {
+	closeBatterySave();
+	if (!pCartridge || !pCartridge->getInfo().battery || !prgRamSize || pRecording || pPlayback) {
+		return false;
+	}
+
+	pBatterySave = new BatterySave();
+	if (!pBatterySave->open(pFileName, prgRamSize)) {
+		delete pBatterySave;
+		pBatterySave = NULL;
+		return false;
+	}
+	pCpuMem->setPrgRam(pBatterySave->getData(), prgRamSize);
+	return true;
+}
+
+// The game carries on with what was last saved, in its own RAM
+void Emulator::closeBatterySave() {
+	if (!pBatterySave) {
+		return;
+	}
+	memcpy(pPrgRam, pBatterySave->getData(), prgRamSize);
+	pCpuMem->setPrgRam(pPrgRam, prgRamSize);
+	delete pBatterySave;
+	pBatterySave = NULL;
 }
 
 void Emulator::reset() {
 	pCpu->reset();	
 	pCpuMem->reset();
 	pPpu->reset();
+	pApu->reset();
+	apController[0]->reset();
+	apController[1]->reset();
+	frameCount = 0;
+}
+
+// A reset keeps the PRG RAM like the console does, a movie has to
+// start without what the last session left in it
+void Emulator::powerOn() {
+	if (pPrgRam) {
+		memset(pPrgRam, 0, prgRamSize);
+	}
+	reset();
 }
 
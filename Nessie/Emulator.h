@@ -1,28 +1,203 @@
 #pragma once
 
 #include "Types.h"
+#include "Stats.h"
+#include "CartridgeImage.h"
 
 class CPU;
 class PPU;
+class APU;
+class AudioRing;
 class CPUMem;
+class Movie;
+class Controller;
+class FrameHashLog;
+class AVRecorder;
+class BatterySave;
+
+#define SCREEN_WIDTH	256
+#define SCREEN_HEIGHT	240
+
+// Formats step() can write the observation in
+enum ObservationFormat {
+	OBS_NONE,				// No observation
+	OBS_PALETTE_INDEX,		// 256x240, one palette index byte per pixel
+	OBS_GRAYSCALE,			// 256x240, one luminance byte per pixel
+	OBS_GRAYSCALE_HALF,		// 128x120, top left pixel of each 2x2 block
+	OBS_RGB32				// 256x240, 0x00RRGGBB per pixel
+};
+
+// Set up once before stepping so step() itself never allocates
+struct StepConfig {
+	ObservationFormat	format;
+	int					numPorts;			// Actions per step, one per port
+	const WORD*			pRamAddresses;		// CPU RAM bytes copied out per step
+	UINT				numRamAddresses;
+};
+
+// Host time spent in a step
+struct StepTiming {
+	UINT		frames;
+	LONGLONG	emulationNs;	// Running the frames
+	LONGLONG	observationNs;	// Converting the observation and copying RAM
+};
 
 class Emulator {
 public:
 			Emulator		(void);
 			~Emulator		(void);
 	
-	void	loadFromFile	(const char* fileName);
+	// Maps an iNES or NES 2.0 file and resets. On failure the cartridge
+	// loaded before stays and getLoadError says why.
+	bool	loadFromFile	(const char* fileName);
+
+	// Runs an image that may be shared with other emulators, which
+	// keeps a reference to it
+	bool	loadCartridge	(CartridgeImage* pImage);
 	void	run				(void);
+	void	runFrame		(void);
 	void	reset			(void);
 	
 	PPU*			getPPU					(void) { return pPpu; }
-	unsigned int*	getScreenPixelBuffer	(void);
-	void			flipScreen				(void);
+	APU*			getAPU					(void) { return pApu; }
+
+	// Palette indices of the last rendered frame
+	BYTE*			getFrameBuffer			(void) { return frameBuffer; }
+	void			beginFrame				(void);
+	void			endFrame				(void);
+	bool			isFrameComplete			(void) { return frameComplete; }
+	CPU*			getCPU					(void) { return pCpu; }
+	CPUMem*			getCPUMem				(void) { return pCpuMem; }
+
+	// Runs common instruction pairs as one (CPU::runFused), on by default
+	void			setFusionEnabled		(bool enabled) { fusionEnabled = enabled; }
+	bool			isFusionEnabled			(void) { return fusionEnabled; }
+
+	// Frames can skip rendering when nobody is going to look at them
+	void			setRenderEnabled		(bool enabled) { renderEnabled = enabled; }
+	bool			isRenderEnabled			(void) { return renderEnabled; }
+
+	// Controller input used for the next frame, one bit per button
+	void			setControllerState		(int port, BYTE buttons);
+
+	// Runs a whole sequence of frames in one call. pInput holds one
+	// button mask per port for each frame, numPorts masks per frame.
+	void			runFrames				(const BYTE* pInput, UINT numFrames, int numPorts = 1);
+
+	// Gym style stepping. Applies the actions, runs frameskip frames and
+	// only renders the last one, then writes the observation and the
+	// configured RAM bytes to the caller's buffers.
+	void			configureStep			(const StepConfig& config);
+	UINT			getObservationSize		(ObservationFormat format);
+	void			step					(const BYTE* pActions, int frameskip, void* pObservation, BYTE* pRam, StepTiming* pTiming);
+	void			writeObservation		(ObservationFormat format, void* pObservation);
+
+	// Movie recording and playback. Playback replaces the controller
+	// state with the recorded input until the movie runs out. A movie
+	// that does not start from a save state starts from power on, with
+	// the PRG RAM cleared. Both fail while a battery save is open, a
+	// movie must neither depend on the file nor write to it.
+	bool			startRecording			(Movie* pMovie, bool fromSaveState);
+	void			stopRecording			(void);
+	bool			startPlayback			(Movie* pMovie);
+	void			stopPlayback			(void);
+	bool			isPlaying				(void) { return pPlayback != NULL; }
+
+	// Appends the frame buffer and RAM hashes of every finished frame
+	// to the log, NULL stops it. The log is owned by the caller.
+	void			setFrameHashLog			(FrameHashLog* pLog) { pFrameHashLog = pLog; }
+
+	// Hands every finished frame and its audio samples to the recorder,
+	// NULL stops it. The recorder is owned by the caller.
+	void			setAVRecorder			(AVRecorder* pRecorder) { pAVRecorder = pRecorder; }
+
+	// Every finished frame writes its audio samples to the ring at
+	// sampleRate, NULL drops them. The ring is owned by the caller.
+	void			setAudioRing			(AudioRing* pRing, int sampleRate);
+
+	// Without audio the APU only keeps what the game can observe, see
+	// APU::setSynthesisEnabled. On by default.
+	void			setAudioEnabled			(bool enabled);
+	bool			isAudioEnabled			(void);
+
+	// Keeps the PRG RAM of a battery backed cartridge in a file instead,
+	// see BatterySave. Open it right after loading, the game sees what
+	// the file holds from then on. Loading another cartridge closes it.
+	// Fails while a movie is recorded or played. A state load rewrites
+	// the save: the state's PRG RAM goes straight into the mapping and
+	// is flushed at the end of the next frame like any game write.
+	bool			openBatterySave			(const char* pFileName);
+	void			closeBatterySave		(void);
+	BatterySave*	getBatterySave			(void) { return pBatterySave; }
+
+	// Save states
+	UINT			getStateSize			(void);
+	void			saveState				(BYTE* p);
+	void			loadState				(const BYTE* p);
+
+	// Host time and event counts, all zero unless built with
+	// NESSIE_INSTRUMENT. getStats is the last finished frame and
+	// getAverageStats the mean of the last STATS_WINDOW frames. A frame
+	// is finished when the next one begins, so whatever the frontend does
+	// between frames (presentCycles) goes into getCurrentStats.
+	const EmulatorStats&	getStats			(void) { return lastStats; }
+	const EmulatorStats&	getAverageStats		(void) { return averageStats; }
+	EmulatorStats&			getCurrentStats		(void) { return currentStats; }
+
+	// Track the instance's events go to in a Chrome trace
+	void			setTraceTrack			(UINT track);
+	UINT			getTraceTrack			(void) { return traceTrack; }
+
+	// Only while a cartridge is loaded
+	CartridgeImage*	getCartridge			(void) { return pCartridge; }
+	UINT			getRomCrc				(void) { return pCartridge ? pCartridge->getCrc() : 0; }
+	const RomInfo&	getRomInfo				(void) { return pCartridge->getInfo(); }
+	const char*		getLoadError			(void) { return pLoadError; }
+	UINT			getFrameCount			(void) { return frameCount; }
 
 private:
 	CPU*	pCpu;
 	PPU*	pPpu;
+	APU*	pApu;
 	CPUMem*	pCpuMem;	
+	Controller*	apController[2];
+
+	CartridgeImage*	pCartridge;
+	const char*		pLoadError;
+
+	// PRG RAM that goes when the emulator does, the battery save's
+	// mapping takes its place while one is open
+	BYTE*			pPrgRam;
+	UINT			prgRamSize;
+	BatterySave*	pBatterySave;
+
+	BYTE	controllerState[2];
+
+	Movie*	pRecording;
+	Movie*	pPlayback;
+
+	FrameHashLog*	pFrameHashLog;
+	AVRecorder*		pAVRecorder;
+
+	UINT	frameCount;
+	UINT	traceTrack;
+	bool	frameComplete;
+	bool	renderEnabled;
+	bool	fusionEnabled;
+
+	void	powerOn			(void);
+	void	commitStats		(void);
+
+	EmulatorStats	currentStats;
+	EmulatorStats	lastStats;
+	EmulatorStats	averageStats;
+	EmulatorStats	statsSum;
+	EmulatorStats*	pStatsHistory;		// STATS_WINDOW frames, only when instrumented
+	UINT			numStatsFrames;
+	bool			statsFrameStarted;
+
+	StepConfig	stepConfig;
+	WORD*		pRamAddresses;
 
-	BYTE*	pCartridge;
-};
\ No newline at end of file
+	BYTE	frameBuffer[ SCREEN_WIDTH * SCREEN_HEIGHT ];
+};
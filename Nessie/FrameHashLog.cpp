@@ -0,0 +1,86 @@
+#include "FrameHashLog.h"
+#include <memory.h>
+#include "Emulator.h"
+#include "CPUMem.h"
+#include "Hash.h"
+
+#define FRAMEHASH_VERSION 2
+
+struct FrameHashHeader {
+	char	magic[4];		// "NFH\x1A"
+	WORD	version;
+	WORD	recordSize;
+	UINT	romCrc;
+};
+
+static const char frameHashMagic[4] = { 'N', 'F', 'H', 0x1A };
+
+FrameHashLog::FrameHashLog() {
+	pFile = NULL;
+	romCrc = 0;
+}
+
+FrameHashLog::~FrameHashLog() {
+	close();
+}
+
+bool FrameHashLog::create(const char* pFileName, UINT crc) {
+	close();
+	if (fopen_s(&pFile, pFileName, "wb") != 0 || !pFile) {
+		pFile = NULL;
+		return false;
+	}
+
+	FrameHashHeader header;
+	memcpy(header.magic, frameHashMagic, 4);
+	header.version = FRAMEHASH_VERSION;
+	header.recordSize = sizeof(FrameHashRecord);
+	header.romCrc = crc;
+	romCrc = crc;
+
+	if (fwrite(&header, sizeof(header), 1, pFile) != 1) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void FrameHashLog::addFrame(UINT frame, const BYTE* pFrameBuffer, const BYTE* pRam) {
+	FrameHashRecord record;
+	record.frame = frame;
+	record.reserved = 0;
+	record.frameHash = hash64(pFrameBuffer, SCREEN_WIDTH * SCREEN_HEIGHT);
+	record.ramHash = hash64(pRam, CPU_RAM_BASE_SIZE);
+	fwrite(&record, sizeof(record), 1, pFile);
+}
+
+bool FrameHashLog::open(const char* pFileName) {
+	close();
+	if (fopen_s(&pFile, pFileName, "rb") != 0 || !pFile) {
+		pFile = NULL;
+		return false;
+	}
+
+	FrameHashHeader header;
+	bool ok = fread(&header, sizeof(header), 1, pFile) == 1
+		&& memcmp(header.magic, frameHashMagic, 4) == 0
+		&& header.version == FRAMEHASH_VERSION
+		&& header.recordSize == sizeof(FrameHashRecord);
+	if (!ok) {
+		close();
+		return false;
+	}
+	romCrc = header.romCrc;
+	return true;
+}
+
+bool FrameHashLog::nextFrame(FrameHashRecord& record) {
+	return pFile && fread(&record, sizeof(record), 1, pFile) == 1;
+}
+
+void FrameHashLog::close() {
+	if (pFile) {
+		fclose(pFile);
+		pFile = NULL;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include "Types.h"
+
+// Hashes of one frame, as stored in the log
+struct FrameHashRecord {
+	UINT				frame;
+	UINT				reserved;
+	unsigned long long	frameHash;	// Palette index frame buffer
+	unsigned long long	ramHash;	// CPU RAM, $0000-$07FF without the mirrors
+};
+
+/*	Per-frame hash stream for regression checking. The file is a small
+	header followed by one fixed size record per frame, so two runs of
+	the same ROM or movie on different builds can be compared frame by
+	frame without keeping any of the frames around. */
+class FrameHashLog {
+public:
+			FrameHashLog	( void );
+			~FrameHashLog	( void );
+
+	// Writing
+	bool	create		( const char* pFileName, UINT romCrc );
+	void	addFrame	( UINT frame, const BYTE* pFrameBuffer, const BYTE* pRam );
+
+	// Reading, records are returned in the order they were written
+	bool	open		( const char* pFileName );
+	bool	nextFrame	( FrameHashRecord& record );
+
+	void	close		( void );
+
+	UINT	getRomCrc	( void )	{ return romCrc; }
+
+private:
+	FILE*	pFile;
+	UINT	romCrc;
+};
@@ -0,0 +1,281 @@
+#include "Hash.h"
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#include <intrin.h>
+#include <memory.h>
+
+// crcTables[0] is the usual byte at a time table, crcTables[k] is the
+// CRC of a byte followed by k zero bytes, so 8 bytes can be looked up
+// independently and combined
+static UINT crcTables[8][256];
+static bool hasClmul;
+
+static bool buildCrcTables() {
+	for (UINT i = 0; i < 256; ++i) {
+		UINT c = i;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+		}
+		crcTables[0][i] = c;
+	}
+	for (UINT i = 0; i < 256; ++i) {
+		for (int k = 1; k < 8; ++k) {
+			crcTables[k][i] = (crcTables[k - 1][i] >> 8) ^ crcTables[0][crcTables[k - 1][i] & 0xFF];
+		}
+	}
+
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	hasClmul = (cpuInfo[2] & (1 << 1)) != 0;
+	return true;
+}
+
+// Built before main so threads hashing at the same time never see a
+// half filled table
+static bool crcTablesBuilt = buildCrcTables();
+
+// Folding constants for the bit reflected polynomial: powers of x mod P
+// for carrying 128 bits forward over 64 and over 16 bytes, for going
+// from 64 to 32 bits, then P itself and the Barrett constant. From
+// Intel's "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ".
+static __declspec(align(16)) const unsigned long long foldBy4[2] = { 0x0154442BD4ULL, 0x01C6E41596ULL };
+static __declspec(align(16)) const unsigned long long foldBy1[2] = { 0x01751997D0ULL, 0x00CCAA009EULL };
+static __declspec(align(16)) const unsigned long long fold64[2] = { 0x0163CD6124ULL, 0 };
+static __declspec(align(16)) const unsigned long long barrett[2] = { 0x01DB710641ULL, 0x01F7011641ULL };
+
+// One fold: the 128 bits in x are carried forward over the distance k
+// stands for and added to the data there
+static inline __m128i fold(__m128i x, __m128i k, __m128i data) {
+	__m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+	__m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+	return _mm_xor_si128(_mm_xor_si128(high, low), data);
+}
+
+// Takes and returns the inverted CRC like the table loop below. length
+// is at least 64 and a multiple of 16.
+static UINT crc32Clmul(const BYTE* p, UINT length, UINT crc) {
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	p += 64;
+	length -= 64;
+
+	// Four independent streams keep the multiplier busy
+	__m128i k = _mm_load_si128((const __m128i*)foldBy4);
+	while (length >= 64) {
+		x1 = fold(x1, k, _mm_loadu_si128((const __m128i*)(p + 0x00)));
+		x2 = fold(x2, k, _mm_loadu_si128((const __m128i*)(p + 0x10)));
+		x3 = fold(x3, k, _mm_loadu_si128((const __m128i*)(p + 0x20)));
+		x4 = fold(x4, k, _mm_loadu_si128((const __m128i*)(p + 0x30)));
+		p += 64;
+		length -= 64;
+	}
+
+	k = _mm_load_si128((const __m128i*)foldBy1);
+	x1 = fold(x1, k, x2);
+	x1 = fold(x1, k, x3);
+	x1 = fold(x1, k, x4);
+	while (length >= 16) {
+		x1 = fold(x1, k, _mm_loadu_si128((const __m128i*)p));
+		p += 16;
+		length -= 16;
+	}
+
+	// 128 bits down to 64, then Barrett reduction down to 32
+	__m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	k = _mm_loadl_epi64((const __m128i*)fold64);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	k = _mm_load_si128((const __m128i*)barrett);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (UINT)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+UINT crc32(const BYTE* p, UINT length, UINT crc) {
+	crc = ~crc;
+
+	if (hasClmul && length >= 64) {
+		UINT folded = length & ~15;
+		crc = crc32Clmul(p, folded, crc);
+		p += folded;
+		length -= folded;
+	}
+
+	while (length >= 8) {
+		UINT one = *(const UINT*)p ^ crc;
+		UINT two = *(const UINT*)(p + 4);
+		crc = crcTables[7][one & 0xFF] ^ crcTables[6][(one >> 8) & 0xFF] ^
+			  crcTables[5][(one >> 16) & 0xFF] ^ crcTables[4][one >> 24] ^
+			  crcTables[3][two & 0xFF] ^ crcTables[2][(two >> 8) & 0xFF] ^
+			  crcTables[1][(two >> 16) & 0xFF] ^ crcTables[0][two >> 24];
+		p += 8;
+		length -= 8;
+	}
+	while (length--) {
+		crc = crcTables[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static const unsigned long long PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long PRIME64_3 = 0x165667B19E3779F9ULL;
+static const unsigned long long PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const unsigned long long PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// Starting keys of the two accumulators and how much they move per
+// stripe, so equal blocks at different offsets hash differently
+static __declspec(align(16)) const unsigned long long hashKeys[6] = {
+	PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME64_5, PRIME64_5
+};
+
+static inline unsigned long long mix64(unsigned long long h) {
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+// One 16 byte lane of a stripe: the keyed data multiplied 32x32->64 with
+// itself plus the data itself, the same accumulate step xxh3 uses
+static inline __m128i accumulate(__m128i acc, __m128i data, __m128i key) {
+	__m128i x = _mm_xor_si128(data, key);
+	acc = _mm_add_epi64(acc, _mm_mul_epu32(x, _mm_srli_epi64(x, 32)));
+	return _mm_add_epi64(acc, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+unsigned long long hash64(const BYTE* p, UINT length, unsigned long long seed) {
+	__declspec(align(16)) unsigned long long lanes[4] = {
+		seed ^ PRIME64_1, seed ^ PRIME64_2, seed ^ PRIME64_3, seed ^ PRIME64_4
+	};
+	__m128i acc0 = _mm_load_si128((const __m128i*)&lanes[0]);
+	__m128i acc1 = _mm_load_si128((const __m128i*)&lanes[2]);
+	__m128i key0 = _mm_load_si128((const __m128i*)&hashKeys[0]);
+	__m128i key1 = _mm_load_si128((const __m128i*)&hashKeys[2]);
+	__m128i keyStep = _mm_load_si128((const __m128i*)&hashKeys[4]);
+
+	UINT numStripes = length / 32;
+	for (UINT i = 0; i != numStripes; ++i, p += 32) {
+		acc0 = accumulate(acc0, _mm_loadu_si128((const __m128i*)p), key0);
+		acc1 = accumulate(acc1, _mm_loadu_si128((const __m128i*)(p + 16)), key1);
+		key0 = _mm_add_epi64(key0, keyStep);
+		key1 = _mm_add_epi64(key1, keyStep);
+	}
+
+	// The tail is zero padded, the length goes into the final mix
+	UINT tail = length & 31;
+	if (tail) {
+		__declspec(align(16)) BYTE last[32];
+		memset(last, 0, sizeof(last));
+		memcpy(last, p, tail);
+		acc0 = accumulate(acc0, _mm_load_si128((const __m128i*)last), key0);
+		acc1 = accumulate(acc1, _mm_load_si128((const __m128i*)(last + 16)), key1);
+	}
+
+	_mm_store_si128((__m128i*)&lanes[0], acc0);
+	_mm_store_si128((__m128i*)&lanes[2], acc1);
+
+	unsigned long long h = seed ^ (length * PRIME64_1);
+	for (int i = 0; i != 4; ++i) {
+		h = (h ^ mix64(lanes[i])) * PRIME64_1 + PRIME64_4;
+	}
+	return mix64(h);
+}
+
+static inline UINT rotl(UINT x, int n) {
+	return (x << n) | (x >> (32 - n));
+}
+
+// One round. Instead of shifting the five words along, each call
+// names them one place further round, five calls bring them back.
+#define SHA1_ROUND(a, b, c, d, e, f, k, i) {			\
+	e += rotl(a, 5) + (f) + (k) + SHA1_WORD(i);			\
+	b = rotl(b, 30);									\
+}
+
+// The message schedule only ever looks 16 words back, so it lives in a
+// 16 word ring filled in as the rounds go
+#define SHA1_WORD(i)	((i) < 16 ? w[i] : (w[(i) & 15] = rotl(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1)))
+
+#define SHA1_FIVE(F, k, i) {							\
+	SHA1_ROUND(a, b, c, d, e, F(b, c, d), k, i);		\
+	SHA1_ROUND(e, a, b, c, d, F(a, b, c), k, i + 1);	\
+	SHA1_ROUND(d, e, a, b, c, F(e, a, b), k, i + 2);	\
+	SHA1_ROUND(c, d, e, a, b, F(d, e, a), k, i + 3);	\
+	SHA1_ROUND(b, c, d, e, a, F(c, d, e), k, i + 4);	\
+}
+
+#define SHA1_CHOOSE(b, c, d)	((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_PARITY(b, c, d)	((b) ^ (c) ^ (d))
+#define SHA1_MAJORITY(b, c, d)	(((b) & (c)) | ((d) & ((b) | (c))))
+
+// One 64 byte block into the five state words
+static void sha1Block(UINT* h, const BYTE* p) {
+	UINT w[16];
+	for (int i = 0; i != 16; ++i) {
+		w[i] = (p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+	}
+
+	UINT a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	for (int i = 0; i != 20; i += 5) {
+		SHA1_FIVE(SHA1_CHOOSE, 0x5A827999, i);
+	}
+	for (int i = 20; i != 40; i += 5) {
+		SHA1_FIVE(SHA1_PARITY, 0x6ED9EBA1, i);
+	}
+	for (int i = 40; i != 60; i += 5) {
+		SHA1_FIVE(SHA1_MAJORITY, 0x8F1BBCDC, i);
+	}
+	for (int i = 60; i != 80; i += 5) {
+		SHA1_FIVE(SHA1_PARITY, 0xCA62C1D6, i);
+	}
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+void sha1(const BYTE* p, UINT length, BYTE digest[SHA1_SIZE]) {
+	UINT h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	UINT numBlocks = length / 64;
+	for (UINT i = 0; i != numBlocks; ++i, p += 64) {
+		sha1Block(h, p);
+	}
+
+	// The tail, a 1 bit, zeros and the length in bits fill one or two
+	// more blocks
+	BYTE last[128];
+	UINT tail = length & 63;
+	memset(last, 0, sizeof(last));
+	memcpy(last, p, tail);
+	last[tail] = 0x80;
+	UINT lastSize = tail < 56 ? 64 : 128;
+	unsigned long long bits = (unsigned long long)length * 8;
+	for (int i = 0; i != 8; ++i) {
+		last[lastSize - 1 - i] = (BYTE)(bits >> (i * 8));
+	}
+	sha1Block(h, last);
+	if (lastSize == 128) {
+		sha1Block(h, last + 64);
+	}
+
+	for (int i = 0; i != 5; ++i) {
+		digest[i * 4] = (BYTE)(h[i] >> 24);
+		digest[i * 4 + 1] = (BYTE)(h[i] >> 16);
+		digest[i * 4 + 2] = (BYTE)(h[i] >> 8);
+		digest[i * 4 + 3] = (BYTE)h[i];
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Types.h"
+
+#define SHA1_SIZE	20
+
+// Standard (zip/PNG) CRC-32. Pass the previous result as crc to hash a
+// buffer in several pieces. Folds 64 bytes at a time with carry-less
+// multiplies on CPUs that have PCLMULQDQ, 8 bytes at a time otherwise.
+UINT	crc32	( const BYTE* p, UINT length, UINT crc = 0 );
+
+// SHA-1, the hash ROM databases identify dumps by
+void	sha1	( const BYTE* p, UINT length, BYTE digest[SHA1_SIZE] );
+
+// Fast 64-bit hash for comparing frames and memory between runs, SSE2
+// over 32 bytes at a time. Not a checksum format, only stable within
+// this code base.
+unsigned long long	hash64	( const BYTE* p, UINT length, unsigned long long seed = 0 );
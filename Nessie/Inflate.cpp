@@ -0,0 +1,348 @@
+#include "Inflate.h"
+#include <memory.h>
+
+#define INFLATE_FAST_BITS	9
+#define INFLATE_FAST_MASK	((1 << INFLATE_FAST_BITS) - 1)
+#define INFLATE_MAX_BITS	15
+
+// Literal/length and distance codes, and the code length alphabet of
+// dynamic blocks
+#define NUM_LITLEN_CODES	288
+#define NUM_DIST_CODES		32
+#define NUM_CODELEN_CODES	19
+
+/*	A canonical Huffman code. fast is indexed by the next 9 bits of the
+	stream and holds the symbol and the code length, or 0 for codes that
+	are longer. Longer codes are found by comparing the next 16 bits,
+	most significant first, against the first code past each length. */
+struct HuffmanTable {
+	WORD	fast[1 << INFLATE_FAST_BITS];
+	UINT	limit[INFLATE_MAX_BITS + 2];	// First code past each length, left aligned to 16 bits
+	WORD	firstCode[INFLATE_MAX_BITS + 1];
+	WORD	firstIndex[INFLATE_MAX_BITS + 1];
+	WORD	symbols[NUM_LITLEN_CODES];		// Symbols in code order
+};
+
+static const WORD lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const BYTE lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const WORD distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const BYTE distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const BYTE codeLengthOrder[NUM_CODELEN_CODES] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static inline UINT reverseBits(UINT code, int numBits) {
+	UINT reversed = 0;
+	for (int i = 0; i != numBits; ++i) {
+		reversed = (reversed << 1) | (code & 1);
+		code >>= 1;
+	}
+	return reversed;
+}
+
+static bool buildTable(HuffmanTable& table, const BYTE* pLengths, UINT numSymbols) {
+	UINT counts[INFLATE_MAX_BITS + 1];
+	memset(counts, 0, sizeof(counts));
+	for (UINT i = 0; i != numSymbols; ++i) {
+		++counts[pLengths[i]];
+	}
+	counts[0] = 0;
+
+	// Codes of each length follow on from the ones before, one bit longer
+	UINT nextCode[INFLATE_MAX_BITS + 1];
+	UINT code = 0;
+	UINT index = 0;
+	for (int bits = 1; bits <= INFLATE_MAX_BITS; ++bits) {
+		nextCode[bits] = code;
+		table.firstCode[bits] = (WORD)code;
+		table.firstIndex[bits] = (WORD)index;
+		code += counts[bits];
+		if (code > (1U << bits)) {
+			return false;
+		}
+		table.limit[bits] = code << (16 - bits);
+		code <<= 1;
+		index += counts[bits];
+	}
+	table.limit[INFLATE_MAX_BITS + 1] = 0x10000;
+
+	memset(table.fast, 0, sizeof(table.fast));
+	for (UINT symbol = 0; symbol != numSymbols; ++symbol) {
+		int bits = pLengths[symbol];
+		if (!bits) {
+			continue;
+		}
+		table.symbols[table.firstIndex[bits] + nextCode[bits] - table.firstCode[bits]] = (WORD)symbol;
+
+		// Stream bits come least significant first, so the table is
+		// indexed by the code reversed, with every filling of the bits
+		// past its end
+		if (bits <= INFLATE_FAST_BITS) {
+			WORD entry = (WORD)((bits << INFLATE_FAST_BITS) | symbol);
+			for (UINT i = reverseBits(nextCode[bits], bits); i < (1 << INFLATE_FAST_BITS); i += 1 << bits) {
+				table.fast[i] = entry;
+			}
+		}
+		++nextCode[bits];
+	}
+	return true;
+}
+
+/*	Bits are taken from the bottom of a 64-bit buffer that is topped up
+	a byte at a time, so any code with its extra bits fits after one
+	refill. Past the end of the input it is topped up with zeros, which
+	a decode may look at but a valid stream never takes: the padding
+	still in the buffer is overrun bytes less what was taken of it. */
+class BitReader {
+public:
+	BitReader(const BYTE* pIn, UINT inSize) {
+		p = pIn;
+		pEnd = pIn + inSize;
+		buffer = 0;
+		numBits = 0;
+		overrun = 0;
+	}
+
+	inline void refill() {
+		while (numBits <= 56) {
+			if (p != pEnd) {
+				buffer |= (unsigned long long)*p++ << numBits;
+			} else {
+				++overrun;
+			}
+			numBits += 8;
+		}
+	}
+
+	inline UINT bits(int count) {
+		if (numBits < count) {
+			refill();
+		}
+		UINT value = (UINT)buffer & ((1U << count) - 1);
+		buffer >>= count;
+		numBits -= count;
+		return value;
+	}
+
+	// Returns -1 for a code that is not in the table
+	inline int decode(const HuffmanTable& table) {
+		if (numBits < 16) {
+			refill();
+		}
+		UINT entry = table.fast[buffer & INFLATE_FAST_MASK];
+		if (entry) {
+			int bits = entry >> INFLATE_FAST_BITS;
+			buffer >>= bits;
+			numBits -= bits;
+			return entry & INFLATE_FAST_MASK;
+		}
+
+		UINT code = reverseBits((UINT)buffer & 0xFFFF, 16);
+		int bits = INFLATE_FAST_BITS + 1;
+		while (code >= table.limit[bits]) {
+			++bits;
+		}
+		if (bits > INFLATE_MAX_BITS) {
+			return -1;
+		}
+		buffer >>= bits;
+		numBits -= bits;
+		return table.symbols[table.firstIndex[bits] + (code >> (16 - bits)) - table.firstCode[bits]];
+	}
+
+	// Stored blocks start on a byte boundary
+	void alignToByte() {
+		bits(numBits & 7);
+	}
+
+	// Copies bytes of a stored block, first whatever is buffered
+	bool copy(BYTE* pOut, UINT count) {
+		while (count && numBits) {
+			*pOut++ = (BYTE)bits(8);
+			--count;
+		}
+		if (count > (UINT)(pEnd - p)) {
+			return false;
+		}
+		memcpy(pOut, p, count);
+		p += count;
+		return true;
+	}
+
+	// Whether more bits were taken than the input holds
+	bool overran() {
+		return (unsigned long long)overrun * 8 > (unsigned long long)numBits;
+	}
+
+private:
+	const BYTE*			p;
+	const BYTE*			pEnd;
+	unsigned long long	buffer;
+	int					numBits;
+	UINT				overrun;
+};
+
+// Reads the code lengths of a dynamic block and builds its two tables
+static bool readDynamicTables(BitReader& reader, HuffmanTable& litlen, HuffmanTable& dist) {
+	UINT numLitlen = reader.bits(5) + 257;
+	UINT numDist = reader.bits(5) + 1;
+	UINT numCodeLengths = reader.bits(4) + 4;
+	if (numLitlen > 286 || numDist > 30) {
+		return false;
+	}
+
+	BYTE lengths[NUM_LITLEN_CODES + NUM_DIST_CODES];
+	memset(lengths, 0, NUM_CODELEN_CODES);
+	for (UINT i = 0; i != numCodeLengths; ++i) {
+		lengths[codeLengthOrder[i]] = (BYTE)reader.bits(3);
+	}
+	HuffmanTable codeLengths;
+	if (!buildTable(codeLengths, lengths, NUM_CODELEN_CODES)) {
+		return false;
+	}
+
+	// Both sets of lengths are one run, repeats can cross from one to
+	// the other
+	UINT total = numLitlen + numDist;
+	for (UINT i = 0; i < total; ) {
+		int symbol = reader.decode(codeLengths);
+		UINT repeat;
+		BYTE length;
+		if (symbol < 0) {
+			return false;
+		} else if (symbol < 16) {
+			lengths[i++] = (BYTE)symbol;
+			continue;
+		} else if (symbol == 16) {
+			if (i == 0) {
+				return false;
+			}
+			repeat = 3 + reader.bits(2);
+			length = lengths[i - 1];
+		} else if (symbol == 17) {
+			repeat = 3 + reader.bits(3);
+			length = 0;
+		} else {
+			repeat = 11 + reader.bits(7);
+			length = 0;
+		}
+		if (i + repeat > total) {
+			return false;
+		}
+		memset(lengths + i, length, repeat);
+		i += repeat;
+	}
+
+	// A block without an end of block code could never end
+	return lengths[256] != 0 &&
+		   buildTable(litlen, lengths, numLitlen) &&
+		   buildTable(dist, lengths + numLitlen, numDist);
+}
+
+static void buildFixedTables(HuffmanTable& litlen, HuffmanTable& dist) {
+	BYTE lengths[NUM_LITLEN_CODES];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 112);
+	memset(lengths + 256, 7, 24);
+	memset(lengths + 280, 8, 8);
+	buildTable(litlen, lengths, NUM_LITLEN_CODES);
+	memset(lengths, 5, NUM_DIST_CODES);
+	buildTable(dist, lengths, NUM_DIST_CODES);
+}
+
+// Decodes one compressed block onto the output
+static bool inflateBlock(BitReader& reader, const HuffmanTable& litlen, const HuffmanTable& dist,
+						 BYTE* pStart, BYTE*& pOut, BYTE* pEnd) {
+	for (;;) {
+		int symbol = reader.decode(litlen);
+		if (symbol < 256) {
+			if (symbol < 0 || pOut == pEnd) {
+				return false;
+			}
+			*pOut++ = (BYTE)symbol;
+			continue;
+		}
+		if (symbol == 256) {
+			return !reader.overran();
+		}
+
+		symbol -= 257;
+		if (symbol >= 29) {
+			return false;
+		}
+		int length = lengthBase[symbol] + reader.bits(lengthExtra[symbol]);
+		int distSymbol = reader.decode(dist);
+		if (distSymbol < 0 || distSymbol >= 30) {
+			return false;
+		}
+		int distance = distBase[distSymbol] + reader.bits(distExtra[distSymbol]);
+		if (distance > pOut - pStart || length > pEnd - pOut) {
+			return false;
+		}
+
+		// Matches at least 8 back can be copied 8 bytes at a time, the
+		// last copy may run past the match as long as it stays in the
+		// output
+		const BYTE* pFrom = pOut - distance;
+		if (distance >= 8 && pEnd - pOut >= length + 8) {
+			do {
+				memcpy(pOut, pFrom, 8);
+				pOut += 8;
+				pFrom += 8;
+				length -= 8;
+			} while (length > 0);
+			pOut += length;
+		} else {
+			while (length--) {
+				*pOut++ = *pFrom++;
+			}
+		}
+	}
+}
+
+bool inflate(const BYTE* pIn, UINT inSize, BYTE* pOut, UINT outSize) {
+	BitReader reader(pIn, inSize);
+	BYTE* pStart = pOut;
+	BYTE* pEnd = pOut + outSize;
+
+	HuffmanTable litlen;
+	HuffmanTable dist;
+	bool last;
+	do {
+		last = reader.bits(1) != 0;
+		UINT type = reader.bits(2);
+		if (type == 0) {
+			reader.alignToByte();
+			UINT length = reader.bits(16);
+			UINT check = reader.bits(16);
+			if ((length ^ 0xFFFF) != check || length > (UINT)(pEnd - pOut) || !reader.copy(pOut, length) || reader.overran()) {
+				return false;
+			}
+			pOut += length;
+			continue;
+		} else if (type == 1) {
+			buildFixedTables(litlen, dist);
+		} else if (type == 2) {
+			if (!readDynamicTables(reader, litlen, dist)) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+		if (!inflateBlock(reader, litlen, dist, pStart, pOut, pEnd)) {
+			return false;
+		}
+	} while (!last);
+
+	return pOut == pEnd && !reader.overran();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Types.h"
+
+/*	Raw DEFLATE (RFC 1951) decompression of a whole stream in one call,
+	for zip archives, which always say how big the result is. The output
+	goes straight to where it is needed and is never reallocated or
+	copied. Huffman codes up to 9 bits are decoded with one table lookup,
+	longer ones by a search over the code lengths. */
+
+// Fails unless pIn holds a complete valid stream that inflates to
+// exactly outSize bytes
+bool	inflate		( const BYTE* pIn, UINT inSize, BYTE* pOut, UINT outSize );
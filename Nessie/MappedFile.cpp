@@ -0,0 +1,56 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile() {
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	pData = NULL;
+	size = 0;
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const char* pFileName) {
+	close();
+	file = CreateFile(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	// Empty files can not be mapped, and nothing this loads is over 4 GB
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || fileSize.HighPart != 0) {
+		close();
+		return false;
+	}
+	size = fileSize.LowPart;
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	pData = (const BYTE*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pData) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (pData) {
+		UnmapViewOfFile(pData);
+		pData = NULL;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <windows.h>
+#include "Types.h"
+
+/*	A whole file mapped read only into memory. The pages come straight
+	from the OS file cache, so every process that maps the same file
+	shares one copy and nothing is read until it is touched. */
+class MappedFile {
+public:
+			MappedFile	( void );
+			~MappedFile	( void );
+
+	bool	open		( const char* pFileName );
+	void	close		( void );
+
+	const BYTE*	getData	( void )	{ return pData; }
+	UINT		getSize	( void )	{ return size; }
+
+private:
+	HANDLE		file;
+	HANDLE		mapping;
+	const BYTE*	pData;
+	UINT		size;
+};
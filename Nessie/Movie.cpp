@@ -0,0 +1,157 @@
+#include "Movie.h"
+#include <stdio.h>
+#include <memory.h>
+
+#define MOVIE_VERSION 1
+
+struct MovieHeader {
+	char	magic[4];		// "NMV\x1A"
+	WORD	version;
+	WORD	flags;
+	UINT	romCrc;
+	UINT	numFrames;
+	UINT	stateSize;
+	UINT	numRuns;
+};
+
+static const char movieMagic[4] = { 'N', 'M', 'V', 0x1A };
+
+Movie::Movie() {
+	romCrc = 0;
+	numFrames = 0;
+	rewind();
+}
+
+Movie::~Movie() {
+}
+
+bool Movie::load(const char* pFileName) {
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "rb") != 0 || !pFile) {
+		return false;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	long fileSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	// The state and the runs have to be all that follows the header
+	MovieHeader header;
+	bool ok = fread(&header, sizeof(header), 1, pFile) == 1
+		&& memcmp(header.magic, movieMagic, 4) == 0
+		&& header.version == MOVIE_VERSION
+		&& header.numRuns <= (UINT)fileSize / 3
+		&& (unsigned long long)sizeof(header) + header.stateSize + 3ull * header.numRuns == (unsigned long long)fileSize;
+
+	if (ok) {
+		romCrc = header.romCrc;
+		numFrames = header.numFrames;
+		state.resize(header.stateSize);
+		runs.resize(header.numRuns);
+		if (header.stateSize) {
+			ok = fread(&state[0], header.stateSize, 1, pFile) == 1;
+		}
+		for (UINT i = 0; ok && i < header.numRuns; ++i) {
+			BYTE run[3];
+			ok = fread(run, 3, 1, pFile) == 1;
+			runs[i].length = run[0];
+			runs[i].port1 = run[1];
+			runs[i].port2 = run[2];
+		}
+
+		// A movie whose runs do not add up to its length is damaged
+		unsigned long long runFrames = 0;
+		for (UINT i = 0; ok && i < header.numRuns; ++i) {
+			runFrames += runs[i].length + 1;
+		}
+		ok = ok && runFrames == numFrames;
+	}
+	fclose(pFile);
+
+	if (!ok) {
+		numFrames = 0;
+		state.clear();
+		runs.clear();
+	}
+	rewind();
+	return ok;
+}
+
+bool Movie::save(const char* pFileName) {
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "wb") != 0 || !pFile) {
+		return false;
+	}
+
+	MovieHeader header;
+	memcpy(header.magic, movieMagic, 4);
+	header.version = MOVIE_VERSION;
+	header.flags = state.empty() ? 0 : MOVIE_FLAG_SAVESTATE;
+	header.romCrc = romCrc;
+	header.numFrames = numFrames;
+	header.stateSize = (UINT)state.size();
+	header.numRuns = (UINT)runs.size();
+
+	bool ok = fwrite(&header, sizeof(header), 1, pFile) == 1;
+	if (ok && !state.empty()) {
+		ok = fwrite(&state[0], state.size(), 1, pFile) == 1;
+	}
+	for (UINT i = 0; ok && i < runs.size(); ++i) {
+		BYTE run[3] = { runs[i].length, runs[i].port1, runs[i].port2 };
+		ok = fwrite(run, 3, 1, pFile) == 1;
+	}
+	fclose(pFile);
+	return ok;
+}
+
+void Movie::begin(UINT crc, const BYTE* pState, UINT stateSize) {
+	romCrc = crc;
+	numFrames = 0;
+	runs.clear();
+	if (pState) {
+		state.assign(pState, pState + stateSize);
+	} else {
+		state.clear();
+	}
+	rewind();
+}
+
+void Movie::addFrame(BYTE port1, BYTE port2) {
+	++numFrames;
+
+	// Extend the last run if the input did not change
+	if (!runs.empty()) {
+		Run& last = runs.back();
+		if (last.port1 == port1 && last.port2 == port2 && last.length != 0xFF) {
+			++last.length;
+			return;
+		}
+	}
+
+	Run run;
+	run.length = 0;
+	run.port1 = port1;
+	run.port2 = port2;
+	runs.push_back(run);
+}
+
+void Movie::rewind() {
+	currentRun = 0;
+	currentRunFrame = 0;
+}
+
+bool Movie::nextFrame(BYTE& port1, BYTE& port2) {
+	if (currentRun >= runs.size()) {
+		return false;
+	}
+
+	const Run& run = runs[currentRun];
+	port1 = run.port1;
+	port2 = run.port2;
+
+	if (currentRunFrame++ == run.length) {
+		++currentRun;
+		currentRunFrame = 0;
+	}
+	return true;
+}
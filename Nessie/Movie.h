@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "Types.h"
+
+// Movie files start from either power on or an embedded save state
+#define MOVIE_FLAG_SAVESTATE	(0x1)
+
+/*	A recorded input session. The file is a small header, the optional
+	save state the movie starts from, and then the per-frame controller
+	input run length packed as (frames - 1, port 1, port 2) triples. Most
+	games hold the same buttons for many frames in a row so this stays
+	tiny even for long sessions. */
+class Movie {
+public:
+			Movie		( void );
+			~Movie		( void );
+
+	bool	load		( const char* pFileName );
+	bool	save		( const char* pFileName );
+
+	// Recording
+	void	begin		( UINT romCrc, const BYTE* pState, UINT stateSize );
+	void	addFrame	( BYTE port1, BYTE port2 );
+
+	// Playback, frames are fetched in order starting at rewind()
+	void	rewind		( void );
+	bool	nextFrame	( BYTE& port1, BYTE& port2 );
+	bool	isFinished	( void )	{ return currentRun >= runs.size(); }
+
+	UINT		getRomCrc		( void )	{ return romCrc; }
+	UINT		getNumFrames	( void )	{ return numFrames; }
+	bool		hasSaveState	( void )	{ return !state.empty(); }
+	const BYTE*	getSaveState	( void )	{ return state.empty() ? NULL : &state[0]; }
+	UINT		getSaveStateSize( void )	{ return (UINT)state.size(); }
+
+private:
+	struct Run {
+		BYTE	length;		// Number of frames - 1
+		BYTE	port1;
+		BYTE	port2;
+	};
+
+	UINT				romCrc;
+	UINT				numFrames;
+	std::vector<BYTE>	state;
+	std::vector<Run>	runs;
+
+	// Playback cursor
+	UINT	currentRun;
+	UINT	currentRunFrame;
+};
@@ -127,4 +127,22 @@
 #define NUM_CYCLES_PER_SCANLINE 113
 #define CPU_FREQUENCY 1789772
 #define NUM_SCANLINES_SCREEN    240
-#define NUM_SCANLINES_VBLANK    22
\ No newline at end of file
+#define NUM_SCANLINES_VBLANK    22
+
+/*	Controller ports. Writing bit 0 of JOYPAD1 strobes both controllers,
+	while it is high the controllers continuously reload their shift
+	registers with the current button state and when it goes low the
+	state is latched. Each read of JOYPAD1/JOYPAD2 then returns the next
+	button in bit 0, in the order below. After all eight buttons have
+	been read official controllers return 1. */
+#define JOYPAD1 (0x4016)
+#define JOYPAD2 (0x4017)
+
+#define BUTTON_A		(0x01)
+#define BUTTON_B		(0x02)
+#define BUTTON_SELECT	(0x04)
+#define BUTTON_START	(0x08)
+#define BUTTON_UP		(0x10)
+#define BUTTON_DOWN		(0x20)
+#define BUTTON_LEFT		(0x40)
+#define BUTTON_RIGHT	(0x80)
@@ -0,0 +1,49 @@
+#include "OpcodeStats.h"
+#include <stdio.h>
+#include <memory.h>
+
+void clearOpcodeStats(OpcodeStats& s) {
+	memset(&s, 0, sizeof(s));
+}
+
+void addOpcodeStats(OpcodeStats& s, const OpcodeStats& add) {
+	for (int i = 0; i != 256; ++i) {
+		s.executions[i] += add.executions[i];
+		s.cycles[i] += add.cycles[i];
+		s.pageCrosses[i] += add.pageCrosses[i];
+		s.takenBranches[i] += add.takenBranches[i];
+	}
+	for (int i = 0; i != 256 * 256; ++i) {
+		s.pairs[i] += add.pairs[i];
+	}
+}
+
+bool writeOpcodeStatsCsv(const OpcodeStats& s, const char* pFileName, const char* pPairFileName) {
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "w") != 0 || !pFile) {
+		return false;
+	}
+	fprintf(pFile, "opcode,executions,cycles,page_crosses,taken_branches\n");
+	for (int i = 0; i != 256; ++i) {
+		if (s.executions[i]) {
+			fprintf(pFile, "%02X,%llu,%llu,%llu,%llu\n", i, s.executions[i], s.cycles[i], s.pageCrosses[i], s.takenBranches[i]);
+		}
+	}
+	fclose(pFile);
+
+	if (!pPairFileName) {
+		return true;
+	}
+
+	if (fopen_s(&pFile, pPairFileName, "w") != 0 || !pFile) {
+		return false;
+	}
+	fprintf(pFile, "first,second,count\n");
+	for (int i = 0; i != 256 * 256; ++i) {
+		if (s.pairs[i]) {
+			fprintf(pFile, "%02X,%02X,%llu\n", i >> 8, i & 0xFF, s.pairs[i]);
+		}
+	}
+	fclose(pFile);
+	return true;
+}
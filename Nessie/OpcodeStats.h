@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Types.h"
+
+/*	Per-opcode execution counters, kept by CPU::run when the build
+	defines NESSIE_OPCODE_STATS. Without it the counting code is not
+	compiled in at all and CPU::getOpcodeStats returns NULL.
+
+	pageCrosses counts indexed accesses and branches that crossed a
+	page. Reads and taken branches pay a cycle for it, which is part of
+	cycles. Stores and read-modify-writes always pay that cycle, so for
+	them a crossing costs nothing extra.
+
+	takenBranches only applies to the eight branch opcodes and counts
+	the branches whose condition held, including those with an offset
+	of 0. pairs[first * 256 + second] counts how often second directly
+	followed first, across interrupts.
+
+	Instructions the lockstep WideCPU executes itself are not counted,
+	only those going through CPU::run.
+
+	Overhead with the counters on, measured with nessie-bench run
+	nestest.nes -frames 600 -reps 5 on a single core VM: the norender
+	workload dropped from 12900-14000 to about 10400 frames per second,
+	20-25% slower. Each instruction updates up to five counters, one of
+	them in the 512 KB pair table. With the define off the build is
+	unchanged. */
+struct OpcodeStats {
+	unsigned long long	executions		[ 256 ];
+	unsigned long long	cycles			[ 256 ];
+	unsigned long long	pageCrosses		[ 256 ];
+	unsigned long long	takenBranches	[ 256 ];
+	unsigned long long	pairs			[ 256 * 256 ];
+};
+
+void	clearOpcodeStats		( OpcodeStats& s );
+void	addOpcodeStats			( OpcodeStats& s, const OpcodeStats& add );
+
+// Writes opcode,executions,cycles,page_crosses,taken_branches rows for
+// every opcode that ran, and first,second,count rows for every pair
+// that occurred. pPairFileName may be NULL.
+bool	writeOpcodeStatsCsv		( const OpcodeStats& s, const char* pFileName, const char* pPairFileName );
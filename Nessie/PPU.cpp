@@ -3,9 +3,12 @@
 #include "NES.h"
 #include "Emulator.h"
 #include "CPU.h"
+#include "State.h"
 
 #define SLEndFrame 262
 
+static const BYTE blankChr[CHR_RAM_SIZE] = { 0 };
+
 const	unsigned char	ReverseCHR[256] =
 {
 	0x00,0x80,0x40,0xC0,0x20,0xA0,0x60,0xE0,0x10,0x90,0x50,0xD0,0x30,0xB0,0x70,0xF0,
@@ -70,9 +73,20 @@ const	unsigned long	CHRHiBit[16] =
 PPU::PPU(CPU* p, Emulator* pEmu) {
 	pCpu = p;
 	pEmulator = pEmu;
+
+	// Power on with cleared memories so runs are deterministic
+	memset(oamData, 0, sizeof(oamData));
+	memset(spriteBuffer, 0, sizeof(spriteBuffer));
+	memset(palette, 0, sizeof(palette));
+	memset(aNameTableMem, 0, sizeof(aNameTableMem));
+
+	// Blank pattern tables until a cartridge is loaded
+	pChrRam = NULL;
+	setChrRom(blankChr);
 }
 
 PPU::~PPU() {
+	delete[] pChrRam;
 }
 
 void PPU::reset() {
@@ -81,6 +95,7 @@ void PPU::reset() {
 	
 	// Reset the register write toggle flag
 	regWriteToggle = 1;
+	vramReadBuffer = 0;
 	intX = 0;
 	ppuAddr = 0;
 	intReg = 0;
@@ -104,8 +119,6 @@ BYTE PPU::readOAMData() {
 }
 
 BYTE PPU::readPPUData() {
-	static BYTE vramReadBuffer;	// Garbage from the start!!
-
 	BYTE ret = vramReadBuffer;
 	WORD a = ppuAddr;
 
@@ -187,32 +200,47 @@ void PPU::writeOAMMem( BYTE address, BYTE data ) {
 	oamData[address] = data;
 }
 
+// The copy wraps around to the start of OAM when OAMADDR is not 0
+void PPU::writeOAMBlock( const BYTE* p ) {
+	BYTE start = reg[OAMADDR & 7];
+	memcpy(oamData + start, p, 0x100 - start);
+	memcpy(oamData, p + (0x100 - start), start);
+}
+
 BYTE PPU::readOAMMem( BYTE address ) {
 	return oamData[address];
 }
 
 void PPU::writePPUMem( WORD address, BYTE data ) {
-	BYTE* p = getVramPtr(address);
-	*p = data; // Screw illegal writes right now
-}
+	// Data is completely mirrored after 0x3FFF so 
+	// strip away anything greater than that.
+	address &= 0x3FFF;
 
-BYTE PPU::readPPUMem( WORD address ) {
-	BYTE* p = getVramPtr(address);
-	return *p;
+	if (address < 0x2000) {
+		// CHR ROM is mapped read only, writing it would fault
+		if (pChrRam) {
+			pChrRam[address] = data;
+		}
+		return;
+	}
+	*getVramPtr(address) = data;
 }
 
-BYTE* PPU::getVramPtr(WORD address) {
-	// Data is completely mirrored after 0x3FFF so 
-	// strip away anything greater than that.
+BYTE PPU::readPPUMem( WORD address ) {
 	address &= 0x3FFF;
 
 	if (address < 0x1000) {
 		// This leads to the pattern tables
-		return pPatternTable1 + address;
+		return pPatternTable1[address];
 	} else if (address < 0x2000) {
-		// This leads to the pattern tables
-		return pPatternTable2 + address - 0x1000;
-	} else if (address < 0x3EFF) {
+		return pPatternTable2[address - 0x1000];
+	}
+	return *getVramPtr(address);
+}
+
+// Name tables and palette, address is $2000-$3FFF
+BYTE* PPU::getVramPtr(WORD address) {
+	if (address < 0x3EFF) {
 		// Account for the possible mirroring of the naming tables
 		if (address >= 0x3000) {
 			address -= 0x1000;
@@ -252,11 +280,20 @@ void PPU::setupNameTables( int mirror ) {
 	}
 }
 
-void PPU::setPatternTable1( BYTE* p ) {
+void PPU::setChrRom( const BYTE* p ) {
+	delete[] pChrRam;
+	pChrRam = NULL;
 	pPatternTable1 = p;
+	pPatternTable2 = p + 0x1000;
 }
-void PPU::setPatternTable2( BYTE* p ) {
-	pPatternTable2 = p;
+
+void PPU::setChrRam() {
+	if (!pChrRam) {
+		pChrRam = new BYTE[CHR_RAM_SIZE];
+	}
+	memset(pChrRam, 0, CHR_RAM_SIZE);
+	pPatternTable1 = pChrRam;
+	pPatternTable2 = pChrRam + 0x1000;
 }
 
 void PPU::setVblankFlag() {
@@ -267,7 +304,44 @@ void PPU::clearVblankFlag() {
 	reg[PPUSTATUS & 7] &= 0x7F;
 }
 
-void PPU::renderScanline(int scanline, unsigned int* pOut) {
+UINT PPU::getStateSize() {
+	return sizeof(regWriteToggle) + sizeof(vramReadBuffer) + sizeof(reg) + sizeof(intX) + sizeof(ppuAddr) +
+		sizeof(intReg) + sizeof(oamData) + sizeof(palette) + sizeof(aNameTableMem) + (pChrRam ? CHR_RAM_SIZE : 0);
+}
+
+void PPU::saveState(BYTE*& p) {
+	STATE_WRITE(p, regWriteToggle);
+	STATE_WRITE(p, vramReadBuffer);
+	STATE_WRITE(p, reg);
+	STATE_WRITE(p, intX);
+	STATE_WRITE(p, ppuAddr);
+	STATE_WRITE(p, intReg);
+	STATE_WRITE(p, oamData);
+	STATE_WRITE(p, palette);
+	STATE_WRITE(p, aNameTableMem);
+	if (pChrRam) {
+		memcpy(p, pChrRam, CHR_RAM_SIZE);
+		p += CHR_RAM_SIZE;
+	}
+}
+
+void PPU::loadState(const BYTE*& p) {
+	STATE_READ(p, regWriteToggle);
+	STATE_READ(p, vramReadBuffer);
+	STATE_READ(p, reg);
+	STATE_READ(p, intX);
+	STATE_READ(p, ppuAddr);
+	STATE_READ(p, intReg);
+	STATE_READ(p, oamData);
+	STATE_READ(p, palette);
+	STATE_READ(p, aNameTableMem);
+	if (pChrRam) {
+		memcpy(pChrRam, p, CHR_RAM_SIZE);
+		p += CHR_RAM_SIZE;
+	}
+}
+
+void PPU::renderScanline(int scanline, BYTE* pOut) {
 	// First find out which name table we are using
 	// it is found in 0x2000 lower two bits
 	int nt = reg[PPUCTRL & 7] & 3;
@@ -281,7 +355,7 @@ void PPU::renderScanline(int scanline, unsigned int* pOut) {
 	// Find out which pattern table we are using
 	// this is found in PPUCTRL >> 4 (one bit);
 	int pt = (reg[PPUCTRL & 7] & 0x10) >> 4;
-	BYTE* pPatternTable = pt ? pPatternTable1 : pPatternTable2;
+	const BYTE* pPatternTable = pt ? pPatternTable1 : pPatternTable2;
 
 	// Calculate beginning tile number
 	// Scanline / 8 * 32 + Hscroll / 8;
@@ -289,13 +363,12 @@ void PPU::renderScanline(int scanline, unsigned int* pOut) {
 	int tileNum = startTile + ( intX >> 3);
 
 	BYTE* pTileAddr = pNameTable + tileNum;
-	BYTE* pTileDataOffset = pPatternTable + *pTileAddr;
+	const BYTE* pTileDataOffset = pPatternTable + *pTileAddr;
 
 //	BYTE tileData1 = 
 
 	for (int i = 0; i < 256; ++i ) {
 		BYTE b = *(pTileAddr + ( i >> 3));
-		b << 4;
-		*pOut++ = ((unsigned int)b) << 16 | b;
+		*pOut++ = b & 0x3F;
 	}
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 class CPU;
 class Emulator;
 
+#define CHR_RAM_SIZE	0x2000
+
 class PPU {
 public:
 			PPU			( CPU* p, Emulator* pEmu );
@@ -28,16 +30,26 @@ public:
 	// Direct accessors into video memory, that is not used by 'real' NES instructions
 	// This is open for DMA access
 	void	writeOAMMem		( BYTE address, BYTE data );
+	void	writeOAMBlock	( const BYTE* p );	// 256 bytes starting at OAMADDR
 	
 	void	setupNameTables		( int mirror );
-	void	setPatternTable1	( BYTE* p );
-	void	setPatternTable2	( BYTE* p );
 
-	void	renderScanline		(int scanline, unsigned int* pOut);
+	// The pattern tables are either 8 KB of CHR ROM, which ignores
+	// writes, or 8 KB of CHR RAM the PPU allocates for itself, which is
+	// saved in states
+	void	setChrRom			( const BYTE* p );
+	void	setChrRam			( void );
+
+	void	renderScanline		(int scanline, BYTE* pOut);
 
 	void	setVblankFlag		(void);
 	void	clearVblankFlag		(void);
 
+	// Save states, saveState writes getStateSize bytes
+	UINT	getStateSize	( void );
+	void	saveState	( BYTE*& p );
+	void	loadState	( const BYTE*& p );
+
 private:
 	BYTE	readPPUMem		( WORD address );
 	void	writePPUMem		( WORD address, BYTE data );
@@ -48,6 +60,9 @@ private:
 
 	BYTE	regWriteToggle;
 
+	// Delayed PPUDATA read result
+	BYTE	vramReadBuffer;
+
 	// The bus-accessible registers
 	BYTE	reg[8];
 
@@ -58,12 +73,13 @@ private:
 	WORD	intReg;	// Intermediate register
 
 	// OAM data
-	BYTE	oamData			[ 0xFF ];		// 256 bytes of spritie goodness
+	BYTE	oamData			[ 0x100 ];		// 256 bytes of spritie goodness
 	BYTE	spriteBuffer	[ 0x20 ];
 
 	// PPU data
-	BYTE*	pPatternTable1;
-	BYTE*	pPatternTable2;
+	const BYTE*	pPatternTable1;
+	const BYTE*	pPatternTable2;
+	BYTE*		pChrRam;		// CHR_RAM_SIZE bytes, NULL with CHR ROM
 	BYTE*	apNameTable		[ 4 ];
 
 	BYTE	palette			[ 0xFF ];
@@ -0,0 +1,22 @@
+#include "Palette.h"
+
+const unsigned int NESPalette[64] =
+{
+	0x7C7C7C,0x0000FC,0x0000BC,0x4428BC,0x940084,0xA80020,0xA81000,0x881400,
+	0x503000,0x007800,0x006800,0x005800,0x004058,0x000000,0x000000,0x000000,
+	0xBCBCBC,0x0078F8,0x0058F8,0x6844FC,0xD800CC,0xE40058,0xF83800,0xE45C10,
+	0xAC7C00,0x00B800,0x00A800,0x00A844,0x008888,0x000000,0x000000,0x000000,
+	0xF8F8F8,0x3CBCFC,0x6888FC,0x9878F8,0xF878F8,0xF85898,0xF87858,0xFCA044,
+	0xF8B800,0xB8F818,0x58D854,0x58F898,0x00E8D8,0x787878,0x000000,0x000000,
+	0xFCFCFC,0xA4E4FC,0xB8B8F8,0xD8B8F8,0xF8B8F8,0xF8A4C0,0xF0D0B0,0xFCE0A8,
+	0xF8D878,0xD8F878,0xB8F8B8,0xB8F8D8,0x00FCFC,0xF8D8F8,0x000000,0x000000
+};
+
+// 0.299 R + 0.587 G + 0.114 B of the entries above
+const BYTE NESPaletteLuma[64] =
+{
+	124, 29, 21, 65, 59, 54, 60, 52, 52, 70, 61, 52, 48,  0,  0,  0,
+	188, 99, 80,100, 88, 78,107,124,124,108, 99,106, 95,  0,  0,  0,
+	248,157,140,144,173,143,155,177,182,203,163,189,161,120,  0,  0,
+	252,212,191,201,210,192,214,226,215,224,222,225,177,229,  0,  0
+};
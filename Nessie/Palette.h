@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Types.h"
+
+// The 64 colours the PPU can output as 0x00RRGGBB
+extern const unsigned int	NESPalette		[ 64 ];
+
+// Luminance of each palette entry, for grayscale output
+extern const BYTE			NESPaletteLuma	[ 64 ];
@@ -0,0 +1,133 @@
+#include "Profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CPUMem.h"
+
+Profiler::Profiler(CPUMem* pMem, UINT interval) {
+	pMemory = pMem;
+	sampleInterval = interval ? (int)interval : 1;
+	cyclesUntilSample = sampleInterval;
+	numSamples = 0;
+	depth = 0;
+}
+
+Profiler::~Profiler() {
+}
+
+void Profiler::clear() {
+	samples.clear();
+	numSamples = 0;
+	cyclesUntilSample = sampleInterval;
+}
+
+void Profiler::call(WORD target, BYTE sp) {
+	if (depth < PROFILER_MAX_DEPTH) {
+		Frame& frame = stack[depth];
+		frame.address = target;
+		frame.bank = pMemory->getPrgBank(target);
+		frame.sp = sp;
+	}
+	++depth;
+}
+
+void Profiler::ret(BYTE sp) {
+	// Frames that did not fit are assumed to return in order
+	if (depth > PROFILER_MAX_DEPTH) {
+		--depth;
+		return;
+	}
+
+	// Everything at or below the stack pointer has been returned from
+	while (depth > 0 && stack[depth - 1].sp <= sp) {
+		--depth;
+	}
+}
+
+DWORD Profiler::makeKey(WORD address, BYTE bank) {
+	return ((DWORD)(address < 0x8000 ? PROFILER_NO_BANK : bank) << 16) | address;
+}
+
+void Profiler::sample(WORD pc) {
+	cyclesUntilSample += sampleInterval;
+	++numSamples;
+
+	int kept = depth < PROFILER_MAX_DEPTH ? depth : PROFILER_MAX_DEPTH;
+	std::vector<DWORD> key(kept + 1);
+	for (int i = 0; i != kept; ++i) {
+		key[i] = makeKey(stack[i].address, stack[i].bank);
+	}
+	key[kept] = makeKey(pc, pMemory->getPrgBank(pc));
+	++samples[key];
+}
+
+bool Profiler::loadLabels(const char* pFileName) {
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "r") != 0 || !pFile) {
+		return false;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), pFile)) {
+		if (line[0] == ';' || line[0] == '#') {
+			continue;
+		}
+
+		char name[200];
+		unsigned int bank;
+		unsigned int address;
+		if (sscanf_s(line, "%x %x %199s", &bank, &address, name, (unsigned)sizeof(name)) == 3) {
+			labels[makeKey((WORD)address, (BYTE)bank)] = name;
+		}
+	}
+	fclose(pFile);
+	return true;
+}
+
+// Frames on the stack are function entries and get their exact label.
+// The sampled PC is somewhere inside a function and gets the closest
+// label before it in the same bank.
+std::string Profiler::symbolize(DWORD key, bool exact) {
+	std::map<DWORD, std::string>::const_iterator it = labels.upper_bound(key);
+	if (it != labels.begin()) {
+		--it;
+		if (it->first == key || (!exact && (it->first >> 16) == (key >> 16))) {
+			return it->second;
+		}
+	}
+
+	char name[16];
+	if ((key >> 16) == PROFILER_NO_BANK) {
+		sprintf_s(name, sizeof(name), "$%04X", key & 0xFFFF);
+	} else {
+		sprintf_s(name, sizeof(name), "%02X:$%04X", key >> 16, key & 0xFFFF);
+	}
+	return name;
+}
+
+bool Profiler::writeFolded(const char* pFileName) {
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "w") != 0 || !pFile) {
+		return false;
+	}
+
+	// Different PCs can symbolize to the same label, so merge by text
+	std::map<std::string, UINT> folded;
+	std::map<std::vector<DWORD>, UINT>::const_iterator it;
+	for (it = samples.begin(); it != samples.end(); ++it) {
+		const std::vector<DWORD>& key = it->first;
+		std::string line = "reset";
+		for (size_t i = 0; i != key.size(); ++i) {
+			line += ";";
+			line += symbolize(key[i], i + 1 != key.size());
+		}
+		folded[line] += it->second;
+	}
+
+	std::map<std::string, UINT>::const_iterator f;
+	for (f = folded.begin(); f != folded.end(); ++f) {
+		fprintf(pFile, "%s %u\n", f->first.c_str(), f->second);
+	}
+	fclose(pFile);
+	return true;
+}
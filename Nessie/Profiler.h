@@ -0,0 +1,69 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Types.h"
+
+class CPUMem;
+
+#define PROFILER_MAX_DEPTH	64
+
+// Bank number used for code outside the PRG ROM, RAM and the like
+#define PROFILER_NO_BANK	0xFF
+
+/*	Sampling profiler for the 6502 code of the running game. Every
+	sampleInterval emulated cycles it records the PC together with a
+	shadow call stack that the CPU maintains through JSR/RTS and
+	NMI/RTI. Samples are kept as counts per distinct stack and written
+	as folded stacks ("outer;inner;leaf count" lines) that flamegraph
+	tools read directly.
+
+	The shadow stack follows the real stack pointer, so a return that
+	unwinds several frames at once (or code that resets S) pops every
+	frame above it, and pushed-address jump tables that RTS without a
+	JSR leave it alone.
+
+	A label file names addresses per PRG bank, one "bank address name"
+	per line in hex, e.g. "0 C5F5 main_loop". Lines starting with ;
+	or # are comments. Addresses below $8000 ignore the bank. */
+class Profiler {
+public:
+			Profiler	( CPUMem* pMem, UINT sampleInterval );
+			~Profiler	( void );
+
+	// Called by the CPU. sp is S after the return address was pushed,
+	// or before it is popped.
+	void	call		( WORD target, BYTE sp );
+	void	ret			( BYTE sp );
+	inline void	advance	( int cycles, WORD pc )	{ cyclesUntilSample -= cycles; if (cyclesUntilSample <= 0) { sample(pc); } }
+
+	bool	loadLabels	( const char* pFileName );
+	bool	writeFolded	( const char* pFileName );
+
+	UINT	getNumSamples	( void )	{ return numSamples; }
+	void	clear			( void );
+
+private:
+	struct Frame {
+		WORD	address;
+		BYTE	bank;
+		BYTE	sp;
+	};
+
+	void		sample		( WORD pc );
+	DWORD		makeKey		( WORD address, BYTE bank );
+	std::string	symbolize	( DWORD key, bool exact );
+
+	CPUMem*	pMemory;
+	int		sampleInterval;
+	int		cyclesUntilSample;
+	UINT	numSamples;
+
+	Frame	stack[ PROFILER_MAX_DEPTH ];
+	int		depth;		// May exceed PROFILER_MAX_DEPTH, deeper frames are not kept
+
+	// Sample counts by stack, each stack a list of (bank << 16 | address)
+	std::map<std::vector<DWORD>, UINT>	samples;
+	std::map<DWORD, std::string>		labels;
+};
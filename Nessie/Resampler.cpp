@@ -0,0 +1,113 @@
+#include "Resampler.h"
+#include <math.h>
+#include <memory.h>
+#include <stdlib.h>
+#include <emmintrin.h>
+
+#define PI	3.14159265358979323846
+
+// Where the filter starts to roll off, as a fraction of the lower of the
+// two rates
+#define RESAMPLER_CUTOFF	0.45
+
+// Each phase is a Blackman windowed sinc centered between input samples
+// RESAMPLER_TAPS / 2 - 1 and RESAMPLER_TAPS / 2, offset by the phase
+// fraction, and normalized so it passes DC unchanged
+Resampler::Resampler(int inputRate, int outputRate) {
+	baseStep = (unsigned long long)((double)inputRate / outputRate * 4294967296.0 + 0.5);
+	step = baseStep;
+	position = 0;
+	adjust = 0.0;
+
+	pHistory = new float[RESAMPLER_MAX_INPUT + RESAMPLER_TAPS];
+	numHistory = RESAMPLER_TAPS / 2 - 1;
+	memset(pHistory, 0, (RESAMPLER_MAX_INPUT + RESAMPLER_TAPS) * sizeof(float));
+
+	pKernelAlloc = malloc(RESAMPLER_PHASES * RESAMPLER_TAPS * sizeof(float) + 15);
+	pKernel = (float*)(((size_t)pKernelAlloc + 15) & ~(size_t)15);
+
+	double cutoff = RESAMPLER_CUTOFF * (outputRate < inputRate ? (double)outputRate / inputRate : 1.0);
+	for (int phase = 0; phase != RESAMPLER_PHASES; ++phase) {
+		double taps[RESAMPLER_TAPS];
+		double sum = 0.0;
+		for (int i = 0; i != RESAMPLER_TAPS; ++i) {
+			double x = i - (RESAMPLER_TAPS / 2 - 1) - (double)phase / RESAMPLER_PHASES;
+			double sinc = x == 0.0 ? 1.0 : sin(2.0 * PI * cutoff * x) / (2.0 * PI * cutoff * x);
+			double w = 2.0 * PI * (x + RESAMPLER_TAPS / 2) / RESAMPLER_TAPS;
+			double window = 0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+			taps[i] = sinc * window;
+			sum += taps[i];
+		}
+		for (int i = 0; i != RESAMPLER_TAPS; ++i) {
+			pKernel[phase * RESAMPLER_TAPS + i] = (float)(taps[i] / sum);
+		}
+	}
+}
+
+Resampler::~Resampler() {
+	delete[] pHistory;
+	free(pKernelAlloc);
+}
+
+// Proportional control on the distance from the target, which settles
+// where the producer and the consumer agree on the rate
+void Resampler::adjustForFill(UINT fill, UINT target) {
+	if (!target) {
+		return;
+	}
+
+	adjust = RESAMPLER_MAX_ADJUST * ((double)fill - (double)target) / target;
+	if (adjust > RESAMPLER_MAX_ADJUST) {
+		adjust = RESAMPLER_MAX_ADJUST;
+	} else if (adjust < -RESAMPLER_MAX_ADJUST) {
+		adjust = -RESAMPLER_MAX_ADJUST;
+	}
+
+	// A fuller buffer takes bigger steps through the input, which makes
+	// fewer output samples
+	step = (unsigned long long)(baseStep * (1.0 + adjust));
+}
+
+int Resampler::process(const short* pIn, int numIn, short* pOut, int maxOutput) {
+	if (numIn > RESAMPLER_MAX_INPUT + RESAMPLER_TAPS - numHistory) {
+		numIn = RESAMPLER_MAX_INPUT + RESAMPLER_TAPS - numHistory;
+	}
+	for (int i = 0; i != numIn; ++i) {
+		pHistory[numHistory + i] = pIn[i];
+	}
+	numHistory += numIn;
+
+	int numOut = 0;
+	while (numOut < maxOutput) {
+		UINT base = (UINT)(position >> 32);
+		if (base + RESAMPLER_TAPS > (UINT)numHistory) {
+			break;
+		}
+
+		UINT phase = (UINT)(position >> (32 - RESAMPLER_PHASE_BITS)) & (RESAMPLER_PHASES - 1);
+		const float* pTaps = pKernel + phase * RESAMPLER_TAPS;
+		const float* pSamples = pHistory + base;
+
+		__m128 sum = _mm_setzero_ps();
+		for (int i = 0; i != RESAMPLER_TAPS; i += 4) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pSamples + i), _mm_load_ps(pTaps + i)));
+		}
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+		// Saturates to the 16-bit range on the way out
+		__m128i s = _mm_cvtps_epi32(sum);
+		pOut[numOut++] = (short)_mm_cvtsi128_si32(_mm_packs_epi32(s, s));
+		position += step;
+	}
+
+	// Keep the input the next output samples still need
+	UINT consumed = (UINT)(position >> 32);
+	if (consumed > (UINT)numHistory) {
+		consumed = numHistory;
+	}
+	memmove(pHistory, pHistory + consumed, (numHistory - consumed) * sizeof(float));
+	numHistory -= consumed;
+	position -= ((unsigned long long)consumed) << 32;
+	return numOut;
+}
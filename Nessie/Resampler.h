@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Types.h"
+
+// Sub-sample positions the filter is tabulated for
+#define RESAMPLER_PHASE_BITS	8
+#define RESAMPLER_PHASES		(1 << RESAMPLER_PHASE_BITS)
+
+// Input samples each output sample is filtered from, a multiple of 4
+#define RESAMPLER_TAPS			16
+
+// Input samples one process call can take
+#define RESAMPLER_MAX_INPUT		4096
+
+// How far the ratio may be pulled to keep the output buffer in step
+#define RESAMPLER_MAX_ADJUST	0.005
+
+/*	Converts 16-bit mono audio between two sample rates with a polyphase
+	windowed sinc filter. Every output sample is the dot product of
+	RESAMPLER_TAPS input samples with the filter phase closest to its
+	position between them, done four taps at a time with SSE2.
+
+	The ratio can be pulled by up to RESAMPLER_MAX_ADJUST from the rate
+	conversion. adjustForFill does that from how full the buffer the
+	output goes to is, so a producer paced by the video clock neither
+	starves nor floods an audio device running on its own clock. Half
+	a percent is too little to hear as a change in pitch. */
+class Resampler {
+public:
+			Resampler	( int inputRate, int outputRate );
+			~Resampler	( void );
+
+	// Takes a batch of input and writes up to maxOutput samples, returns
+	// how many. Call again with no input to get the rest when the output
+	// did not fit.
+	int		process			( const short* pIn, int numIn, short* pOut, int maxOutput );
+
+	// Pulls the ratio towards keeping fill at target
+	void	adjustForFill	( UINT fill, UINT target );
+	double	getAdjust		( void )	{ return adjust; }
+
+private:
+	// Input samples advanced per output sample, 32.32 fixed point
+	unsigned long long	baseStep;
+	unsigned long long	step;
+	unsigned long long	position;
+	double				adjust;
+
+	int		numHistory;
+	float*	pHistory;	// RESAMPLER_MAX_INPUT + RESAMPLER_TAPS samples
+	float*	pKernel;	// RESAMPLER_PHASES rows of RESAMPLER_TAPS, 16-byte aligned
+	void*	pKernelAlloc;
+};
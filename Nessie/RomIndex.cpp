@@ -0,0 +1,126 @@
+#include "RomIndex.h"
+#include <stdio.h>
+#include <memory.h>
+#include <algorithm>
+
+static const BYTE indexMagic[4] = { 'N', 'R', 'I', 0x1A };
+
+RomIndex::RomIndex() {
+	pEntries = NULL;
+	numEntries = 0;
+}
+
+bool RomIndex::load(const char* pFileName) {
+	close();
+	if (!file.open(pFileName)) {
+		return false;
+	}
+
+	const RomIndexHeader* pHeader = (const RomIndexHeader*)file.getData();
+	if (file.getSize() < sizeof(RomIndexHeader) ||
+		memcmp(pHeader->magic, indexMagic, sizeof(indexMagic)) != 0 ||
+		pHeader->version != ROM_INDEX_VERSION ||
+		pHeader->entrySize != sizeof(RomIndexEntry) ||
+		(file.getSize() - sizeof(RomIndexHeader)) % sizeof(RomIndexEntry) != 0 ||
+		pHeader->numEntries != (file.getSize() - sizeof(RomIndexHeader)) / sizeof(RomIndexEntry)) {
+		file.close();
+		return false;
+	}
+
+	pEntries = (const RomIndexEntry*)(file.getData() + sizeof(RomIndexHeader));
+	numEntries = pHeader->numEntries;
+	return true;
+}
+
+void RomIndex::close() {
+	file.close();
+	pEntries = NULL;
+	numEntries = 0;
+}
+
+const RomIndexEntry* RomIndex::find(UINT fileCrc) const {
+	UINT begin = 0;
+	UINT end = numEntries;
+	while (begin < end) {
+		UINT middle = begin + (end - begin) / 2;
+		if (pEntries[middle].fileCrc < fileCrc) {
+			begin = middle + 1;
+		} else {
+			end = middle;
+		}
+	}
+	return begin < numEntries && pEntries[begin].fileCrc == fileCrc ? &pEntries[begin] : NULL;
+}
+
+static bool byFileCrc(const RomIndexEntry& a, const RomIndexEntry& b) {
+	return a.fileCrc < b.fileCrc;
+}
+
+bool RomIndex::save(const char* pFileName, RomIndexEntry* pEntries, UINT numEntries) {
+	std::sort(pEntries, pEntries + numEntries, byFileCrc);
+
+	// The same file twice in the library is one entry. Two different
+	// files with the same CRC are as good as never going to happen.
+	UINT numUnique = 0;
+	for (UINT i = 0; i != numEntries; ++i) {
+		if (numUnique == 0 || pEntries[numUnique - 1].fileCrc != pEntries[i].fileCrc) {
+			pEntries[numUnique++] = pEntries[i];
+		}
+	}
+
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "wb") != 0) {
+		return false;
+	}
+	RomIndexHeader header;
+	memcpy(header.magic, indexMagic, sizeof(indexMagic));
+	header.version = ROM_INDEX_VERSION;
+	header.entrySize = sizeof(RomIndexEntry);
+	header.numEntries = numUnique;
+	bool ok = fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+			  fwrite(pEntries, sizeof(RomIndexEntry), numUnique, pFile) == numUnique;
+	return fclose(pFile) == 0 && ok;
+}
+
+void RomIndex::fromRomInfo(const RomInfo& info, RomIndexEntry& entry) {
+	entry.mapper = (WORD)info.mapper;
+	entry.submapper = info.submapper;
+	entry.consoleType = info.consoleType;
+	entry.region = (BYTE)info.region;
+	entry.flags = (info.verticalMirroring ? ROM_INDEX_VERTICAL : 0) |
+				  (info.fourScreen ? ROM_INDEX_FOUR_SCREEN : 0) |
+				  (info.battery ? ROM_INDEX_BATTERY : 0) |
+				  (info.nes2 ? ROM_INDEX_NES2 : 0);
+	memset(entry.pad, 0, sizeof(entry.pad));
+	memset(entry.reserved, 0, sizeof(entry.reserved));
+	entry.prgRomSize = info.prgRomSize;
+	entry.chrRomSize = info.chrRomSize;
+	entry.prgRamSize = info.prgRamSize;
+	entry.prgNvramSize = info.prgNvramSize;
+	entry.chrRamSize = info.chrRamSize;
+	entry.chrNvramSize = info.chrNvramSize;
+}
+
+bool RomIndex::apply(const RomIndexEntry& entry, UINT fileSize, RomInfo& info) {
+	// The trainer is part of the file layout and stays what the file says
+	unsigned long long end = (unsigned long long)info.prgRomOffset + entry.prgRomSize + entry.chrRomSize;
+	if (entry.prgRomSize == 0 || end > fileSize) {
+		return false;
+	}
+
+	info.mapper = entry.mapper;
+	info.submapper = entry.submapper;
+	info.consoleType = entry.consoleType;
+	info.region = (RomRegion)entry.region;
+	info.verticalMirroring = (entry.flags & ROM_INDEX_VERTICAL) != 0;
+	info.fourScreen = (entry.flags & ROM_INDEX_FOUR_SCREEN) != 0;
+	info.battery = (entry.flags & ROM_INDEX_BATTERY) != 0;
+	info.prgRomSize = entry.prgRomSize;
+	info.chrRomSize = entry.chrRomSize;
+	info.chrRomOffset = info.prgRomOffset + entry.prgRomSize;
+	info.prgRamSize = entry.prgRamSize;
+	info.prgNvramSize = entry.prgNvramSize;
+	info.chrRamSize = entry.chrRamSize;
+	info.chrNvramSize = entry.chrNvramSize;
+	return true;
+}
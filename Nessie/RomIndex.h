@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Types.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include "RomInfo.h"
+
+#define ROM_INDEX_VERSION	2
+
+// RomIndexEntry flags
+#define ROM_INDEX_VERTICAL		0x01
+#define ROM_INDEX_FOUR_SCREEN	0x02
+#define ROM_INDEX_BATTERY		0x04
+#define ROM_INDEX_NES2			0x08	// Taken from a NES 2.0 header
+
+// One ROM file of a library and what its cartridge is, 64 bytes
+struct RomIndexEntry {
+	UINT	fileCrc;			// CRC32 of the whole file, what the loader looks up
+	UINT	romCrc;				// CRC32 of PRG and CHR ROM
+	BYTE	romSha1[SHA1_SIZE];	// SHA-1 of PRG and CHR ROM
+
+	WORD	mapper;
+	BYTE	submapper;
+	BYTE	consoleType;
+	BYTE	region;
+	BYTE	flags;
+	BYTE	pad[2];
+
+	UINT	prgRomSize;
+	UINT	chrRomSize;
+	UINT	prgRamSize;
+	UINT	prgNvramSize;
+	UINT	chrRamSize;
+	UINT	chrNvramSize;
+
+	BYTE	reserved[4];		// Zero, keeps the entry at 64 bytes
+};
+
+static_assert(sizeof(RomIndexEntry) == 64, "RomIndexEntry is part of the index file format");
+
+struct RomIndexHeader {
+	BYTE	magic[4];			// "NRI" $1A
+	UINT	version;
+	UINT	entrySize;
+	UINT	numEntries;
+};
+
+/*	A header database for a ROM library: the index file is the header
+	followed by the entries sorted by file CRC, mapped read only and
+	searched in place. The loader already has the CRC of every file it
+	loads, so looking a file up costs a binary search and no hashing.
+
+	The entries are built from the library's own headers. Files holding
+	the same PRG and CHR ROM are the same cartridge, and all of them get
+	what the best header among them says (NES 2.0 over plain iNES over
+	iNES with junk in it), which fixes the bad headers of the others.
+	A file whose header says more ROM than it has is matched by all the
+	data after its header, and only gets an entry from a good copy. */
+class RomIndex {
+public:
+			RomIndex		( void );
+
+	bool	load		( const char* pFileName );
+	void	close		( void );
+
+	// The entry for a file with the given CRC, NULL if there is none
+	const RomIndexEntry*	find	( UINT fileCrc ) const;
+
+	UINT	getNumEntries	( void ) const	{ return numEntries; }
+
+	// Sorts the entries and writes them out, dropping repeated files
+	static bool	save		( const char* pFileName, RomIndexEntry* pEntries, UINT numEntries );
+
+	// Fills in the header part of an entry. The hashes are left alone.
+	static void	fromRomInfo	( const RomInfo& info, RomIndexEntry& entry );
+
+	// Overrides what the header of a file of the given size said with
+	// the entry. Fails and leaves info alone if the ROM sizes in the
+	// entry do not fit the file.
+	static bool	apply		( const RomIndexEntry& entry, UINT fileSize, RomInfo& info );
+
+private:
+	MappedFile				file;
+	const RomIndexEntry*	pEntries;
+	UINT					numEntries;
+};
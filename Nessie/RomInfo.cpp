@@ -0,0 +1,99 @@
+#include "RomInfo.h"
+#include <memory.h>
+
+// NES 2.0 ROM sizes: the low byte and an upper nibble count banks,
+// unless the nibble is $F and the byte is an exponent and multiplier
+// (EEEE EEMM, 2^E * (MM * 2 + 1) bytes)
+static unsigned long long nes2RomSize(BYTE low, BYTE high, UINT bankSize) {
+	if (high == 0x0F) {
+		UINT exponent = low >> 2;
+		if (exponent > 32) {
+			return ~0ULL;
+		}
+		return (1ULL << exponent) * ((low & 3) * 2 + 1);
+	}
+	return (unsigned long long)(low | (high << 8)) * bankSize;
+}
+
+// NES 2.0 RAM sizes are a shift count, 64 << n bytes or none for 0
+static UINT nes2RamSize(BYTE shift) {
+	return shift ? 64 << shift : 0;
+}
+
+bool parseRomHeader(const BYTE* p, UINT size, RomInfo& info) {
+	memset(&info, 0, sizeof(info));
+
+	if (size < INES_HEADER_SIZE || p[0] != 'N' || p[1] != 'E' || p[2] != 'S' || p[3] != 0x1A) {
+		info.pError = "not an iNES file";
+		return false;
+	}
+
+	info.verticalMirroring = (p[6] & 0x01) != 0;
+	info.battery = (p[6] & 0x02) != 0;
+	info.trainer = (p[6] & 0x04) != 0;
+	info.fourScreen = (p[6] & 0x08) != 0;
+	info.consoleType = p[7] & 0x03;
+	info.nes2 = (p[7] & 0x0C) == 0x08;
+
+	unsigned long long prgSize;
+	unsigned long long chrSize;
+	if (info.nes2) {
+		info.mapper = (p[6] >> 4) | (p[7] & 0xF0) | ((p[8] & 0x0F) << 8);
+		info.submapper = p[8] >> 4;
+		prgSize = nes2RomSize(p[4], p[9] & 0x0F, 0x4000);
+		chrSize = nes2RomSize(p[5], p[9] >> 4, 0x2000);
+		info.prgRamSize = nes2RamSize(p[10] & 0x0F);
+		info.prgNvramSize = nes2RamSize(p[10] >> 4);
+		info.chrRamSize = nes2RamSize(p[11] & 0x0F);
+		info.chrNvramSize = nes2RamSize(p[11] >> 4);
+		info.region = (RomRegion)(p[12] & 0x03);
+	} else {
+		// Tools used to sign their name in bytes 7-15, in which case byte
+		// 7 is no mapper number either
+		info.dirty = p[12] || p[13] || p[14] || p[15];
+		info.mapper = (p[6] >> 4) | (info.dirty ? 0 : (p[7] & 0xF0));
+		if (info.dirty) {
+			info.consoleType = 0;
+		}
+		prgSize = (unsigned long long)p[4] * 0x4000;
+		chrSize = (unsigned long long)p[5] * 0x2000;
+
+		// 0 meant 8 KB, which is what everything without a count had
+		UINT ram = (!info.dirty && p[8] ? p[8] : 1) * 0x2000;
+		if (info.battery) {
+			info.prgNvramSize = ram;
+		} else {
+			info.prgRamSize = ram;
+		}
+		info.chrRamSize = chrSize ? 0 : 0x2000;
+		info.region = !info.dirty && (p[9] & 0x01) ? REGION_PAL : REGION_NTSC;
+	}
+
+	unsigned long long offset = INES_HEADER_SIZE;
+	if (info.trainer) {
+		info.trainerOffset = (UINT)offset;
+		offset += INES_TRAINER_SIZE;
+	}
+	info.prgRomOffset = (UINT)offset;
+
+	if (prgSize == 0) {
+		info.pError = "no PRG ROM";
+		return false;
+	}
+	if (prgSize > size || chrSize > size) {
+		info.pError = "file is shorter than the header says";
+		return false;
+	}
+
+	offset += prgSize;
+	info.chrRomOffset = (UINT)offset;
+	offset += chrSize;
+	if (offset > size) {
+		info.pError = "file is shorter than the header says";
+		return false;
+	}
+
+	info.prgRomSize = (UINT)prgSize;
+	info.chrRomSize = (UINT)chrSize;
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Types.h"
+
+#define INES_HEADER_SIZE	16
+#define INES_TRAINER_SIZE	512
+
+// Timing the cartridge was made for
+enum RomRegion {
+	REGION_NTSC,
+	REGION_PAL,
+	REGION_MULTIPLE,	// Works on both
+	REGION_DENDY
+};
+
+/*	What the 16 byte iNES header of a ROM file says, in bytes rather
+	than in the header's units. NES 2.0 headers are recognized by bits
+	2-3 of byte 7 being 2 and fill in everything, plain iNES ones leave
+	the submapper and the NVRAM and CHR RAM sizes to guesses: battery
+	backed carts get their PRG RAM as NVRAM and carts without CHR ROM
+	get 8 KB of CHR RAM. */
+struct RomInfo {
+	bool		nes2;
+	bool		dirty;			// iNES header with junk in bytes 12-15
+	UINT		mapper;
+	BYTE		submapper;
+	BYTE		consoleType;	// 0 NES, 1 Vs. System, 2 PlayChoice-10, 3 extended
+	RomRegion	region;
+
+	bool		verticalMirroring;
+	bool		fourScreen;
+	bool		battery;
+	bool		trainer;
+
+	UINT		prgRomSize;
+	UINT		chrRomSize;
+	UINT		prgRamSize;		// Volatile
+	UINT		prgNvramSize;	// Battery backed
+	UINT		chrRamSize;
+	UINT		chrNvramSize;
+
+	// Where the parts are in the file
+	UINT		trainerOffset;
+	UINT		prgRomOffset;
+	UINT		chrRomOffset;
+
+	const char*	pError;			// Why parseRomHeader failed
+};
+
+// Fills in info from the start of a ROM file of the given size and
+// checks that the file holds everything the header says it does. When
+// only the ROM sizes are wrong the trainer and PRG ROM offsets are
+// still filled in, so the ROM index can supply the sizes.
+bool	parseRomHeader	( const BYTE* pData, UINT size, RomInfo& info );
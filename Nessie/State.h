@@ -0,0 +1,9 @@
+#pragma once
+
+#include <memory.h>
+
+// Helpers used by the components to copy their plain member variables
+// to and from a flat save state buffer. The pointer is advanced past
+// the value so consecutive calls pack the members back to back.
+#define STATE_WRITE(p, v)	{ memcpy((p), &(v), sizeof(v)); (p) += sizeof(v); }
+#define STATE_READ(p, v)	{ memcpy(&(v), (p), sizeof(v)); (p) += sizeof(v); }
@@ -0,0 +1,30 @@
+#include "Stats.h"
+#include <memory.h>
+
+void clearStats(EmulatorStats& s) {
+	memset(&s, 0, sizeof(s));
+}
+
+void addStats(EmulatorStats& s, const EmulatorStats& add) {
+	unsigned long long* p = (unsigned long long*)&s;
+	const unsigned long long* pAdd = (const unsigned long long*)&add;
+	for (UINT i = 0; i != STATS_NUM_FIELDS; ++i) {
+		p[i] += pAdd[i];
+	}
+}
+
+void subtractStats(EmulatorStats& s, const EmulatorStats& sub) {
+	unsigned long long* p = (unsigned long long*)&s;
+	const unsigned long long* pSub = (const unsigned long long*)&sub;
+	for (UINT i = 0; i != STATS_NUM_FIELDS; ++i) {
+		p[i] -= pSub[i];
+	}
+}
+
+void divideStats(EmulatorStats& s, const EmulatorStats& sum, UINT count) {
+	unsigned long long* p = (unsigned long long*)&s;
+	const unsigned long long* pSum = (const unsigned long long*)&sum;
+	for (UINT i = 0; i != STATS_NUM_FIELDS; ++i) {
+		p[i] = count ? pSum[i] / count : 0;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Types.h"
+#include "Timer.h"
+
+// Frames the rolling average in Emulator::getAverageStats spans
+#define STATS_WINDOW		60
+
+// Counters for the PPU registers $2000-$2007 and the APU and I/O
+// registers $4000-$401F, one slot per register
+#define STATS_NUM_IO		(8 + 0x20)
+#define STATS_IO_INDEX(a)	((a) < 0x4000 ? ((a) & 7) : 8 + ((a) & 0x1F))
+
+/*	Where the host time of a frame went, in rdtsc cycles, and how often
+	the interesting events happened. Every field is an unsigned long long
+	so frames can be summed and averaged field by field.
+
+	cpuCycles is what is left of the frame after the other emulation
+	parts are taken out. presentCycles is filled in by the frontend for
+	the frame it just showed. There is no mapper yet so mapperCycles
+	stays zero until one exists. */
+struct EmulatorStats {
+	unsigned long long	frameCycles;		// All of Emulator::runFrame
+	unsigned long long	cpuCycles;
+	unsigned long long	ioCycles;			// CPUMem register handlers
+	unsigned long long	renderCycles;		// PPU::renderScanline
+	unsigned long long	dmaCycles;			// OAM DMA
+	unsigned long long	apuCycles;			// Catching the APU up and mixing
+	unsigned long long	resampleCycles;		// APU samples to the audio ring rate
+	unsigned long long	mapperCycles;
+	unsigned long long	presentCycles;		// Frontend
+
+	unsigned long long	nmis;
+	unsigned long long	dmas;
+	unsigned long long	ioReads		[ STATS_NUM_IO ];
+	unsigned long long	ioWrites	[ STATS_NUM_IO ];
+};
+
+#define STATS_NUM_FIELDS	(sizeof(EmulatorStats) / sizeof(unsigned long long))
+
+void	clearStats		( EmulatorStats& s );
+void	addStats		( EmulatorStats& s, const EmulatorStats& add );
+void	subtractStats	( EmulatorStats& s, const EmulatorStats& sub );
+void	divideStats		( EmulatorStats& s, const EmulatorStats& sum, UINT count );
+
+/*	The instrumentation is compiled out unless NESSIE_INSTRUMENT is
+	defined, then none of the counters or rdtsc calls are left in the
+	emulation paths. Counter arguments are not evaluated when it is off,
+	so they may dereference pointers that are only set up when it is on.
+
+	STATS_SCOPE adds the cycles until the end of the enclosing block. */
+#ifdef NESSIE_INSTRUMENT
+
+class StatsScope {
+public:
+	StatsScope	( unsigned long long& c ) : counter(c)	{ start = readCycles(); }
+	~StatsScope	( void )								{ counter += readCycles() - start; }
+
+private:
+	unsigned long long&	counter;
+	unsigned long long	start;
+};
+
+#define STATS_SCOPE(counter)	StatsScope statsScope_(counter)
+#define STATS_COUNT(counter)	(++(counter))
+
+#else
+
+#define STATS_SCOPE(counter)
+#define STATS_COUNT(counter)
+
+#endif
@@ -0,0 +1,171 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads) {
+	if (numThreads <= 0) {
+		numThreads = getNumCores();
+	}
+
+	numWorkers = numThreads;
+	pWorkers = new Worker[numWorkers];
+	pTaskFunc = NULL;
+	pTaskContext = NULL;
+	remaining = 0;
+	quit = 0;
+	doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	for (int i = 0; i != numWorkers; ++i) {
+		Worker& w = pWorkers[i];
+		w.pPool = this;
+		w.index = i;
+		w.begin = w.end = 0;
+		w.thread = NULL;
+		w.wakeEvent = NULL;
+		InitializeCriticalSection(&w.lock);
+	}
+
+	// Worker 0 is the thread calling parallelFor
+	for (int i = 1; i != numWorkers; ++i) {
+		Worker& w = pWorkers[i];
+		w.wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		w.thread = CreateThread(NULL, 0, threadProc, &w, 0, NULL);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	InterlockedExchange(&quit, 1);
+	for (int i = 1; i != numWorkers; ++i) {
+		SetEvent(pWorkers[i].wakeEvent);
+	}
+	for (int i = 1; i != numWorkers; ++i) {
+		WaitForSingleObject(pWorkers[i].thread, INFINITE);
+		CloseHandle(pWorkers[i].thread);
+		CloseHandle(pWorkers[i].wakeEvent);
+	}
+	for (int i = 0; i != numWorkers; ++i) {
+		DeleteCriticalSection(&pWorkers[i].lock);
+	}
+	CloseHandle(doneEvent);
+	delete[] pWorkers;
+}
+
+int ThreadPool::getNumCores() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void ThreadPool::parallelFor(UINT count, TaskFunc pFunc, void* pContext) {
+	if (count == 0) {
+		return;
+	}
+
+	pTaskFunc = pFunc;
+	pTaskContext = pContext;
+	remaining = (LONG)count;
+
+	// Hand out equal slices, the stealing evens out the rest
+	UINT first = 0;
+	for (int i = 0; i != numWorkers; ++i) {
+		UINT last = (UINT)(((unsigned long long)count * (i + 1)) / numWorkers);
+		EnterCriticalSection(&pWorkers[i].lock);
+		pWorkers[i].begin = first;
+		pWorkers[i].end = last;
+		LeaveCriticalSection(&pWorkers[i].lock);
+		first = last;
+	}
+
+	for (int i = 1; i != numWorkers; ++i) {
+		SetEvent(pWorkers[i].wakeEvent);
+	}
+
+	work(&pWorkers[0]);
+
+	// Other workers may still be finishing the indices they took
+	WaitForSingleObject(doneEvent, INFINITE);
+}
+
+DWORD WINAPI ThreadPool::threadProc(LPVOID pParam) {
+	Worker* pWorker = (Worker*)pParam;
+	ThreadPool* pPool = pWorker->pPool;
+
+	for (;;) {
+		WaitForSingleObject(pWorker->wakeEvent, INFINITE);
+		if (pPool->quit) {
+			break;
+		}
+		pPool->work(pWorker);
+	}
+	return 0;
+}
+
+void ThreadPool::work(Worker* pWorker) {
+	for (;;) {
+		UINT index;
+		if (!takeIndex(pWorker, index)) {
+			if (!steal(pWorker)) {
+				// Nothing left to take, the rest is already running
+				return;
+			}
+			continue;
+		}
+
+		pTaskFunc(pTaskContext, index);
+
+		if (InterlockedDecrement(&remaining) == 0) {
+			SetEvent(doneEvent);
+		}
+	}
+}
+
+bool ThreadPool::takeIndex(Worker* pWorker, UINT& index) {
+	bool taken = false;
+	EnterCriticalSection(&pWorker->lock);
+	if (pWorker->begin < pWorker->end) {
+		index = pWorker->begin++;
+		taken = true;
+	}
+	LeaveCriticalSection(&pWorker->lock);
+	return taken;
+}
+
+bool ThreadPool::steal(Worker* pThief) {
+	for (;;) {
+		// Pick the victim with the most work left
+		Worker* pVictim = NULL;
+		UINT most = 0;
+		for (int i = 0; i != numWorkers; ++i) {
+			Worker* pWorker = &pWorkers[i];
+			if (pWorker == pThief) {
+				continue;
+			}
+			UINT left = pWorker->end - pWorker->begin;	// Racy, only a hint
+			if (pWorker->begin < pWorker->end && left > most) {
+				most = left;
+				pVictim = pWorker;
+			}
+		}
+		if (!pVictim) {
+			return false;
+		}
+
+		// Take the back half, or the last index if only one is left
+		UINT begin = 0, end = 0;
+		EnterCriticalSection(&pVictim->lock);
+		if (pVictim->begin < pVictim->end) {
+			UINT mid = pVictim->begin + (pVictim->end - pVictim->begin) / 2;
+			begin = mid;
+			end = pVictim->end;
+			pVictim->end = mid;
+		}
+		LeaveCriticalSection(&pVictim->lock);
+
+		if (begin < end) {
+			EnterCriticalSection(&pThief->lock);
+			pThief->begin = begin;
+			pThief->end = end;
+			LeaveCriticalSection(&pThief->lock);
+			return true;
+		}
+		// Someone else got there first, look again
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Types.h"
+
+/*	A fixed pool of worker threads, one per core by default, that runs
+	parallel loops over [0, count). Every worker starts out owning an
+	equal slice of the indices and takes them one at a time from the
+	front. A worker that runs dry steals the back half of the largest
+	remaining slice, so a worker stuck on a slow index never holds up
+	the indices queued behind it. The calling thread works as well. */
+class ThreadPool {
+public:
+	typedef void (*TaskFunc)( void* pContext, UINT index );
+
+			ThreadPool		( int numThreads = 0 );
+			~ThreadPool		( void );
+
+	// Runs pFunc for every index and returns once all of them are done
+	void	parallelFor		( UINT count, TaskFunc pFunc, void* pContext );
+
+	int		getNumThreads	( void )	{ return numWorkers; }
+
+	static int	getNumCores	( void );
+
+private:
+	struct Worker {
+		ThreadPool*			pPool;
+		int					index;
+		HANDLE				thread;
+		HANDLE				wakeEvent;
+
+		// The slice of indices this worker owns, guarded by lock
+		CRITICAL_SECTION	lock;
+		UINT				begin;
+		UINT				end;
+	};
+
+	static DWORD WINAPI	threadProc	( LPVOID pParam );
+
+	void	work			( Worker* pWorker );
+	bool	takeIndex		( Worker* pWorker, UINT& index );
+	bool	steal			( Worker* pThief );
+
+	Worker*		pWorkers;
+	int			numWorkers;
+
+	TaskFunc	pTaskFunc;
+	void*		pTaskContext;
+
+	volatile LONG	remaining;
+	volatile LONG	quit;
+	HANDLE			doneEvent;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <windows.h>
+#include <intrin.h>
+
+// High resolution host timer, in ticks of the performance counter
+inline LONGLONG readTimer() {
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+// CPU time stamp counter, for measuring short stretches of code
+inline unsigned long long readCycles() {
+	return __rdtsc();
+}
+
+inline LONGLONG queryTimerFrequency() {
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	return f.QuadPart;
+}
+
+// Read before main so threads converting at the same time never race
+// on it
+static const LONGLONG timerFrequency = queryTimerFrequency();
+
+inline LONGLONG timerToNs(LONGLONG ticks) {
+	return (LONGLONG)((double)ticks * 1000000000.0 / (double)timerFrequency);
+}
@@ -0,0 +1,120 @@
+#include "Tracer.h"
+#include <stdio.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+
+struct TraceEvent {
+	const char*	pName;
+	UINT		track;
+	LONGLONG	start;
+	LONGLONG	end;
+};
+
+// One per recording thread, only that thread ever writes to it
+struct TraceRing {
+	TraceRing*		pNext;
+	DWORD			threadId;
+	volatile LONG	writeIndex;		// Events ever written, the ring holds the last TRACE_RING_SIZE
+	TraceEvent		events[ TRACE_RING_SIZE ];
+};
+
+volatile bool traceEnabled = false;
+
+static TraceRing* volatile pRings = NULL;
+static DWORD ringTlsIndex = TLS_OUT_OF_INDEXES;
+
+void traceEnable(bool enable) {
+	// Set up before any worker can record
+	if (enable && ringTlsIndex == TLS_OUT_OF_INDEXES) {
+		ringTlsIndex = TlsAlloc();
+	}
+	traceEnabled = enable;
+}
+
+static TraceRing* getThreadRing() {
+	TraceRing* pRing = (TraceRing*)TlsGetValue(ringTlsIndex);
+	if (pRing) {
+		return pRing;
+	}
+
+	pRing = new TraceRing;
+	pRing->threadId = GetCurrentThreadId();
+	pRing->writeIndex = 0;
+
+	// Push onto the list of rings without a lock
+	TraceRing* pHead;
+	do {
+		pHead = pRings;
+		pRing->pNext = pHead;
+	} while (InterlockedCompareExchangePointer((void* volatile*)&pRings, pRing, pHead) != pHead);
+
+	TlsSetValue(ringTlsIndex, pRing);
+	return pRing;
+}
+
+void traceEvent(const char* pName, UINT track, LONGLONG start, LONGLONG end) {
+	if (!traceEnabled) {
+		return;
+	}
+
+	TraceRing* pRing = getThreadRing();
+	LONG index = pRing->writeIndex;
+	TraceEvent& e = pRing->events[index & (TRACE_RING_SIZE - 1)];
+	e.pName = pName;
+	e.track = track;
+	e.start = start;
+	e.end = end;
+
+	// Publish the event after it is written
+	MemoryBarrier();
+	pRing->writeIndex = index + 1;
+}
+
+void traceClear() {
+	for (TraceRing* pRing = pRings; pRing; pRing = pRing->pNext) {
+		pRing->writeIndex = 0;
+	}
+}
+
+static bool byStart(const TraceEvent& a, const TraceEvent& b) {
+	return a.start < b.start;
+}
+
+bool traceDump(const char* pFileName) {
+	std::vector<TraceEvent> events;
+	for (TraceRing* pRing = pRings; pRing; pRing = pRing->pNext) {
+		LONG end = pRing->writeIndex;
+		LONG begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+		for (LONG i = begin; i != end; ++i) {
+			events.push_back(pRing->events[i & (TRACE_RING_SIZE - 1)]);
+		}
+	}
+	std::sort(events.begin(), events.end(), byStart);
+
+	FILE* pFile;
+	if (fopen_s(&pFile, pFileName, "w") != 0 || !pFile) {
+		return false;
+	}
+
+	// Times are microseconds from the first event
+	LONGLONG origin = events.empty() ? 0 : events[0].start;
+	std::set<UINT> tracks;
+
+	fprintf(pFile, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i != events.size(); ++i) {
+		const TraceEvent& e = events[i];
+		fprintf(pFile, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+			e.pName, e.track, timerToNs(e.start - origin) / 1000.0, timerToNs(e.end - e.start) / 1000.0);
+		tracks.insert(e.track);
+	}
+
+	// Name the tracks after the instances
+	fprintf(pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Nessie\"}}");
+	for (std::set<UINT>::const_iterator it = tracks.begin(); it != tracks.end(); ++it) {
+		fprintf(pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"instance %u\"}}", *it, *it);
+	}
+	fprintf(pFile, "\n],\"displayTimeUnit\":\"ns\"}\n");
+	fclose(pFile);
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Types.h"
+#include "Timer.h"
+
+// Events each thread keeps before the oldest are overwritten
+#define TRACE_RING_SIZE		65536
+
+/*	Timeline tracer that writes Chrome trace JSON (chrome://tracing,
+	Perfetto). Events are complete events, a name, a start and an end in
+	host time, placed on a track. Every emulator instance has its own
+	track, set with Emulator::setTraceTrack.
+
+	Each thread records into its own ring buffer so recording never
+	takes a lock. The rings are created on a thread's first event and
+	linked into a global list with a compare-and-swap. traceDump reads
+	all of them and should be called while the emulation threads are
+	idle, e.g. between BatchRunner steps.
+
+	When tracing is disabled an event costs one test of a global flag. */
+extern volatile bool	traceEnabled;
+
+void	traceEnable		( bool enable );
+void	traceEvent		( const char* pName, UINT track, LONGLONG start, LONGLONG end );
+bool	traceDump		( const char* pFileName );
+void	traceClear		( void );
+
+// Traces the rest of the enclosing block. pName must be a string
+// literal or otherwise outlive the trace.
+class TraceScope {
+public:
+	TraceScope	( const char* pEventName, UINT eventTrack ) : pName(pEventName), track(eventTrack)	{ start = traceEnabled ? readTimer() : 0; }
+	~TraceScope	( void )	{ if (traceEnabled && start) { traceEvent(pName, track, start, readTimer()); } }
+
+private:
+	const char*	pName;
+	UINT		track;
+	LONGLONG	start;
+};
+
+#define TRACE_SCOPE(name, track)	TraceScope traceScope_(name, track)
@@ -0,0 +1,355 @@
+#include "WideCPU.h"
+#include <emmintrin.h>
+#include "CPU.h"
+#include "CPUMem.h"
+#include "Emulator.h"
+
+// Lane masks as a byte vector, 0xFF for the lanes in the mask
+static __m128i expandMask(int mask) {
+	__declspec(align(16)) BYTE bytes[WIDE_MAX_LANES];
+	for (int i = 0; i != WIDE_MAX_LANES; ++i) {
+		bytes[i] = (mask & (1 << i)) ? 0xFF : 0x00;
+	}
+	return _mm_loadu_si128((const __m128i*)bytes);
+}
+
+// Picks the new value for the lanes in the mask and keeps the old one elsewhere
+static inline __m128i select(__m128i mask, __m128i newValue, __m128i oldValue) {
+	return _mm_or_si128(_mm_and_si128(mask, newValue), _mm_andnot_si128(mask, oldValue));
+}
+
+// Same as SET_N_Z in CPU.cpp, for every lane
+static inline __m128i setNZ(__m128i f, __m128i value) {
+	__m128i z = _mm_and_si128(_mm_cmpeq_epi8(value, _mm_setzero_si128()), _mm_set1_epi8(FLAG_Z));
+	__m128i n = _mm_and_si128(value, _mm_set1_epi8((char)FLAG_N));
+	f = _mm_andnot_si128(_mm_set1_epi8((char)(FLAG_N | FLAG_Z)), f);
+	return _mm_or_si128(f, _mm_or_si128(n, z));
+}
+
+// Same as CPU::compare, C is set when reg >= m
+static inline __m128i compare(__m128i f, __m128i reg, BYTE m) {
+	__m128i value = _mm_set1_epi8((char)m);
+	f = setNZ(f, _mm_sub_epi8(reg, value));
+	__m128i noBorrow = _mm_cmpeq_epi8(_mm_subs_epu8(value, reg), _mm_setzero_si128());
+	__m128i c = _mm_and_si128(noBorrow, _mm_set1_epi8(FLAG_C));
+	return _mm_or_si128(_mm_andnot_si128(_mm_set1_epi8(FLAG_C), f), c);
+}
+
+WideCPU::WideCPU(Emulator** ppLanes, int num) {
+	numLanes = num > WIDE_MAX_LANES ? WIDE_MAX_LANES : num;
+	for (int i = 0; i != WIDE_MAX_LANES; ++i) {
+		apLanes[i] = i < numLanes ? ppLanes[i] : NULL;
+		apCpu[i] = i < numLanes ? ppLanes[i]->getCPU() : NULL;
+		apMem[i] = i < numLanes ? apCpu[i]->pMemory : NULL;
+		A[i] = X[i] = Y[i] = S[i] = F[i] = 0;
+		P[i] = 0;
+	}
+	wideCount = 0;
+	scalarCount = 0;
+}
+
+WideCPU::~WideCPU() {
+}
+
+void WideCPU::loadLane(int lane) {
+	CPU* pCpu = apCpu[lane];
+	A[lane] = pCpu->A;
+	X[lane] = pCpu->X;
+	Y[lane] = pCpu->Y;
+	S[lane] = pCpu->S;
+	F[lane] = pCpu->F;
+	P[lane] = pCpu->P;
+}
+
+void WideCPU::storeLane(int lane) {
+	CPU* pCpu = apCpu[lane];
+	pCpu->A = A[lane];
+	pCpu->X = X[lane];
+	pCpu->Y = Y[lane];
+	pCpu->S = S[lane];
+	pCpu->F = F[lane];
+	pCpu->P = P[lane];
+}
+
+void WideCPU::runFrame() {
+	int activeMask = 0;
+	for (int i = 0; i != numLanes; ++i) {
+		apLanes[i]->beginFrame();
+		loadLane(i);
+		activeMask |= 1 << i;
+	}
+
+	while (activeMask) {
+		step(activeMask);
+
+		// Lanes park once they reach vblank
+		for (int i = 0; i != numLanes; ++i) {
+			if ((activeMask & (1 << i)) && apLanes[i]->isFrameComplete()) {
+				activeMask &= ~(1 << i);
+			}
+		}
+	}
+
+	for (int i = 0; i != numLanes; ++i) {
+		storeLane(i);
+	}
+}
+
+void WideCPU::runInstruction() {
+	int activeMask = 0;
+	for (int i = 0; i != numLanes; ++i) {
+		loadLane(i);
+		activeMask |= 1 << i;
+	}
+
+	step(activeMask);
+
+	for (int i = 0; i != numLanes; ++i) {
+		storeLane(i);
+	}
+}
+
+void WideCPU::step(int activeMask) {
+	int pending = activeMask;
+	while (pending) {
+		// Group every pending lane that sits on the same PC as the first one
+		int lead = 0;
+		while (!(pending & (1 << lead))) {
+			++lead;
+		}
+		WORD pc = P[lead];
+		int group = 0;
+		for (int i = lead; i != numLanes; ++i) {
+			if ((pending & (1 << i)) && P[i] == pc) {
+				group |= 1 << i;
+			}
+		}
+		pending &= ~group;
+
+		// Code in RAM may differ between lanes, only ROM is shared
+		if (pc >= 0x8000 && executeWide(pc, group)) {
+			continue;
+		}
+
+		for (int i = lead; i != numLanes; ++i) {
+			if (group & (1 << i)) {
+				runScalar(i);
+			}
+		}
+	}
+}
+
+void WideCPU::runScalar(int lane) {
+	storeLane(lane);
+	apCpu[lane]->run();
+	loadLane(lane);
+	++scalarCount;
+}
+
+bool WideCPU::executeWide(WORD pc, int mask) {
+	CPUMem* pMem = apMem[0];
+	BYTE opCode = pMem->peek(pc);
+	BYTE operand = pMem->peek(pc + 1);
+
+	__m128i m = expandMask(mask);
+	__m128i a = _mm_loadu_si128((const __m128i*)A);
+	__m128i x = _mm_loadu_si128((const __m128i*)X);
+	__m128i y = _mm_loadu_si128((const __m128i*)Y);
+	__m128i s = _mm_loadu_si128((const __m128i*)S);
+	__m128i f = _mm_loadu_si128((const __m128i*)F);
+	__m128i one = _mm_set1_epi8(1);
+
+	__m128i newA = a, newX = x, newY = y, newS = s, newF = f;
+	int length = 1;
+	int cycles = 2;
+
+	// Branches and zero page accesses are resolved per lane
+	BYTE branchFlag = 0;
+	bool branchIfSet = false;
+	BYTE* pZeroPageReg = NULL;
+	BYTE* pStoreReg = NULL;
+
+	// Only opcodes the scalar CPU implements, with the same cycle counts
+	switch (opCode) {
+	case 0xA9: // LDA #
+		newA = _mm_set1_epi8((char)operand);
+		newF = setNZ(f, newA);
+		length = 2;
+		break;
+	case 0xA2: // LDX #
+		newX = _mm_set1_epi8((char)operand);
+		newF = setNZ(f, newX);
+		length = 2;
+		break;
+	case 0xA0: // LDY #
+		newY = _mm_set1_epi8((char)operand);
+		newF = setNZ(f, newY);
+		length = 2;
+		break;
+	case 0x29: // AND #
+		newA = _mm_and_si128(a, _mm_set1_epi8((char)operand));
+		newF = setNZ(f, newA);
+		length = 2;
+		break;
+	case 0x49: // EOR #
+		newA = _mm_xor_si128(a, _mm_set1_epi8((char)operand));
+		newF = setNZ(f, newA);
+		length = 2;
+		break;
+	case 0xC9: // CMP #
+		newF = compare(f, a, operand);
+		length = 2;
+		break;
+	case 0xE0: // CPX #
+		newF = compare(f, x, operand);
+		length = 2;
+		break;
+	case 0xAA: // TAX
+		newX = a;
+		newF = setNZ(f, newX);
+		break;
+	case 0xA8: // TAY
+		newY = a;
+		newF = setNZ(f, newY);
+		break;
+	case 0x8A: // TXA
+		newA = x;
+		newF = setNZ(f, newA);
+		break;
+	case 0x9A: // TXS
+		newS = x;
+		break;
+	case 0xE8: // INX
+		newX = _mm_add_epi8(x, one);
+		newF = setNZ(f, newX);
+		break;
+	case 0xC8: // INY
+		newY = _mm_add_epi8(y, one);
+		newF = setNZ(f, newY);
+		break;
+	case 0xCA: // DEX
+		newX = _mm_sub_epi8(x, one);
+		newF = setNZ(f, newX);
+		break;
+	case 0x88: // DEY
+		newY = _mm_sub_epi8(y, one);
+		newF = setNZ(f, newY);
+		break;
+	case 0x4A: // LSR A
+		{
+			__m128i c = _mm_and_si128(a, one);
+			newA = _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F));
+			newF = _mm_or_si128(_mm_andnot_si128(_mm_set1_epi8(FLAG_C), setNZ(f, newA)), c);
+		}
+		break;
+	case 0x18: // CLC
+		newF = _mm_andnot_si128(_mm_set1_epi8(FLAG_C), f);
+		break;
+	case 0xD8: // CLD
+		newF = _mm_andnot_si128(_mm_set1_epi8(FLAG_D), f);
+		break;
+	case 0x58: // CLI
+		newF = _mm_andnot_si128(_mm_set1_epi8(FLAG_I), f);
+		break;
+	case 0xB8: // CLV
+		newF = _mm_andnot_si128(_mm_set1_epi8(FLAG_V), f);
+		break;
+	case 0x78: // SEI
+		newF = _mm_or_si128(f, _mm_set1_epi8(FLAG_I));
+		break;
+
+		//
+		// Zero page loads and stores, plain RAM in every lane
+		//
+	case 0xA5: pZeroPageReg = A; break;
+	case 0xA6: pZeroPageReg = X; break;
+	case 0xA4: pZeroPageReg = Y; break;
+	case 0x85: pStoreReg = A; break;
+	case 0x86: pStoreReg = X; break;
+	case 0x84: pStoreReg = Y; break;
+
+		//
+		// Branches
+		//
+	case 0x10: branchFlag = FLAG_N; branchIfSet = false; break;
+	case 0x30: branchFlag = FLAG_N; branchIfSet = true;  break;
+	case 0x50: branchFlag = FLAG_V; branchIfSet = false; break;
+	case 0x70: branchFlag = FLAG_V; branchIfSet = true;  break;
+	case 0x90: branchFlag = FLAG_C; branchIfSet = false; break;
+	case 0xB0: branchFlag = FLAG_C; branchIfSet = true;  break;
+	case 0xD0: branchFlag = FLAG_Z; branchIfSet = false; break;
+	case 0xF0: branchFlag = FLAG_Z; branchIfSet = true;  break;
+
+	default:
+		return false;
+	}
+
+	if (pZeroPageReg || pStoreReg) {
+		length = 2;
+		cycles = 3;
+		for (int i = 0; i != numLanes; ++i) {
+			if (!(mask & (1 << i))) {
+				continue;
+			}
+			if (pZeroPageReg) {
+				pZeroPageReg[i] = apMem[i]->peek(operand);
+				F[i] = (F[i] & ~(FLAG_N | FLAG_Z)) | (pZeroPageReg[i] & FLAG_N) | (pZeroPageReg[i] ? 0 : FLAG_Z);
+			} else {
+				apMem[i]->write(operand, pStoreReg[i]);
+			}
+		}
+		finishWide(pc, mask, length, cycles);
+		return true;
+	}
+
+	if (branchFlag) {
+		WORD next = pc + 2;
+		WORD target = (operand & 0x80) ? next - (0x100 - operand) : next + operand;
+		int takenCycles = 2 + (((next & 0xFF00) != (target & 0xFF00)) ? 2 : 1);
+		int notTakenCycles = 2;
+
+		for (int i = 0; i != numLanes; ++i) {
+			if (!(mask & (1 << i))) {
+				continue;
+			}
+			bool taken = ((F[i] & branchFlag) != 0) == branchIfSet;
+			P[i] = taken ? target : next;
+			consumeCycles(i, taken ? takenCycles : notTakenCycles);
+		}
+		return true;
+	}
+
+	_mm_storeu_si128((__m128i*)A, select(m, newA, a));
+	_mm_storeu_si128((__m128i*)X, select(m, newX, x));
+	_mm_storeu_si128((__m128i*)Y, select(m, newY, y));
+	_mm_storeu_si128((__m128i*)S, select(m, newS, s));
+	_mm_storeu_si128((__m128i*)F, select(m, newF, f));
+
+	finishWide(pc, mask, length, cycles);
+	return true;
+}
+
+void WideCPU::finishWide(WORD pc, int mask, int length, int cycles) {
+	for (int i = 0; i != numLanes; ++i) {
+		if (mask & (1 << i)) {
+			P[i] = pc + length;
+			consumeCycles(i, cycles);
+		}
+	}
+}
+
+void WideCPU::consumeCycles(int lane, int cycles) {
+	// Scanline ends can render and take the NMI, which needs the
+	// registers back in the CPU.
+	CPU* pCpu = apCpu[lane];
+	++pCpu->instructionCount;
+	if (pCpu->cyclesLeftOnScanline - cycles >= 0) {
+		pCpu->cyclesLeftOnScanline -= cycles;
+		pCpu->totalCycles += cycles;
+	} else {
+		storeLane(lane);
+		pCpu->tick(cycles);
+		loadLane(lane);
+	}
+	++wideCount;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Types.h"
+
+class Emulator;
+class CPU;
+class CPUMem;
+
+#define WIDE_MAX_LANES	16
+
+/*	Lockstep interpreter for many instances running the same ROM. The
+	registers of all lanes live here structure of arrays style, one
+	SSE2 register holds the A (or X, Y, S, F) of all 16 lanes. Every
+	step the lanes are grouped by program counter and a group sitting
+	on a register-only or immediate instruction in ROM executes it for
+	all of its lanes at once, under a lane mask. Anything touching the
+	bus or the program counter falls back to the scalar CPU::run for
+	each lane, and lanes that meet at the same PC again run together.
+
+	The results per lane are identical to running the lanes on their
+	own, nessie-bench wide checks this against the scalar CPU. */
+class WideCPU {
+public:
+			WideCPU		( Emulator** ppLanes, int numLanes );
+			~WideCPU	( void );
+
+	// Runs every lane until it has finished a frame
+	void	runFrame	( void );
+
+	// Runs a single instruction on every lane, for tracing
+	void	runInstruction	( void );
+
+	// How many lane-instructions took the wide and the scalar path
+	unsigned long long	getWideCount	( void )	{ return wideCount; }
+	unsigned long long	getScalarCount	( void )	{ return scalarCount; }
+
+private:
+	void	step			( int activeMask );
+	bool	executeWide		( WORD pc, int mask );
+	void	runScalar		( int lane );
+	void	finishWide		( WORD pc, int mask, int length, int cycles );
+	void	consumeCycles	( int lane, int cycles );
+
+	// Moves a lane's registers between the SoA arrays and its CPU
+	void	loadLane		( int lane );
+	void	storeLane		( int lane );
+
+	Emulator*	apLanes	[ WIDE_MAX_LANES ];
+	CPU*		apCpu	[ WIDE_MAX_LANES ];
+	CPUMem*		apMem	[ WIDE_MAX_LANES ];
+	int			numLanes;
+
+	__declspec(align(16)) BYTE	A	[ WIDE_MAX_LANES ];
+	__declspec(align(16)) BYTE	X	[ WIDE_MAX_LANES ];
+	__declspec(align(16)) BYTE	Y	[ WIDE_MAX_LANES ];
+	__declspec(align(16)) BYTE	S	[ WIDE_MAX_LANES ];
+	__declspec(align(16)) BYTE	F	[ WIDE_MAX_LANES ];
+	WORD						P	[ WIDE_MAX_LANES ];
+
+	unsigned long long	wideCount;
+	unsigned long long	scalarCount;
+};
@@ -0,0 +1,164 @@
+#include "ZipArchive.h"
+#include "Inflate.h"
+#include "Hash.h"
+#include <string.h>
+#include <ctype.h>
+#include <memory.h>
+
+#define ZIP_END_SIGNATURE		0x06054B50
+#define ZIP_CENTRAL_SIGNATURE	0x02014B50
+#define ZIP_LOCAL_SIGNATURE		0x04034B50
+
+#define ZIP_END_SIZE			22
+#define ZIP_CENTRAL_SIZE		46
+#define ZIP_LOCAL_SIZE			30
+#define ZIP_MAX_COMMENT			0xFFFF
+
+#define ZIP_FLAG_ENCRYPTED		0x0001
+
+static inline UINT read16(const BYTE* p) {
+	return p[0] | (p[1] << 8);
+}
+
+static inline UINT read32(const BYTE* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT)p[3] << 24);
+}
+
+// Paths in archives always use forward slashes, paths given to the
+// loader may not
+static bool namesMatch(const char* pA, const char* pB) {
+	for (; *pA && *pB; ++pA, ++pB) {
+		char a = *pA == '\\' ? '/' : *pA;
+		char b = *pB == '\\' ? '/' : *pB;
+		if (tolower((BYTE)a) != tolower((BYTE)b)) {
+			return false;
+		}
+	}
+	return *pA == *pB;
+}
+
+ZipArchive::ZipArchive() {
+	pDirectory = NULL;
+	directorySize = 0;
+	numEntries = 0;
+}
+
+bool ZipArchive::open(const char* pFileName) {
+	close();
+	if (!file.open(pFileName) || file.getSize() < ZIP_END_SIZE) {
+		close();
+		return false;
+	}
+
+	// The end record is last, followed only by the archive comment
+	const BYTE* pData = file.getData();
+	UINT size = file.getSize();
+	UINT lowest = size - ZIP_END_SIZE > ZIP_MAX_COMMENT ? size - ZIP_END_SIZE - ZIP_MAX_COMMENT : 0;
+	const BYTE* pEnd = NULL;
+	for (UINT offset = size - ZIP_END_SIZE + 1; offset-- > lowest; ) {
+		if (read32(pData + offset) == ZIP_END_SIGNATURE) {
+			pEnd = pData + offset;
+			break;
+		}
+	}
+	if (!pEnd) {
+		close();
+		return false;
+	}
+
+	numEntries = read16(pEnd + 10);
+	directorySize = read32(pEnd + 12);
+	UINT directoryOffset = read32(pEnd + 16);
+	if (directoryOffset > size || directorySize > size - directoryOffset) {
+		close();
+		return false;
+	}
+	pDirectory = pData + directoryOffset;
+	return true;
+}
+
+void ZipArchive::close() {
+	file.close();
+	pDirectory = NULL;
+	directorySize = 0;
+	numEntries = 0;
+}
+
+bool ZipArchive::findEntry(const char* pName, ZipEntry& entry) {
+	return find(pName, NULL, entry);
+}
+
+bool ZipArchive::findFirst(const char* pExtension, ZipEntry& entry) {
+	return find(NULL, pExtension, entry);
+}
+
+bool ZipArchive::find(const char* pName, const char* pExtension, ZipEntry& entry) {
+	UINT extensionLength = pExtension ? (UINT)strlen(pExtension) : 0;
+	const BYTE* p = pDirectory;
+	const BYTE* pEnd = pDirectory + directorySize;
+
+	for (UINT i = 0; i != numEntries; ++i) {
+		if (pEnd - p < ZIP_CENTRAL_SIZE || read32(p) != ZIP_CENTRAL_SIGNATURE) {
+			return false;
+		}
+		UINT nameLength = read16(p + 28);
+		UINT recordSize = ZIP_CENTRAL_SIZE + nameLength + read16(p + 30) + read16(p + 32);
+		if ((UINT)(pEnd - p) < recordSize) {
+			return false;
+		}
+
+		// Longer names than fit are no ROM anyone asks for
+		if (nameLength < ZIP_MAX_NAME) {
+			memcpy(entry.name, p + ZIP_CENTRAL_SIZE, nameLength);
+			entry.name[nameLength] = 0;
+
+			bool match = pName ? namesMatch(entry.name, pName) :
+				nameLength > extensionLength && _stricmp(entry.name + nameLength - extensionLength, pExtension) == 0;
+			if (match) {
+				entry.flags = read16(p + 8);
+				entry.method = read16(p + 10);
+				entry.crc = read32(p + 16);
+				entry.compressedSize = read32(p + 20);
+				entry.size = read32(p + 24);
+				entry.localHeaderOffset = read32(p + 42);
+				return true;
+			}
+		}
+		p += recordSize;
+	}
+	return false;
+}
+
+bool ZipArchive::extract(const ZipEntry& entry, BYTE* pOut) {
+	if (entry.flags & ZIP_FLAG_ENCRYPTED) {
+		return false;
+	}
+
+	// The local header repeats the name and has its own extra field,
+	// the data follows it
+	const BYTE* pData = file.getData();
+	UINT size = file.getSize();
+	UINT offset = entry.localHeaderOffset;
+	if (offset > size || size - offset < ZIP_LOCAL_SIZE || read32(pData + offset) != ZIP_LOCAL_SIGNATURE) {
+		return false;
+	}
+	offset += ZIP_LOCAL_SIZE + read16(pData + offset + 26) + read16(pData + offset + 28);
+	if (offset > size || size - offset < entry.compressedSize) {
+		return false;
+	}
+
+	const BYTE* pIn = pData + offset;
+	if (entry.method == ZIP_STORED) {
+		if (entry.compressedSize != entry.size) {
+			return false;
+		}
+		memcpy(pOut, pIn, entry.size);
+	} else if (entry.method == ZIP_DEFLATED) {
+		if (!inflate(pIn, entry.compressedSize, pOut, entry.size)) {
+			return false;
+		}
+	} else {
+		return false;
+	}
+	return crc32(pOut, entry.size) == entry.crc;
+}
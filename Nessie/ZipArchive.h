@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Types.h"
+#include "MappedFile.h"
+
+#define ZIP_MAX_NAME	260
+
+#define ZIP_STORED		0
+#define ZIP_DEFLATED	8
+
+// What the central directory says about one file in an archive
+struct ZipEntry {
+	char	name[ZIP_MAX_NAME];
+	UINT	method;
+	UINT	flags;
+	UINT	crc;				// CRC32 of the uncompressed file
+	UINT	compressedSize;
+	UINT	size;
+	UINT	localHeaderOffset;
+};
+
+/*	A zip archive mapped read only. Opening it only finds the central
+	directory; extracting an entry inflates it from the mapping straight
+	into the caller's buffer. Zip64 archives are not supported, no ROM
+	needs one. */
+class ZipArchive {
+public:
+			ZipArchive		( void );
+
+	bool	open			( const char* pFileName );
+	void	close			( void );
+
+	// The entry with the given path in the archive, ignoring case and
+	// which way the slashes go
+	bool	findEntry		( const char* pName, ZipEntry& entry );
+
+	// The first entry whose name ends in pExtension, ignoring case
+	bool	findFirst		( const char* pExtension, ZipEntry& entry );
+
+	// pOut takes entry.size bytes. Fails on any stream that does not come
+	// out to exactly that size or whose CRC does not match the directory.
+	// Checking the CRC costs one more pass over the output, a small part
+	// of inflating it, and the entry's CRC can then stand for the file's.
+	bool	extract			( const ZipEntry& entry, BYTE* pOut );
+
+private:
+	// Walks the directory for the first entry with the name or the
+	// extension, whichever is given
+	bool	find			( const char* pName, const char* pExtension, ZipEntry& entry );
+
+	MappedFile	file;
+	const BYTE*	pDirectory;
+	UINT		directorySize;
+	UINT		numEntries;
+};
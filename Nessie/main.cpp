@@ -1,39 +1,282 @@
 #include "SDL.h" 
 #include "Emulator.h"
+#include "Movie.h"
 #include "Types.h"
+#include "NES.h"
+#include "Palette.h"
+#include "Tracer.h"
+#include "Timer.h"
+#include "APU.h"
+#include "AudioRing.h"
+#include "AVRecorder.h"
+#include <stdio.h>
+#include <string.h>
 
-const int SCREEN_WIDTH = 256;
-const int SCREEN_HEIGHT = 240;
 const int SCREEN_BPP = 32;
 
 
 SDL_Surface* screen;
 
+// The APU keeps the ring half full, about 45 ms of samples
+#define AUDIO_RING_SIZE		4096
+
+// Host time of one emulated frame, about 16.5 ms
+#define FRAME_NS			(1000000000.0 * NUM_CYCLES_PER_SCANLINE * (NUM_SCANLINES_SCREEN + NUM_SCANLINES_VBLANK) / CPU_FREQUENCY)
+
+// Runs on SDL's audio thread, the only reader of the ring. When the
+// ring runs dry the rest is filled with the last sample so it does not
+// click.
+void audioCallback(void* pUser, Uint8* pStream, int length) {
+	static short lastSample = 0;
+	AudioRing* pRing = (AudioRing*)pUser;
+	short* pOut = (short*)pStream;
+	UINT count = length / sizeof(short);
+
+	UINT read = pRing->read(pOut, count);
+	if (read) {
+		lastSample = pOut[read - 1];
+	}
+	for (UINT i = read; i < count; ++i) {
+		pOut[i] = lastSample;
+	}
+}
+
+// <rom>.sav next to the ROM, or next to the archive for a ROM in a zip
+// file. Returns false if the path does not fit.
+bool makeSavePath(const char* pRomFile, char* pOut, size_t outSize) {
+	size_t end = strlen(pRomFile);
+	for (size_t i = 0; pRomFile[i]; ++i) {
+		if (_strnicmp(pRomFile + i, ".zip", 4) == 0 && (pRomFile[i + 4] == 0 || pRomFile[i + 4] == '\\' || pRomFile[i + 4] == '/')) {
+			end = i;
+			break;
+		}
+		if (pRomFile[i] == '.') {
+			end = i;
+		} else if (pRomFile[i] == '\\' || pRomFile[i] == '/') {
+			end = strlen(pRomFile);
+		}
+	}
+	if (end + 5 > outSize) {
+		return false;
+	}
+	memcpy(pOut, pRomFile, end);
+	strcpy_s(pOut + end, outSize - end, ".sav");
+	return true;
+}
+
+// Reads the keyboard into a controller button mask
+BYTE readKeyboard() {
+	Uint8* keys = SDL_GetKeyState(NULL);
+	BYTE buttons = 0;
+	if (keys[SDLK_z])		buttons |= BUTTON_A;
+	if (keys[SDLK_x])		buttons |= BUTTON_B;
+	if (keys[SDLK_RSHIFT])	buttons |= BUTTON_SELECT;
+	if (keys[SDLK_RETURN])	buttons |= BUTTON_START;
+	if (keys[SDLK_UP])		buttons |= BUTTON_UP;
+	if (keys[SDLK_DOWN])	buttons |= BUTTON_DOWN;
+	if (keys[SDLK_LEFT])	buttons |= BUTTON_LEFT;
+	if (keys[SDLK_RIGHT])	buttons |= BUTTON_RIGHT;
+	return buttons;
+}
+
+// Converts the emulator's palette indices to the screen surface
+void present(Emulator& emu) {
+	STATS_SCOPE(emu.getCurrentStats().presentCycles);
+	TRACE_SCOPE("present", emu.getTraceTrack());
+
+	SDL_LockSurface(screen);
+	const BYTE* pIn = emu.getFrameBuffer();
+	for (int y = 0; y != SCREEN_HEIGHT; ++y) {
+		unsigned int* pOut = (unsigned int*)((BYTE*)screen->pixels + y * screen->pitch);
+		for (int x = 0; x != SCREEN_WIDTH; ++x) {
+			*pOut++ = NESPalette[*pIn++ & 0x3F];
+		}
+	}
+	SDL_UnlockSurface(screen);
+	SDL_Flip(screen);
+}
+
 int main( int argc, char* args[] ) 
 { 
 	screen = NULL;
 
+	// nessie [rom] [options], the ROM defaults to nestest.nes. -record
+	// <file> records the session input, -play <file> replays it as fast
+	// as the emulator can run. -trace <file> writes a Chrome trace of the
+	// last frames on exit. -dump <base> writes the session to <base>.y4m
+	// and <base>.wav. -index <file> takes the cartridge from a ROM
+	// library index when the ROM is in it. Battery backed games save to
+	// <rom>.sav or to -sav <file>, except while a movie is recorded or
+	// played.
+	const char* pRomFile = "nestest.nes";
+	const char* pRecordFile = NULL;
+	const char* pPlayFile = NULL;
+	const char* pTraceFile = NULL;
+	const char* pDumpBase = NULL;
+	const char* pIndexFile = NULL;
+	const char* pSaveFile = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(args[i], "-record") == 0 && i + 1 < argc) {
+			pRecordFile = args[++i];
+		} else if (strcmp(args[i], "-play") == 0 && i + 1 < argc) {
+			pPlayFile = args[++i];
+		} else if (strcmp(args[i], "-trace") == 0 && i + 1 < argc) {
+			pTraceFile = args[++i];
+		} else if (strcmp(args[i], "-dump") == 0 && i + 1 < argc) {
+			pDumpBase = args[++i];
+		} else if (strcmp(args[i], "-index") == 0 && i + 1 < argc) {
+			pIndexFile = args[++i];
+		} else if (strcmp(args[i], "-sav") == 0 && i + 1 < argc) {
+			pSaveFile = args[++i];
+		} else if (args[i][0] != '-') {
+			pRomFile = args[i];
+		}
+	}
+	traceEnable(pTraceFile != NULL);
+
+	RomIndex romIndex;
+	if (pIndexFile) {
+		if (romIndex.load(pIndexFile)) {
+			CartridgeImage::setIndex(&romIndex);
+		} else {
+			fprintf(stderr, "could not read the ROM index %s\n", pIndexFile);
+		}
+	}
+
 	//Start SDL 
 	SDL_Init( SDL_INIT_EVERYTHING ); 
 	
 	// Setup the screen
-	screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_SWSURFACE);
+	screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, SDL_SWSURFACE);
 	
 	Emulator emu;
-	emu.loadFromFile("superkuken");
+	if (!emu.loadFromFile(pRomFile)) {
+		fprintf(stderr, "could not load %s: %s\n", pRomFile, emu.getLoadError());
+		SDL_Quit();
+		return 1;
+	}
 
-	while(true) {
-		emu.run();
+	// Movies start from power on with cleared RAM and the emulator
+	// will not run one with a battery save open, so none is opened
+	char savePath[MAX_PATH];
+	if (emu.getRomInfo().battery && !pPlayFile && !pRecordFile) {
+		if (!pSaveFile && makeSavePath(pRomFile, savePath, sizeof(savePath))) {
+			pSaveFile = savePath;
+		}
+		if (pSaveFile && !emu.openBatterySave(pSaveFile)) {
+			fprintf(stderr, "could not open the battery save %s, the game will not be saved\n", pSaveFile);
+		}
+	}
 
+	AudioRing audioRing(AUDIO_RING_SIZE);
 
-//			SDL_Flip(screen);
+	// The device may not run at the APU's rate, the APU resamples to
+	// whatever it got
+	SDL_AudioSpec audioSpec;
+	SDL_AudioSpec obtainedSpec;
+	memset(&audioSpec, 0, sizeof(audioSpec));
+	audioSpec.freq = APU_SAMPLE_RATE;
+	audioSpec.format = AUDIO_S16SYS;
+	audioSpec.channels = 1;
+	audioSpec.samples = 1024;
+	audioSpec.callback = audioCallback;
+	audioSpec.userdata = &audioRing;
+	bool audio = SDL_OpenAudio(&audioSpec, &obtainedSpec) == 0;
+	if (audio) {
+		emu.setAudioRing(&audioRing, obtainedSpec.freq);
+		SDL_PauseAudio(0);
+	}
+
+	// Nothing is dropped from a dump, a slow disk slows the game down
+	AVRecorder recorder;
+	if (pDumpBase && recorder.open(pDumpBase, AV_FORMAT_Y4M_WAV, AV_BLOCK, 16, APU_SAMPLE_RATE)) {
+		emu.setAVRecorder(&recorder);
+	}
+
+	Movie movie;
+	if (pPlayFile) {
+		if (!movie.load(pPlayFile) || !emu.startPlayback(&movie)) {
+			pPlayFile = NULL;
+		}
+	} else if (pRecordFile) {
+		emu.startRecording(&movie, false);
+	}
+
+	LONGLONG paceStart = readTimer();
+	unsigned long long pacedFrames = 0;
+
+	bool running = true;
+	while(running) {
+		emu.runFrame();
+		present(emu);
+
+		// The host timer sets the pace at the NES frame rate. The audio
+		// device runs on its own clock and the APU's resampler follows
+		// it through the ring fill. Replays run flat out.
+		if (!pPlayFile) {
+			LONGLONG due = (LONGLONG)(++pacedFrames * FRAME_NS);
+			LONGLONG now = timerToNs(readTimer() - paceStart);
+			while (now < due) {
+				if (due - now > 2000000) {
+					SDL_Delay(1);
+				}
+				now = timerToNs(readTimer() - paceStart);
+			}
+
+			// After a stall start over instead of rushing to catch up
+			if (now - due > 4 * FRAME_NS) {
+				paceStart = readTimer();
+				pacedFrames = 0;
+			}
+		}
+
+#ifdef NESSIE_INSTRUMENT
+		// Where the host time goes, averaged over the last second
+		if (emu.getFrameCount() % STATS_WINDOW == 0) {
+			const EmulatorStats& s = emu.getAverageStats();
+			char caption[256];
+			sprintf_s(caption, 256, "kcycles/frame: cpu %llu io %llu ppu %llu dma %llu apu %llu resample %llu present %llu, nmi %llu dma %llu",
+				s.cpuCycles / 1000, s.ioCycles / 1000, s.renderCycles / 1000, s.dmaCycles / 1000,
+				s.apuCycles / 1000, s.resampleCycles / 1000, s.presentCycles / 1000, s.nmis, s.dmas);
+			SDL_WM_SetCaption(caption, NULL);
+		}
+#endif
+
+		SDL_Event event;
+		while (SDL_PollEvent(&event)) {
+			if (event.type == SDL_QUIT) {
+				running = false;
+			}
+		}
+
+		emu.setControllerState(0, readKeyboard());
+
+		// Replays end with the movie
+		if (pPlayFile && !emu.isPlaying()) {
+			running = false;
+		}
 
 		SDL_Delay(0);
 	}
-	
+
+	if (pRecordFile && !pPlayFile) {
+		emu.stopRecording();
+		movie.save(pRecordFile);
+	}
+
+	if (pTraceFile) {
+		traceDump(pTraceFile);
+	}
+
+	emu.setAVRecorder(NULL);
+	recorder.close();
+
+	if (audio) {
+		SDL_CloseAudio();
+	}
+	emu.setAudioRing(NULL, 0);
 
 	//Quit SDL 
 	SDL_Quit(); 
 	return 0; 
 } 
-
@@ -0,0 +1,86 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "CPUMem.h"
+#include "BatterySave.h"
+#include "Timer.h"
+
+// Runs the frames with one PRG RAM byte written before each, like a
+// game that saves all the time, so every frame asks for a flush.
+// Returns the nanoseconds per frame and the worst frame.
+static double runWriting(Emulator& emu, UINT numFrames, double* pWorstNs) {
+	LONGLONG worst = 0;
+	LONGLONG start = readTimer();
+	for (UINT i = 0; i != numFrames; ++i) {
+		LONGLONG frameStart = readTimer();
+		emu.getCPUMem()->write((WORD)(0x6000 + (i & 0x1FFF)), (BYTE)i);
+		emu.runFrame();
+		LONGLONG frameTicks = readTimer() - frameStart;
+		if (frameTicks > worst) {
+			worst = frameTicks;
+		}
+	}
+	LONGLONG end = readTimer();
+
+	*pWorstNs = (double)timerToNs(worst);
+	return (double)timerToNs(end - start) / numFrames;
+}
+
+// Frame time with the PRG RAM in a battery save against plain memory,
+// and what the writer thread spent flushing meanwhile. The flushes
+// should cost the emulator nothing, however long they take.
+int benchBattery(int argc, char* argv[]) {
+	const char* pRom = NULL;
+	const char* pSaveFile = NULL;
+	UINT numFrames = 600;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			numFrames = (UINT)atoi(argv[++i]);
+		} else if (!pRom) {
+			pRom = argv[i];
+		} else {
+			pSaveFile = argv[i];
+		}
+	}
+	if (!pRom || !pSaveFile || !numFrames) {
+		printf("battery <rom> <save file> [-frames n]\n");
+		return 1;
+	}
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+
+	double worstNs;
+	Emulator plain;
+	plain.loadFromFile(pRom);
+	double plainNs = runWriting(plain, numFrames, &worstNs);
+	printf("%-10s %10.0f ns/frame, worst %.2f ms\n", "memory", plainNs, worstNs / 1e6);
+
+	Emulator emu;
+	emu.loadFromFile(pRom);
+	if (!emu.openBatterySave(pSaveFile)) {
+		printf("could not open %s, the ROM needs a battery\n", pSaveFile);
+		return 1;
+	}
+	double savedNs = runWriting(emu, numFrames, &worstNs);
+
+	// Read once the writer is done, the last flush on close is timed on
+	// its own
+	BatterySave* pSave = emu.getBatterySave();
+	pSave->stopWriter();
+	UINT numFlushes = pSave->getNumFlushes();
+	double flushNs = (double)pSave->getFlushNs();
+	LONGLONG closeStart = readTimer();
+	emu.closeBatterySave();
+	double closeNs = (double)timerToNs(readTimer() - closeStart);
+
+	printf("%-10s %10.0f ns/frame, worst %.2f ms, %.1f%% slower\n", "save", savedNs, worstNs / 1e6,
+		100.0 * (savedNs / plainNs - 1.0));
+	printf("%-10s %u flushes for %u frames, %.3f ms each, %.1f%% of the frame time on the writer thread, close %.2f ms\n", "",
+		numFlushes, numFrames, numFlushes ? flushNs / numFlushes / 1e6 : 0.0,
+		100.0 * flushNs / (savedNs * numFrames), closeNs / 1e6);
+	return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Types.h"
+
+// Loads the ROM into a throwaway emulator and prints why when that
+// fails, for the commands to check their ROM argument up front
+bool	checkRom		( const char* pRom );
+
+// Each benchmark is a command of nessie-bench, given the remaining
+// command line arguments. Returns the process exit code.
+int		benchBattery	( int argc, char* argv[] );
+int		benchHashCompare( int argc, char* argv[] );
+int		benchIndex		( int argc, char* argv[] );
+int		benchMicro		( int argc, char* argv[] );
+int		benchNestest	( int argc, char* argv[] );
+int		benchOpcodes	( int argc, char* argv[] );
+int		benchProfile	( int argc, char* argv[] );
+int		benchRecord		( int argc, char* argv[] );
+int		benchRun		( int argc, char* argv[] );
+int		benchScaling	( int argc, char* argv[] );
+int		benchWide		( int argc, char* argv[] );
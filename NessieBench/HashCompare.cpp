@@ -0,0 +1,58 @@
+#include "Bench.h"
+#include <stdio.h>
+#include "FrameHashLog.h"
+
+// Compares two frame hash logs, normally the same ROM or movie run on
+// two builds, and reports the first frame where they differ
+int benchHashCompare(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("hashcmp <log a> <log b>\n");
+		return 1;
+	}
+
+	FrameHashLog a;
+	FrameHashLog b;
+	if (!a.open(argv[0])) {
+		printf("Could not read %s\n", argv[0]);
+		return 1;
+	}
+	if (!b.open(argv[1])) {
+		printf("Could not read %s\n", argv[1]);
+		return 1;
+	}
+
+	if (a.getRomCrc() != b.getRomCrc()) {
+		printf("warning: the logs are of different ROMs (%08X, %08X)\n", a.getRomCrc(), b.getRomCrc());
+	}
+
+	UINT numFrames = 0;
+	FrameHashRecord ra;
+	FrameHashRecord rb;
+	for (;;) {
+		bool moreA = a.nextFrame(ra);
+		bool moreB = b.nextFrame(rb);
+		if (!moreA || !moreB) {
+			if (moreA != moreB) {
+				printf("%u frames identical, then %s ends\n", numFrames, moreA ? argv[1] : argv[0]);
+				return 1;
+			}
+			break;
+		}
+
+		bool frameDiffers = ra.frameHash != rb.frameHash;
+		bool ramDiffers = ra.ramHash != rb.ramHash;
+		if (ra.frame != rb.frame || frameDiffers || ramDiffers) {
+			printf("first divergence at frame %u (record %u):%s%s%s\n", ra.frame, numFrames,
+				ra.frame != rb.frame ? " frame number" : "",
+				frameDiffers ? " frame buffer" : "",
+				ramDiffers ? " RAM" : "");
+			printf("  %s  frame %016llX  ram %016llX\n", argv[0], ra.frameHash, ra.ramHash);
+			printf("  %s  frame %016llX  ram %016llX\n", argv[1], rb.frameHash, rb.ramHash);
+			return 1;
+		}
+		++numFrames;
+	}
+
+	printf("%u frames identical\n", numFrames);
+	return 0;
+}
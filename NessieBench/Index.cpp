@@ -0,0 +1,194 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "CartridgeImage.h"
+#include "RomIndex.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+// One ROM file of the library and what hashing it found
+struct IndexedFile {
+	std::string		path;
+	RomIndexEntry	entry;
+	int				rank;		// How far its header can be trusted, -1 if it is no ROM and 0 if its sizes are wrong
+	UINT			size;
+};
+
+// Adds every .nes and .zip file under dir, depth first
+static void findRoms(const std::string& dir, std::vector<IndexedFile>& files) {
+	WIN32_FIND_DATA data;
+	HANDLE find = FindFirstFile((dir + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	do {
+		if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) {
+			continue;
+		}
+		std::string path = dir + "\\" + data.cFileName;
+		size_t length = strlen(data.cFileName);
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			findRoms(path, files);
+		} else if (length > 4 && (_stricmp(data.cFileName + length - 4, ".nes") == 0 ||
+								  _stricmp(data.cFileName + length - 4, ".zip") == 0)) {
+			IndexedFile file;
+			file.path = path;
+			file.rank = -1;
+			file.size = 0;
+			files.push_back(file);
+		}
+	} while (FindNextFile(find, &data));
+	FindClose(find);
+}
+
+// Loads one file, zipped or not, and hashes its ROM on a pool thread.
+// The loader already has the CRC of the whole file. A header that says
+// more ROM than the file has is kept with all the data after it as
+// the ROM, which hashes the same as a good copy of the cartridge.
+static void hashRom(void* pContext, UINT index) {
+	IndexedFile& file = (*(std::vector<IndexedFile>*)pContext)[index];
+
+	const char* pError;
+	CartridgeImage* pImage = CartridgeImage::load(file.path.c_str(), pError, true);
+	if (!pImage) {
+		return;
+	}
+
+	const RomInfo& info = pImage->getInfo();
+	RomIndexEntry& entry = file.entry;
+	UINT romSize = info.prgRomSize + info.chrRomSize;
+	entry.fileCrc = pImage->getCrc();
+	entry.romCrc = crc32(pImage->getPrgRom(), romSize);
+	sha1(pImage->getPrgRom(), romSize, entry.romSha1);
+	RomIndex::fromRomInfo(info, entry);
+
+	if (pImage->hasBadSizes()) {
+		file.rank = 0;
+	} else {
+		file.rank = info.nes2 ? 3 : (info.dirty ? 1 : 2);
+	}
+	file.size = pImage->getSize();
+	pImage->release();
+}
+
+static bool bySha1(const IndexedFile* pA, const IndexedFile* pB) {
+	int order = memcmp(pA->entry.romSha1, pB->entry.romSha1, SHA1_SIZE);
+	return order != 0 ? order < 0 : pA->path < pB->path;
+}
+
+// Gives every file the header and rank of the most trusted file with
+// the same PRG and CHR ROM and returns how many headers that changed
+static UINT shareBestHeaders(std::vector<IndexedFile>& files) {
+	std::vector<IndexedFile*> roms;
+	for (size_t i = 0; i != files.size(); ++i) {
+		if (files[i].rank >= 0) {
+			roms.push_back(&files[i]);
+		}
+	}
+	std::sort(roms.begin(), roms.end(), bySha1);
+
+	UINT numFixed = 0;
+	for (size_t begin = 0; begin != roms.size(); ) {
+		size_t end = begin + 1;
+		const IndexedFile* pBest = roms[begin];
+		while (end != roms.size() && memcmp(roms[end]->entry.romSha1, pBest->entry.romSha1, SHA1_SIZE) == 0) {
+			if (roms[end]->rank > pBest->rank) {
+				pBest = roms[end];
+			}
+			++end;
+		}
+
+		// Everything after the hashes is the header part
+		size_t offset = offsetof(RomIndexEntry, mapper);
+		for (size_t i = begin; i != end; ++i) {
+			BYTE* pTo = (BYTE*)&roms[i]->entry + offset;
+			const BYTE* pFrom = (const BYTE*)&pBest->entry + offset;
+			if (memcmp(pTo, pFrom, sizeof(RomIndexEntry) - offset) != 0) {
+				memcpy(pTo, pFrom, sizeof(RomIndexEntry) - offset);
+				++numFixed;
+			}
+			roms[i]->rank = pBest->rank;
+		}
+		begin = end;
+	}
+	return numFixed;
+}
+
+// Walks a ROM library, hashes every file on all cores and writes the
+// header database the loader consults
+int benchIndex(int argc, char* argv[]) {
+	const char* pDir = NULL;
+	const char* pIndexFile = NULL;
+	int numThreads = 0;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			numThreads = atoi(argv[++i]);
+		} else if (!pDir) {
+			pDir = argv[i];
+		} else {
+			pIndexFile = argv[i];
+		}
+	}
+	if (!pDir || !pIndexFile) {
+		printf("index <rom directory> <index file> [-threads n]\n");
+		return 1;
+	}
+
+	LONGLONG start = readTimer();
+	std::vector<IndexedFile> files;
+	findRoms(pDir, files);
+	LONGLONG walked = readTimer();
+
+	ThreadPool pool(numThreads);
+	if (!files.empty()) {
+		pool.parallelFor((UINT)files.size(), hashRom, &files);
+	}
+	LONGLONG hashed = readTimer();
+
+	UINT numFixed = shareBestHeaders(files);
+	std::vector<RomIndexEntry> entries;
+	unsigned long long numBytes = 0;
+	for (size_t i = 0; i != files.size(); ++i) {
+		if (files[i].rank > 0) {
+			entries.push_back(files[i].entry);
+			numBytes += files[i].size;
+		} else if (files[i].rank == 0) {
+			// No good copy to take the sizes from
+			printf("skipped %s, its header says more ROM than it has\n", files[i].path.c_str());
+		} else {
+			printf("skipped %s\n", files[i].path.c_str());
+		}
+	}
+	if (!RomIndex::save(pIndexFile, entries.empty() ? NULL : &entries[0], (UINT)entries.size())) {
+		printf("could not write %s\n", pIndexFile);
+		return 1;
+	}
+	LONGLONG end = readTimer();
+
+	RomIndex index;
+	if (!index.load(pIndexFile)) {
+		printf("could not read back %s\n", pIndexFile);
+		return 1;
+	}
+	for (size_t i = 0; i != entries.size(); ++i) {
+		if (!index.find(entries[i].fileCrc)) {
+			printf("%08X is missing from the index\n", entries[i].fileCrc);
+			return 1;
+		}
+	}
+
+	double hashSeconds = timerToNs(hashed - walked) / 1e9;
+	printf("%u files, %u ROMs, %u entries, %u headers fixed\n", (UINT)files.size(), (UINT)entries.size(),
+		index.getNumEntries(), numFixed);
+	printf("walk %.1f ms, hash %.1f ms on %d threads (%.1f MB/s), total %.1f ms\n",
+		timerToNs(walked - start) / 1e6, hashSeconds * 1000.0, pool.getNumThreads(),
+		hashSeconds > 0.0 ? numBytes / hashSeconds / 1e6 : 0.0, timerToNs(end - start) / 1e6);
+	return 0;
+}
@@ -0,0 +1,406 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "CPU.h"
+#include "CPUMem.h"
+#include "PPU.h"
+#include "APU.h"
+#include "Resampler.h"
+#include "Hash.h"
+#include "Timer.h"
+
+#define MICRO_REPEATS	7
+#define NUM_ADDRESSES	4096
+
+// Sinks the results so the compiler can not drop the measured code
+static volatile BYTE sink;
+static volatile unsigned long long sinkHash;
+
+// Cycles per operation, best of MICRO_REPEATS runs of numOps operations
+static void report(const char* pName, unsigned long long bestCycles, UINT numOps) {
+	printf("%-28s %10.2f cycles/op\n", pName, (double)bestCycles / numOps);
+}
+
+//
+// CPUMem::read/write over different address mixes
+//
+static void fillAddresses(WORD* pAddresses, int ramPercent, int romPercent) {
+	srand(1234);
+	for (int i = 0; i != NUM_ADDRESSES; ++i) {
+		int r = rand() % 100;
+		if (r < ramPercent) {
+			pAddresses[i] = (WORD)(rand() & 0x07FF);
+		} else if (r < ramPercent + romPercent) {
+			pAddresses[i] = (WORD)(0x8000 + (rand() & 0x7FFF));
+		} else {
+			// PPUSTATUS and the first controller, both safe to hammer
+			pAddresses[i] = (rand() & 1) ? 0x2002 : 0x4016;
+		}
+	}
+}
+
+static void benchBus(Emulator& emu) {
+	CPUMem* pMem = emu.getCPUMem();
+	WORD addresses[NUM_ADDRESSES];
+
+	struct Mix { const char* pName; int ram; int rom; } mixes[] = {
+		{ "read  RAM",			100,	0 },
+		{ "read  ROM",			0,		100 },
+		{ "read  I/O",			0,		0 },
+		{ "read  70/25/5 mix",	70,		25 },
+	};
+	for (int m = 0; m != sizeof(mixes) / sizeof(mixes[0]); ++m) {
+		fillAddresses(addresses, mixes[m].ram, mixes[m].rom);
+		unsigned long long best = ~0ULL;
+		for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+			BYTE acc = 0;
+			unsigned long long start = readCycles();
+			for (int i = 0; i != NUM_ADDRESSES; ++i) {
+				acc ^= pMem->read(addresses[i]);
+			}
+			unsigned long long cycles = readCycles() - start;
+			sink = acc;
+			best = cycles < best ? cycles : best;
+		}
+		report(mixes[m].pName, best, NUM_ADDRESSES);
+	}
+
+	// Writes go to RAM or to OAMADDR, the ROM ignores them
+	Mix writeMixes[] = {
+		{ "write RAM",			100,	0 },
+		{ "write I/O",			0,		0 },
+	};
+	for (int m = 0; m != sizeof(writeMixes) / sizeof(writeMixes[0]); ++m) {
+		fillAddresses(addresses, writeMixes[m].ram, writeMixes[m].rom);
+		for (int i = 0; i != NUM_ADDRESSES; ++i) {
+			if (addresses[i] >= 0x2000) {
+				addresses[i] = 0x2003;
+			}
+		}
+		unsigned long long best = ~0ULL;
+		for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+			unsigned long long start = readCycles();
+			for (int i = 0; i != NUM_ADDRESSES; ++i) {
+				pMem->write(addresses[i], (BYTE)i);
+			}
+			unsigned long long cycles = readCycles() - start;
+			best = cycles < best ? cycles : best;
+		}
+		report(writeMixes[m].pName, best, NUM_ADDRESSES);
+	}
+	emu.reset();
+}
+
+//
+// CPU::run dispatch over synthetic programs
+//
+static BYTE prgRom[0x4000];
+
+// Puts a looping program at $C000 and points the vectors at it. NMIs
+// and IRQs go to an RTI at $FF00 so they do not disturb the loop, and
+// the APU frame interrupt is inhibited so there are no IRQs to begin with.
+static void loadProgram(Emulator& emu, const BYTE* pCode, int length) {
+	memset(prgRom, 0xEA, sizeof(prgRom));
+	memcpy(prgRom, pCode, length);
+
+	// JMP $C000
+	prgRom[length + 0] = 0x4C;
+	prgRom[length + 1] = 0x00;
+	prgRom[length + 2] = 0xC0;
+
+	prgRom[0x3F00] = 0x40;		// RTI
+	prgRom[0x3FFA] = 0x00;		// NMI
+	prgRom[0x3FFB] = 0xFF;
+	prgRom[0x3FFC] = 0x00;		// Reset
+	prgRom[0x3FFD] = 0xC0;
+	prgRom[0x3FFE] = 0x00;		// IRQ
+	prgRom[0x3FFF] = 0xFF;
+
+	emu.getCPUMem()->setPrgRomBank1(prgRom);
+	emu.getCPUMem()->setPrgRomBank2(prgRom);
+	emu.reset();
+	emu.getCPUMem()->write(APU_FRAME, 0x40);
+}
+
+static void benchDispatch(Emulator& emu) {
+	static const BYTE alu[] = {
+		0x69, 0x01,			// ADC #$01
+		0x29, 0xFE,			// AND #$FE
+		0x49, 0x55,			// EOR #$55
+		0xC9, 0x03,			// CMP #$03
+		0xE8,				// INX
+		0xC8,				// INY
+		0x4A,				// LSR A
+		0x2A,				// ROL A
+		0xAA,				// TAX
+		0x8A,				// TXA
+	};
+	static const BYTE loadStore[] = {
+		0xA5, 0x10,			// LDA $10
+		0x85, 0x11,			// STA $11
+		0xA6, 0x12,			// LDX $12
+		0x86, 0x13,			// STX $13
+		0xAD, 0x00, 0x03,	// LDA $0300
+		0x8D, 0x01, 0x03,	// STA $0301
+		0xBD, 0x00, 0x04,	// LDA $0400,X
+		0x9D, 0x00, 0x05,	// STA $0500,X
+		0xB5, 0x20,			// LDA $20,X
+		0x95, 0x30,			// STA $30,X
+	};
+	static const BYTE branches[] = {
+		0xA2, 0x08,			// LDX #$08
+		0xCA,				// DEX
+		0xD0, 0xFD,			// BNE -3
+		0xA9, 0x00,			// LDA #$00
+		0xF0, 0x00,			// BEQ +0
+		0x10, 0x00,			// BPL +0
+		0x18,				// CLC
+		0xB0, 0x00,			// BCS +0 (not taken)
+	};
+
+	struct Program { const char* pName; const BYTE* pCode; int length; } programs[] = {
+		{ "dispatch ALU",			alu,		sizeof(alu) },
+		{ "dispatch load/store",	loadStore,	sizeof(loadStore) },
+		{ "dispatch branch heavy",	branches,	sizeof(branches) },
+	};
+
+	CPU* pCpu = emu.getCPU();
+	const UINT numInstructions = 100000;
+	emu.setRenderEnabled(false);
+
+	for (int p = 0; p != sizeof(programs) / sizeof(programs[0]); ++p) {
+		loadProgram(emu, programs[p].pCode, programs[p].length);
+		unsigned long long best = ~0ULL;
+		for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+			unsigned long long start = readCycles();
+			for (UINT i = 0; i != numInstructions; ++i) {
+				pCpu->run();
+			}
+			unsigned long long cycles = readCycles() - start;
+			best = cycles < best ? cycles : best;
+		}
+		report(programs[p].pName, best, numInstructions);
+	}
+	emu.setRenderEnabled(true);
+}
+
+//
+// PPU, DMA and save states
+//
+static void benchPPU(Emulator& emu) {
+	PPU* pPpu = emu.getPPU();
+	BYTE* pFrame = emu.getFrameBuffer();
+
+	// Only the background layer is rendered by the PPU so far
+	unsigned long long best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (int line = 0; line != SCREEN_HEIGHT; ++line) {
+			pPpu->renderScanline(line, pFrame + line * SCREEN_WIDTH);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	report("renderScanline background", best, SCREEN_HEIGHT);
+
+	CPUMem* pMem = emu.getCPUMem();
+	const UINT numDmas = 1000;
+	best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (UINT i = 0; i != numDmas; ++i) {
+			pMem->write(0x4014, 0x02);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	report("OAM DMA", best, numDmas);
+	pMem->clearDmaPending();
+
+	UINT size = emu.getStateSize();
+	BYTE* pState = new BYTE[size];
+	const UINT numStates = 1000;
+
+	best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (UINT i = 0; i != numStates; ++i) {
+			emu.saveState(pState);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	report("save state snapshot", best, numStates);
+
+	best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (UINT i = 0; i != numStates; ++i) {
+			emu.loadState(pState);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	report("save state restore", best, numStates);
+
+	delete[] pState;
+}
+
+// A frame of a program that keeps every APU channel busy, with the full
+// APU and with the timing only one that headless instances use
+static void benchApu(Emulator& emu) {
+	static const BYTE program[] = {
+		0xA9, 0x0F,			// LDA #$0F
+		0x8D, 0x15, 0x40,	// STA $4015
+		0xA9, 0xBF,			// LDA #$BF, 50% duty, constant volume 15
+		0x8D, 0x00, 0x40,	// STA $4000
+		0x8D, 0x04, 0x40,	// STA $4004
+		0xA9, 0xFD,			// LDA #$FD
+		0x8D, 0x02, 0x40,	// STA $4002
+		0xA9, 0x7E,			// LDA #$7E
+		0x8D, 0x06, 0x40,	// STA $4006
+		0xA9, 0x08,			// LDA #$08
+		0x8D, 0x03, 0x40,	// STA $4003
+		0x8D, 0x07, 0x40,	// STA $4007
+		0xA9, 0xFF,			// LDA #$FF
+		0x8D, 0x08, 0x40,	// STA $4008
+		0xA9, 0x40,			// LDA #$40
+		0x8D, 0x0A, 0x40,	// STA $400A
+		0xA9, 0x08,			// LDA #$08
+		0x8D, 0x0B, 0x40,	// STA $400B
+		0xA9, 0x3F,			// LDA #$3F
+		0x8D, 0x0C, 0x40,	// STA $400C
+		0xA9, 0x04,			// LDA #$04
+		0x8D, 0x0E, 0x40,	// STA $400E
+		0xA9, 0x08,			// LDA #$08
+		0x8D, 0x0F, 0x40,	// STA $400F
+		0xA9, 0x4F,			// LDA #$4F, looping sample at the fastest rate
+		0x8D, 0x10, 0x40,	// STA $4010
+		0xA9, 0x00,			// LDA #$00, from $C000
+		0x8D, 0x12, 0x40,	// STA $4012
+		0xA9, 0x10,			// LDA #$10, 257 bytes
+		0x8D, 0x13, 0x40,	// STA $4013
+		0xA9, 0x1F,			// LDA #$1F
+		0x8D, 0x15, 0x40,	// STA $4015
+		0xA5, 0x00,			// LDA $00
+		0x4C, 0x00, 0x00,	// JMP to the LDA, patched below
+	};
+	BYTE code[sizeof(program)];
+	memcpy(code, program, sizeof(program));
+	WORD loop = 0xC000 + sizeof(program) - 5;
+	code[sizeof(program) - 2] = (BYTE)(loop & 0xFF);
+	code[sizeof(program) - 1] = (BYTE)(loop >> 8);
+
+	emu.setRenderEnabled(false);
+	const UINT numFrames = 60;
+	const char* apNames[2] = { "APU frame, full", "APU frame, timing only" };
+	unsigned long long bestOf[2];
+
+	for (int mode = 0; mode != 2; ++mode) {
+		loadProgram(emu, code, sizeof(code));
+		emu.setAudioEnabled(mode == 0);
+		emu.runFrame();
+
+		unsigned long long best = ~0ULL;
+		for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+			unsigned long long start = readCycles();
+			for (UINT i = 0; i != numFrames; ++i) {
+				emu.runFrame();
+			}
+			unsigned long long cycles = readCycles() - start;
+			best = cycles < best ? cycles : best;
+		}
+		report(apNames[mode], best, numFrames);
+		bestOf[mode] = best;
+	}
+	printf("%-28s %10.2f cycles/frame saved by skipping synthesis\n", "",
+		((double)bestOf[0] - (double)bestOf[1]) / numFrames);
+
+	emu.setAudioEnabled(true);
+	emu.setRenderEnabled(true);
+}
+
+// One frame of APU samples to a 48 kHz device, the batch the APU hands
+// the resampler at the end of every frame
+static void benchResample() {
+	const int numIn = APU_SAMPLE_RATE / 60;
+	short in[numIn];
+	short out[BLIP_SIZE];
+	for (int i = 0; i != numIn; ++i) {
+		in[i] = (short)((i * 97) & 0x3FFF);
+	}
+
+	Resampler resampler(APU_SAMPLE_RATE, 48000);
+	const UINT numFrames = 100;
+	UINT numOut = 0;
+	unsigned long long best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (UINT i = 0; i != numFrames; ++i) {
+			numOut += resampler.process(in, numIn, out, BLIP_SIZE);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	sink = (BYTE)(numOut + out[0]);
+	report("resample frame to 48 kHz", best, numFrames);
+}
+
+// The per-frame hash log hashes the frame buffer and RAM once a frame,
+// shown against the cost of emulating a frame
+static void benchHash(Emulator& emu) {
+	const BYTE* pFrame = emu.getFrameBuffer();
+	const BYTE* pRam = emu.getCPUMem()->getRam();
+	const UINT numHashes = 100;
+
+	unsigned long long best = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		for (UINT i = 0; i != numHashes; ++i) {
+			sinkHash += hash64(pFrame, SCREEN_WIDTH * SCREEN_HEIGHT);
+			sinkHash += hash64(pRam, CPU_RAM_SIZE);
+		}
+		unsigned long long cycles = readCycles() - start;
+		best = cycles < best ? cycles : best;
+	}
+	report("frame + RAM hash", best, numHashes);
+
+	unsigned long long bestFrame = ~0ULL;
+	for (int rep = 0; rep != MICRO_REPEATS; ++rep) {
+		unsigned long long start = readCycles();
+		emu.runFrame();
+		unsigned long long cycles = readCycles() - start;
+		bestFrame = cycles < bestFrame ? cycles : bestFrame;
+	}
+	printf("%-28s %10.3f %% of a rendered frame\n", "", 100.0 * best / numHashes / bestFrame);
+}
+
+// Component microbenchmarks, each timed with rdtsc in isolation
+int benchMicro(int argc, char* argv[]) {
+	if (argc < 1) {
+		printf("micro <rom>\n");
+		return 1;
+	}
+
+	Emulator emu;
+	if (!emu.loadFromFile(argv[0])) {
+		printf("could not load %s: %s\n", argv[0], emu.getLoadError());
+		return 1;
+	}
+
+	// Warm up to a representative PPU and RAM state
+	for (int i = 0; i != 60; ++i) {
+		emu.runFrame();
+	}
+
+	printf("best of %d runs, host cycles from rdtsc\n\n", MICRO_REPEATS);
+	benchBus(emu);
+	benchPPU(emu);
+	benchDispatch(emu);
+	benchApu(emu);
+	benchResample();
+	benchHash(emu);
+	return 0;
+}
@@ -0,0 +1,328 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "CPU.h"
+#include "CPUMem.h"
+#include "WideCPU.h"
+
+// Instruction lengths for all 256 opcodes, including the unofficial
+// ones that nestest exercises at the end of its log
+static const BYTE opcodeLength[256] = {
+	1,2,1,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	3,2,1,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	1,2,1,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	1,2,1,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	2,2,2,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	2,2,2,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	2,2,2,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+	2,2,2,2,2,2,2,2,1,2,1,2,3,3,3,3,
+	2,2,1,2,2,2,2,2,1,3,1,3,3,3,3,3,
+};
+
+// One instruction worth of trace, as nestest.log prints it
+struct TraceLine {
+	WORD	pc;
+	int		numBytes;
+	BYTE	bytes[3];
+	BYTE	a;
+	BYTE	x;
+	BYTE	y;
+	BYTE	p;
+	BYTE	sp;
+	long	cycle;	// CPU cycle, or the PPU dot for logs with an SL: column
+};
+
+#define CONTEXT_LINES	8
+#define MAX_LINE		256
+
+// Parses "name:xx" (hex) out of a log line
+static bool parseHexField(const char* pLine, const char* pName, BYTE& value) {
+	const char* p = strstr(pLine, pName);
+	if (p == NULL) {
+		return false;
+	}
+	value = (BYTE)strtoul(p + strlen(pName), NULL, 16);
+	return true;
+}
+
+// Reads the fields out of a nestest.log line. Both the newer format
+// ("PPU:  0, 21 CYC:7", CPU cycles) and the older one ("CYC:  0 SL:241",
+// PPU dots) are understood; dotCycles tells which one the line used.
+static bool parseLine(const char* pLine, TraceLine& t, bool& dotCycles) {
+	if (strlen(pLine) < 16) {
+		return false;
+	}
+
+	char* pEnd;
+	t.pc = (WORD)strtoul(pLine, &pEnd, 16);
+	if (pEnd != pLine + 4) {
+		return false;
+	}
+
+	t.numBytes = 0;
+	for (int i = 0; i != 3; ++i) {
+		const char* p = pLine + 6 + i * 3;
+		if (p[0] == ' ') {
+			break;
+		}
+		t.bytes[i] = (BYTE)strtoul(p, NULL, 16);
+		++t.numBytes;
+	}
+
+	if (!parseHexField(pLine, " A:", t.a) || !parseHexField(pLine, " X:", t.x) ||
+		!parseHexField(pLine, " Y:", t.y) || !parseHexField(pLine, " P:", t.p) ||
+		!parseHexField(pLine, "SP:", t.sp)) {
+		return false;
+	}
+
+	const char* pCycle = strstr(pLine, "CYC:");
+	if (pCycle == NULL) {
+		return false;
+	}
+	t.cycle = strtol(pCycle + 4, NULL, 10);
+	dotCycles = strstr(pLine, "SL:") != NULL;
+	return true;
+}
+
+static void formatLine(const TraceLine& t, char* pOut, size_t size) {
+	char bytes[10] = "        ";
+	for (int i = 0; i != t.numBytes; ++i) {
+		sprintf_s(bytes + i * 3, sizeof(bytes) - i * 3, i + 1 == t.numBytes ? "%02X" : "%02X ", t.bytes[i]);
+	}
+	sprintf_s(pOut, size, "%04X  %-8s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%ld",
+		t.pc, bytes, t.a, t.x, t.y, t.p, t.sp, t.cycle);
+}
+
+// Names the first field that differs, or returns NULL
+static const char* compareLines(const TraceLine& ours, const TraceLine& ref) {
+	if (ours.pc != ref.pc) return "PC";
+	if (ours.numBytes != ref.numBytes || memcmp(ours.bytes, ref.bytes, ours.numBytes) != 0) return "opcode bytes";
+	if (ours.a != ref.a) return "A";
+	if (ours.x != ref.x) return "X";
+	if (ours.y != ref.y) return "Y";
+	if (ours.p != ref.p) return "P";
+	if (ours.sp != ref.sp) return "SP";
+	if (ours.cycle != ref.cycle) return "CYC";
+	return NULL;
+}
+
+// Interpreter backends the trace can be run against. Each call executes
+// at least one instruction, lines for the instructions a backend ran
+// together can not be looked at and are skipped.
+struct Backend {
+	const char*	pName;
+	void		(*pStep)( Emulator* pEmu, WideCPU* pWide );
+};
+
+static void stepSwitch(Emulator* pEmu, WideCPU* pWide) {
+	pEmu->getCPU()->run();
+}
+
+static void stepWide(Emulator* pEmu, WideCPU* pWide) {
+	pWide->runInstruction();
+}
+
+// May run two instructions at once
+static void stepFused(Emulator* pEmu, WideCPU* pWide) {
+	pEmu->getCPU()->runFused();
+}
+
+static const Backend backends[] = {
+	{ "switch",	stepSwitch },
+	{ "wide",	stepWide },
+	{ "fused",	stepFused },
+};
+
+// Runs nestest.nes from $C000 in automation mode, one instruction at a
+// time, and compares each instruction with the reference nestest.log.
+// Stops at the first line that differs and prints the lines leading up
+// to it.
+int benchNestest(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("nestest <rom> <log> [-backend switch|wide|fused] [-trace file]\n");
+		return 1;
+	}
+
+	const char* pRom = argv[0];
+	const char* pLog = argv[1];
+	const Backend* pBackend = &backends[0];
+	const char* pTraceFile = NULL;
+
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc) {
+			const char* pName = argv[++i];
+			pBackend = NULL;
+			for (int b = 0; b != sizeof(backends) / sizeof(backends[0]); ++b) {
+				if (strcmp(pName, backends[b].pName) == 0) {
+					pBackend = &backends[b];
+				}
+			}
+			if (pBackend == NULL) {
+				printf("Unknown backend %s\n", pName);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+			pTraceFile = argv[++i];
+		}
+	}
+
+	FILE* pRef = NULL;
+	if (fopen_s(&pRef, pLog, "r") != 0 || pRef == NULL) {
+		printf("Could not open %s\n", pLog);
+		return 1;
+	}
+
+	FILE* pTrace = NULL;
+	if (pTraceFile != NULL && (fopen_s(&pTrace, pTraceFile, "w") != 0 || pTrace == NULL)) {
+		printf("Could not open %s\n", pTraceFile);
+		fclose(pRef);
+		return 1;
+	}
+
+	Emulator* pEmu = new Emulator();
+	if (!pEmu->loadFromFile(pRom)) {
+		printf("could not load %s: %s\n", pRom, pEmu->getLoadError());
+		delete pEmu;
+		fclose(pRef);
+		if (pTrace) {
+			fclose(pTrace);
+		}
+		return 1;
+	}
+	pEmu->setRenderEnabled(false);
+
+	// Automation mode, the same start state the reference log has
+	CPU* pCpu = pEmu->getCPU();
+	CPUMem* pMem = pEmu->getCPUMem();
+	CPURegisters regs;
+	regs.P = 0xC000;
+	regs.A = regs.X = regs.Y = 0;
+	regs.F = 0x24;
+	regs.S = 0xFD;
+	pCpu->setRegisters(regs);
+
+	Emulator* apLanes[1] = { pEmu };
+	WideCPU wide(apLanes, 1);
+
+	char line[MAX_LINE];
+	char context[CONTEXT_LINES][MAX_LINE];
+	int numContext = 0;
+	unsigned long lineNumber = 0;
+	long firstCycle = 0;
+	unsigned long long startCycles = pCpu->getTotalCycles();
+	unsigned long long skipLines = 0;
+	unsigned long numMerged = 0;
+	int result = 0;
+	bool stopped = false;
+
+	while (fgets(line, sizeof(line), pRef) != NULL) {
+		size_t length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			line[--length] = 0;
+		}
+
+		TraceLine ref;
+		bool dotCycles;
+		if (!parseLine(line, ref, dotCycles)) {
+			continue;
+		}
+		++lineNumber;
+		if (lineNumber == 1) {
+			firstCycle = ref.cycle;
+		}
+
+		if (skipLines) {
+			--skipLines;
+			strcpy_s(context[(lineNumber - 1) % CONTEXT_LINES], MAX_LINE, line);
+			if (numContext < CONTEXT_LINES) {
+				++numContext;
+			}
+			continue;
+		}
+
+		// The state before the instruction executes
+		TraceLine ours;
+		pCpu->getRegisters(regs);
+		ours.pc = regs.P;
+		ours.numBytes = opcodeLength[pMem->peek(regs.P)];
+		for (int i = 0; i != ours.numBytes; ++i) {
+			ours.bytes[i] = pMem->peek((WORD)(regs.P + i));
+		}
+		ours.a = regs.A;
+		ours.x = regs.X;
+		ours.y = regs.Y;
+		// Bit 5 always reads as set and B only exists on the stack
+		ours.p = (regs.F | 0x20) & ~FLAG_B;
+		ours.sp = regs.S;
+		long elapsed = (long)(pCpu->getTotalCycles() - startCycles);
+		ours.cycle = dotCycles ? (firstCycle + elapsed * 3) % 341 : firstCycle + elapsed;
+
+		char ourLine[MAX_LINE];
+		formatLine(ours, ourLine, sizeof(ourLine));
+		if (pTrace != NULL) {
+			// Flushed every line in case the emulator goes down
+			fprintf(pTrace, "%s\n", ourLine);
+			fflush(pTrace);
+		}
+
+		const char* pField = compareLines(ours, ref);
+		if (pField == NULL && !CPU::isImplemented(ours.bytes[0])) {
+			// Real nestest goes on to the unofficial opcodes, running one
+			// the CPU does not know would stop the process. The result
+			// codes so far are those of the official tests.
+			printf("%s: all %lu official lines match, stopped at unofficial opcode %02X, result codes %02X %02X\n",
+				pBackend->pName, lineNumber - 1, ours.bytes[0], pMem->peek(0x02), pMem->peek(0x03));
+			stopped = true;
+			break;
+		}
+		if (pField != NULL) {
+			printf("%s: %s differs at line %lu\n\n", pBackend->pName, pField, lineNumber);
+			for (int i = 0; i != numContext; ++i) {
+				printf("     %s\n", context[(lineNumber - 1 - numContext + i) % CONTEXT_LINES]);
+			}
+			printf("ref  %s\n", line);
+			printf("ours %s\n", ourLine);
+			result = 1;
+			break;
+		}
+
+		strcpy_s(context[(lineNumber - 1) % CONTEXT_LINES], MAX_LINE, line);
+		if (numContext < CONTEXT_LINES) {
+			++numContext;
+		}
+
+		unsigned long long instructions = pCpu->getInstructionCount();
+		pBackend->pStep(pEmu, &wide);
+		skipLines = pCpu->getInstructionCount() - instructions - 1;
+		if (skipLines) {
+			++numMerged;
+		}
+	}
+
+	if (numMerged) {
+		// Their state is only compared at the line after them
+		printf("%s: %lu steps ran more than one instruction\n", pBackend->pName, numMerged);
+	}
+
+	if (result == 0 && !stopped) {
+		// nestest leaves its error codes in $02 and $03
+		printf("%s: all %lu lines match, result codes %02X %02X\n",
+			pBackend->pName, lineNumber, pMem->peek(0x02), pMem->peek(0x03));
+	}
+
+	if (pTrace != NULL) {
+		fclose(pTrace);
+	}
+	fclose(pRef);
+	delete pEmu;
+	return result;
+}
@@ -0,0 +1,60 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchRunner.h"
+#include "OpcodeStats.h"
+
+// Runs a batch of instances and writes the per-opcode and opcode pair
+// counters summed over all of them. Needs a NESSIE_OPCODE_STATS build.
+int benchOpcodes(int argc, char* argv[]) {
+	if (argc < 1) {
+		printf("opcodes <rom> [instances] [frames] [prefix]\n");
+		return 1;
+	}
+
+	const char* pRom = argv[0];
+	UINT numInstances = argc > 1 ? (UINT)atoi(argv[1]) : 16;
+	UINT numFrames = argc > 2 ? (UINT)atoi(argv[2]) : 600;
+	const char* pPrefix = argc > 3 ? argv[3] : "opcodes";
+
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+	BatchRunner runner(numInstances);
+	runner.loadFromFile(pRom);
+
+	StepConfig config;
+	config.format = OBS_NONE;
+	config.numPorts = 1;
+	config.pRamAddresses = NULL;
+	config.numRamAddresses = 0;
+	runner.configureStep(config);
+
+	BYTE* pActions = new BYTE[numInstances];
+	memset(pActions, 0, numInstances);
+	for (UINT f = 0; f != numFrames; ++f) {
+		runner.step(pActions, 1, NULL, NULL, NULL);
+	}
+	delete[] pActions;
+
+	OpcodeStats* pTotal = new OpcodeStats;
+	if (!runner.getOpcodeStats(*pTotal)) {
+		printf("this build does not count opcodes, define NESSIE_OPCODE_STATS\n");
+		delete pTotal;
+		return 1;
+	}
+
+	char opcodeFile[256];
+	char pairFile[256];
+	sprintf_s(opcodeFile, sizeof(opcodeFile), "%s.csv", pPrefix);
+	sprintf_s(pairFile, sizeof(pairFile), "%s_pairs.csv", pPrefix);
+	bool ok = writeOpcodeStatsCsv(*pTotal, opcodeFile, pairFile);
+	if (ok) {
+		printf("%u instances x %u frames written to %s and %s\n", numInstances, numFrames, opcodeFile, pairFile);
+	} else {
+		printf("could not write %s\n", opcodeFile);
+	}
+	delete pTotal;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "CPU.h"
+#include "Movie.h"
+#include "Profiler.h"
+
+// Runs a ROM (and movie) under the guest profiler and writes folded
+// stacks, e.g. for flamegraph.pl
+int benchProfile(int argc, char* argv[]) {
+	const char* pRom = NULL;
+	const char* pMovie = NULL;
+	const char* pLabels = NULL;
+	const char* pOut = "profile.folded";
+	UINT numFrames = 0;
+	UINT interval = 1000;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-movie") == 0 && i + 1 < argc) {
+			pMovie = argv[++i];
+		} else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			numFrames = (UINT)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc) {
+			interval = (UINT)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-labels") == 0 && i + 1 < argc) {
+			pLabels = argv[++i];
+		} else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) {
+			pOut = argv[++i];
+		} else {
+			pRom = argv[i];
+		}
+	}
+
+	if (!pRom) {
+		printf("profile <rom> [-movie file] [-frames n] [-interval cycles] [-labels file] [-out file]\n");
+		return 1;
+	}
+
+	Emulator emu;
+	if (!emu.loadFromFile(pRom)) {
+		printf("could not load %s: %s\n", pRom, emu.getLoadError());
+		return 1;
+	}
+	emu.setRenderEnabled(false);
+
+	Movie movie;
+	if (pMovie) {
+		if (!movie.load(pMovie) || !emu.startPlayback(&movie)) {
+			printf("could not play %s on %s\n", pMovie, pRom);
+			return 1;
+		}
+	}
+	if (!numFrames) {
+		numFrames = pMovie ? movie.getNumFrames() : 3600;
+	}
+
+	Profiler profiler(emu.getCPUMem(), interval);
+	if (pLabels && !profiler.loadLabels(pLabels)) {
+		printf("could not read %s\n", pLabels);
+		return 1;
+	}
+
+	emu.getCPU()->setProfiler(&profiler);
+	for (UINT i = 0; i != numFrames; ++i) {
+		emu.runFrame();
+	}
+	emu.getCPU()->setProfiler(NULL);
+
+	if (!profiler.writeFolded(pOut)) {
+		printf("could not write %s\n", pOut);
+		return 1;
+	}
+	printf("%u samples over %u frames written to %s\n", profiler.getNumSamples(), numFrames, pOut);
+	return 0;
+}
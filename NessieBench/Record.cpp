@@ -0,0 +1,82 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "APU.h"
+#include "AVRecorder.h"
+#include "Timer.h"
+
+// Emulated frames per second with the recorder, if any, attached. The
+// rate only covers emulating, the time the writer then takes to drain
+// its queue and close is returned in pFlushSeconds and reported next
+// to it, so nothing left in the queue goes unseen.
+static double recordOnce(const char* pRom, UINT numFrames, AVRecorder* pRecorder, double* pFlushSeconds) {
+	Emulator emu;
+	emu.loadFromFile(pRom);
+	emu.setAVRecorder(pRecorder);
+
+	LONGLONG start = readTimer();
+	for (UINT i = 0; i != numFrames; ++i) {
+		emu.runFrame();
+	}
+	LONGLONG emulated = readTimer();
+	if (pRecorder) {
+		pRecorder->close();
+	}
+	LONGLONG end = readTimer();
+
+	*pFlushSeconds = timerToNs(end - emulated) / 1e9;
+	return numFrames / (timerToNs(emulated - start) / 1e9);
+}
+
+// Emulation throughput lost to recording, with the writer blocking the
+// emulator when it falls behind and with it dropping frames instead
+int benchRecord(int argc, char* argv[]) {
+	const char* pRom = NULL;
+	const char* pBase = NULL;
+	UINT numFrames = 600;
+	UINT queueFrames = 16;
+	AVFormat format = AV_FORMAT_Y4M_WAV;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			numFrames = (UINT)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-queue") == 0 && i + 1 < argc) {
+			queueFrames = (UINT)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-raw") == 0) {
+			format = AV_FORMAT_RAW;
+		} else if (!pRom) {
+			pRom = argv[i];
+		} else {
+			pBase = argv[i];
+		}
+	}
+	if (!pRom || !pBase) {
+		printf("record <rom> <output base> [-frames n] [-queue n] [-raw]\n");
+		return 1;
+	}
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+
+	double flush;
+	double baseline = recordOnce(pRom, numFrames, NULL, &flush);
+	printf("%-10s %10.1f frames/s\n", "off", baseline);
+
+	static const AVBackpressure modes[2] = { AV_BLOCK, AV_DROP };
+	static const char* pModeNames[2] = { "block", "drop" };
+	for (int m = 0; m != 2; ++m) {
+		AVRecorder recorder;
+		if (!recorder.open(pBase, format, modes[m], queueFrames, APU_SAMPLE_RATE)) {
+			printf("could not create the output files for %s\n", pBase);
+			return 1;
+		}
+		double fps = recordOnce(pRom, numFrames, &recorder, &flush);
+		printf("%-10s %10.1f frames/s, %5.1f%% lost, blocked %.1f ms, %u written, %u dropped, %.1f ms flushing%s\n",
+			pModeNames[m], fps, 100.0 * (1.0 - fps / baseline), recorder.getBlockedNs() / 1e6,
+			recorder.getFramesWritten(), recorder.getFramesDropped(), flush * 1000.0,
+			recorder.hasFailed() ? ", write failed" : "");
+	}
+	return 0;
+}
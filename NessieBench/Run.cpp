@@ -0,0 +1,221 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Emulator.h"
+#include "FrameHashLog.h"
+#include "CPU.h"
+#include "Movie.h"
+#include "Timer.h"
+
+// Results of one repetition of a workload
+struct RunResult {
+	double	seconds;
+	double	framesPerSecond;
+	double	instructionsPerSecond;
+	double	nsPerFrame;
+	double	p50, p90, p99, maxNs;
+	EmulatorStats	stats;	// Average of the last frames, NESSIE_INSTRUMENT builds only
+};
+
+// Mean and standard deviation of one number over the repetitions
+struct Spread {
+	double	mean;
+	double	stddev;
+	double	minimum;
+	double	maximum;
+};
+
+static Spread spreadOf(const std::vector<RunResult>& runs, double RunResult::* pField) {
+	Spread s;
+	s.mean = 0.0;
+	s.minimum = s.maximum = runs[0].*pField;
+	for (size_t i = 0; i != runs.size(); ++i) {
+		double v = runs[i].*pField;
+		s.mean += v;
+		s.minimum = v < s.minimum ? v : s.minimum;
+		s.maximum = v > s.maximum ? v : s.maximum;
+	}
+	s.mean /= runs.size();
+
+	double variance = 0.0;
+	for (size_t i = 0; i != runs.size(); ++i) {
+		double d = runs[i].*pField - s.mean;
+		variance += d * d;
+	}
+	s.stddev = runs.size() > 1 ? sqrt(variance / (runs.size() - 1)) : 0.0;
+	return s;
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+// Runs the ROM (and movie) headless for a number of frames
+static RunResult runOnce(const char* pRom, const char* pMovie, UINT numFrames, bool render, bool fusion, const char* pHashLog) {
+	Emulator emu;
+	emu.loadFromFile(pRom);
+	emu.setRenderEnabled(render);
+	emu.setFusionEnabled(fusion);
+
+	FrameHashLog hashLog;
+	if (pHashLog) {
+		if (hashLog.create(pHashLog, emu.getRomCrc())) {
+			emu.setFrameHashLog(&hashLog);
+		} else {
+			printf("could not create %s\n", pHashLog);
+		}
+	}
+
+	Movie movie;
+	if (pMovie) {
+		if (!movie.load(pMovie) || !emu.startPlayback(&movie)) {
+			printf("could not play %s on %s\n", pMovie, pRom);
+		}
+	}
+
+	std::vector<double> frameNs(numFrames);
+	unsigned long long firstInstruction = emu.getCPU()->getInstructionCount();
+
+	LONGLONG start = readTimer();
+	for (UINT i = 0; i != numFrames; ++i) {
+		LONGLONG frameStart = readTimer();
+		emu.runFrame();
+		frameNs[i] = (double)timerToNs(readTimer() - frameStart);
+	}
+	LONGLONG end = readTimer();
+
+	RunResult r;
+	r.seconds = timerToNs(end - start) / 1e9;
+	r.framesPerSecond = numFrames / r.seconds;
+	r.instructionsPerSecond = (emu.getCPU()->getInstructionCount() - firstInstruction) / r.seconds;
+	r.nsPerFrame = r.seconds * 1e9 / numFrames;
+
+	std::sort(frameNs.begin(), frameNs.end());
+	r.p50 = percentile(frameNs, 0.50);
+	r.p90 = percentile(frameNs, 0.90);
+	r.p99 = percentile(frameNs, 0.99);
+	r.maxNs = frameNs.back();
+	r.stats = emu.getAverageStats();
+	return r;
+}
+
+static void printSpread(FILE* pFile, const char* pName, const Spread& s, bool last) {
+	fprintf(pFile, "        \"%s\": { \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f }%s\n",
+		pName, s.mean, s.stddev, s.minimum, s.maximum, last ? "" : ",");
+}
+
+// Workloads are run with the renderer on and off, the difference
+// between the two is the cost of the PPU renderer.
+int benchRun(int argc, char* argv[]) {
+	const char* pRom = NULL;
+	const char* pMovie = NULL;
+	const char* pJson = NULL;
+	const char* pHashLog = NULL;
+	bool fusion = true;
+	UINT numFrames = 0;
+	int numReps = 5;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-movie") == 0 && i + 1 < argc) {
+			pMovie = argv[++i];
+		} else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			numFrames = (UINT)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc) {
+			numReps = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+			pJson = argv[++i];
+		} else if (strcmp(argv[i], "-hashlog") == 0 && i + 1 < argc) {
+			pHashLog = argv[++i];
+		} else if (strcmp(argv[i], "-nofusion") == 0) {
+			fusion = false;
+		} else {
+			pRom = argv[i];
+		}
+	}
+
+	if (!pRom || numReps < 1) {
+		printf("run <rom> [-movie file] [-frames n] [-reps n] [-json file] [-hashlog file] [-nofusion]\n");
+		return 1;
+	}
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+
+	// A movie runs for its own length unless told otherwise
+	if (!numFrames) {
+		Movie movie;
+		numFrames = (pMovie && movie.load(pMovie)) ? movie.getNumFrames() : 3600;
+	}
+	if (!numFrames) {
+		numFrames = 1;
+	}
+
+	FILE* pFile = NULL;
+	if (pJson && fopen_s(&pFile, pJson, "w") != 0) {
+		pFile = NULL;
+	}
+	if (pFile) {
+		fprintf(pFile, "{\n  \"rom\": \"%s\",\n  \"movie\": \"%s\",\n  \"frames\": %u,\n  \"reps\": %d,\n  \"workloads\": [\n",
+			pRom, pMovie ? pMovie : "", numFrames, numReps);
+	}
+
+	printf("%s%s%s, %u frames x %d reps\n\n", pRom, pMovie ? " + " : "", pMovie ? pMovie : "", numFrames, numReps);
+	printf("workload     frames/s (+-)          Minstr/s   ns/frame    p50        p90        p99\n");
+
+	for (int w = 0; w != 2; ++w) {
+		bool render = (w == 0);
+		const char* pName = render ? "render" : "norender";
+
+		// The hash log comes from a rendered run of its own, writing it
+		// would slow down a timed one
+		if (render && pHashLog) {
+			runOnce(pRom, pMovie, numFrames, render, fusion, pHashLog);
+		}
+
+		std::vector<RunResult> runs;
+		for (int rep = 0; rep != numReps; ++rep) {
+			runs.push_back(runOnce(pRom, pMovie, numFrames, render, fusion, NULL));
+		}
+
+		Spread fps = spreadOf(runs, &RunResult::framesPerSecond);
+		Spread ips = spreadOf(runs, &RunResult::instructionsPerSecond);
+		Spread ns = spreadOf(runs, &RunResult::nsPerFrame);
+		Spread p50 = spreadOf(runs, &RunResult::p50);
+		Spread p90 = spreadOf(runs, &RunResult::p90);
+		Spread p99 = spreadOf(runs, &RunResult::p99);
+		Spread maxNs = spreadOf(runs, &RunResult::maxNs);
+
+		printf("%-12s %9.0f (%7.0f) %10.2f %10.0f %10.0f %10.0f %10.0f\n",
+			pName, fps.mean, fps.stddev, ips.mean / 1e6, ns.mean, p50.mean, p90.mean, p99.mean);
+
+#ifdef NESSIE_INSTRUMENT
+		// Per frame breakdown of the last repetition
+		const EmulatorStats& s = runs.back().stats;
+		printf("%-12s cycles/frame cpu %llu io %llu render %llu dma %llu apu %llu resample %llu, %llu nmis %llu dmas\n", "",
+			s.cpuCycles, s.ioCycles, s.renderCycles, s.dmaCycles, s.apuCycles, s.resampleCycles, s.nmis, s.dmas);
+#endif
+
+		if (pFile) {
+			fprintf(pFile, "    {\n      \"name\": \"%s\",\n      \"metrics\": {\n", pName);
+			printSpread(pFile, "frames_per_second", fps, false);
+			printSpread(pFile, "instructions_per_second", ips, false);
+			printSpread(pFile, "ns_per_frame", ns, false);
+			printSpread(pFile, "frame_ns_p50", p50, false);
+			printSpread(pFile, "frame_ns_p90", p90, false);
+			printSpread(pFile, "frame_ns_p99", p99, false);
+			printSpread(pFile, "frame_ns_max", maxNs, true);
+			fprintf(pFile, "      }\n    }%s\n", w == 1 ? "" : ",");
+		}
+	}
+
+	if (pFile) {
+		fprintf(pFile, "  ]\n}\n");
+		fclose(pFile);
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchRunner.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "Tracer.h"
+
+// Steps a batch of instances with an increasing number of worker
+// threads, doubling up to 64 or the number of cores, and prints the
+// aggregate throughput of each run. With -trace the run with the most
+// threads is written as a Chrome trace, one track per instance.
+int benchScaling(int argc, char* argv[]) {
+	const char* pTraceFile = NULL;
+	if (argc >= 2 && strcmp(argv[argc - 2], "-trace") == 0) {
+		pTraceFile = argv[argc - 1];
+		argc -= 2;
+	}
+
+	if (argc < 1) {
+		printf("scaling <rom> [instances] [frames] [-trace file]\n");
+		return 1;
+	}
+
+	const char* pRom = argv[0];
+	UINT numInstances = argc > 1 ? (UINT)atoi(argv[1]) : 256;
+	UINT numSteps = argc > 2 ? (UINT)atoi(argv[2]) : 600;
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+
+	int maxThreads = ThreadPool::getNumCores();
+	if (maxThreads > 64) {
+		maxThreads = 64;
+	}
+
+	printf("%u instances, %u frames each, up to %d threads\n\n", numInstances, numSteps, maxThreads);
+	printf("threads   frames/s    speedup   efficiency\n");
+
+	double baseline = 0.0;
+	for (int threads = 1; ; threads *= 2) {
+		if (threads > maxThreads) {
+			threads = maxThreads;
+		}
+
+		BatchRunner runner(numInstances, threads);
+		runner.loadFromFile(pRom);
+
+		StepConfig config;
+		config.format = OBS_PALETTE_INDEX;
+		config.numPorts = 1;
+		config.pRamAddresses = NULL;
+		config.numRamAddresses = 0;
+		runner.configureStep(config);
+
+		BYTE* pActions = new BYTE[numInstances];
+		BYTE* pObservations = new BYTE[(size_t)numInstances * runner.getObservationSize()];
+		for (UINT i = 0; i != numInstances; ++i) {
+			pActions[i] = 0;
+		}
+
+		traceEnable(pTraceFile != NULL && threads == maxThreads);
+
+		LONGLONG start = readTimer();
+		for (UINT s = 0; s != numSteps; ++s) {
+			runner.step(pActions, 1, pObservations, NULL, NULL);
+		}
+		double seconds = timerToNs(readTimer() - start) / 1e9;
+
+		double fps = (double)numInstances * numSteps / seconds;
+		if (threads == 1) {
+			baseline = fps;
+		}
+		printf("%7d %10.0f %9.2fx %11.1f%%\n", threads, fps, fps / baseline, 100.0 * fps / baseline / threads);
+
+		delete[] pActions;
+		delete[] pObservations;
+
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+
+	if (pTraceFile) {
+		traceEnable(false);
+		if (!traceDump(pTraceFile)) {
+			printf("could not write %s\n", pTraceFile);
+			return 1;
+		}
+	}
+	return 0;
+}
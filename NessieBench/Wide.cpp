@@ -0,0 +1,88 @@
+#include "Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Emulator.h"
+#include "WideCPU.h"
+#include "Timer.h"
+
+// Runs the same ROM on a set of wide lanes and on plain scalar
+// emulators, compares the complete state of every lane with its scalar
+// twin after each frame and reports the speed of both. Lane i starts i
+// frames ahead so the lanes do not all sit on the same PC.
+int benchWide(int argc, char* argv[]) {
+	if (argc < 1) {
+		printf("wide <rom> [lanes] [frames]\n");
+		return 1;
+	}
+
+	const char* pRom = argv[0];
+	int numLanes = argc > 1 ? atoi(argv[1]) : WIDE_MAX_LANES;
+	UINT numFrames = argc > 2 ? (UINT)atoi(argv[2]) : 600;
+	if (numLanes < 1 || numLanes > WIDE_MAX_LANES) {
+		numLanes = WIDE_MAX_LANES;
+	}
+	if (!checkRom(pRom)) {
+		return 1;
+	}
+
+	Emulator* apWide[WIDE_MAX_LANES];
+	Emulator* apScalar[WIDE_MAX_LANES];
+	for (int i = 0; i != numLanes; ++i) {
+		apWide[i] = new Emulator();
+		apWide[i]->loadFromFile(pRom);
+		apScalar[i] = new Emulator();
+		apScalar[i]->loadFromFile(pRom);
+		for (int f = 0; f != i; ++f) {
+			apWide[i]->runFrame();
+			apScalar[i]->runFrame();
+		}
+	}
+
+	WideCPU wide(apWide, numLanes);
+
+	UINT stateSize = apWide[0]->getStateSize();
+	BYTE* pWideState = new BYTE[stateSize];
+	BYTE* pScalarState = new BYTE[stateSize];
+
+	LONGLONG wideTime = 0;
+	LONGLONG scalarTime = 0;
+	int result = 0;
+
+	for (UINT frame = 0; frame != numFrames && result == 0; ++frame) {
+		LONGLONG start = readTimer();
+		wide.runFrame();
+		LONGLONG middle = readTimer();
+		for (int i = 0; i != numLanes; ++i) {
+			apScalar[i]->runFrame();
+		}
+		LONGLONG end = readTimer();
+
+		wideTime += middle - start;
+		scalarTime += end - middle;
+
+		for (int i = 0; i != numLanes; ++i) {
+			apWide[i]->saveState(pWideState);
+			apScalar[i]->saveState(pScalarState);
+			if (memcmp(pWideState, pScalarState, stateSize) != 0) {
+				printf("lane %d differs from the scalar CPU after frame %u\n", i, frame);
+				result = 1;
+				break;
+			}
+		}
+	}
+
+	unsigned long long total = wide.getWideCount() + wide.getScalarCount();
+	printf("%d lanes, %u frames: %s\n", numLanes, numFrames, result ? "MISMATCH" : "all lanes match");
+	printf("wide    %10.3f ms\n", timerToNs(wideTime) / 1e6);
+	printf("scalar  %10.3f ms\n", timerToNs(scalarTime) / 1e6);
+	printf("%.1f%% of %llu lane-instructions ran wide\n", total ? 100.0 * wide.getWideCount() / total : 0.0, total);
+
+	delete[] pWideState;
+	delete[] pScalarState;
+	for (int i = 0; i != numLanes; ++i) {
+		delete apWide[i];
+		delete apScalar[i];
+	}
+	return result;
+}
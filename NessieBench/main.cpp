@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <string.h>
+#include "Bench.h"
+#include "Emulator.h"
+
+struct BenchCommand {
+	const char*	pName;
+	int			(*pFunc)( int argc, char* argv[] );
+	const char*	pUsage;
+};
+
+static const BenchCommand commands[] = {
+	{ "battery",	benchBattery,	"battery <rom> <save file> [-frames n]   frame time with a battery save against the time spent flushing it" },
+	{ "hashcmp",	benchHashCompare,	"hashcmp <log a> <log b>              first frame where two frame hash logs differ" },
+	{ "index",		benchIndex,		"index <rom directory> <index file> [-threads n]   hash a ROM library, .nes and .zip, into a header database" },
+	{ "micro",		benchMicro,		"micro <rom>                          bus, CPU dispatch, PPU, DMA and save state in cycles/op" },
+	{ "nestest",	benchNestest,	"nestest <rom> <log> [-backend switch|wide|fused] [-trace file]   CPU trace against the reference log" },
+	{ "opcodes",	benchOpcodes,	"opcodes <rom> [instances] [frames] [prefix]   per-opcode and pair counters as CSV" },
+	{ "profile",	benchProfile,	"profile <rom> [-movie file] [-frames n] [-interval cycles] [-labels file] [-out file]   guest profiler, folded stacks" },
+	{ "record",		benchRecord,	"record <rom> <output base> [-frames n] [-queue n] [-raw]   emulation speed lost to dumping audio and video" },
+	{ "run",		benchRun,		"run <rom> [-movie file] [-frames n] [-reps n] [-json file] [-hashlog file] [-nofusion]   headless ROM/movie workload" },
+	{ "scaling",	benchScaling,	"scaling <rom> [instances] [frames] [-trace file]   batch runner throughput from 1 thread to one per core" },
+	{ "wide",		benchWide,		"wide <rom> [lanes] [frames]          lockstep interpreter against the scalar CPU" },
+};
+
+bool checkRom(const char* pRom) {
+	Emulator emu;
+	if (!emu.loadFromFile(pRom)) {
+		printf("could not load %s: %s\n", pRom, emu.getLoadError());
+		return false;
+	}
+	return true;
+}
+
+static void printUsage() {
+	printf("usage: nessie-bench <command> [args]\n\n");
+	for (int i = 0; i != sizeof(commands) / sizeof(commands[0]); ++i) {
+		printf("  %s\n", commands[i].pUsage);
+	}
+}
+
+int main( int argc, char* argv[] ) {
+	if (argc < 2) {
+		printUsage();
+		return 1;
+	}
+
+	for (int i = 0; i != sizeof(commands) / sizeof(commands[0]); ++i) {
+		if (strcmp(argv[1], commands[i].pName) == 0) {
+			return commands[i].pFunc(argc - 2, argv + 2);
+		}
+	}
+
+	printUsage();
+	return 1;
+}